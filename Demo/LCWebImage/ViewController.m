@@ -43,6 +43,8 @@
     [(LCAutoPurgingImageCache *)[LCWebImageManager defaultInstance].imageCache setCustomDecodedImage:^UIImage * _Nonnull(NSData * _Nonnull data, NSString * _Nonnull identifier) {
         return [[YYImage alloc] initWithData:data scale:UIScreen.mainScreen.scale];
     }];
+    // 忽略会过期的签名参数
+    [LCWebImageManager defaultInstance].cacheKeyFilter = [LCWebImageManager cacheKeyFilterRemovingQueryItemNames:@[@"sec", @"t"]];
 
     self.images = @[
         // gif
@@ -0,0 +1,78 @@
+//
+//  LCImageBufferPoolTests.m
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import <XCTest/XCTest.h>
+#import "LCImageBufferPool.h"
+
+static const size_t kLCTestImageWidth = 2048;
+static const size_t kLCTestImageHeight = 1536;
+static const NSUInteger kLCTestImageCount = 20;
+
+@interface LCImageBufferPoolTests : XCTestCase
+
+@end
+
+@implementation LCImageBufferPoolTests
+
+- (void)testReleasedImageGivesItsBufferBack {
+    LCImageBufferPool *pool = [[LCImageBufferPool alloc] init];
+    pool.maximumPooledBytes = 64 * 1024 * 1024;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaNoneSkipFirst;
+    CGContextRef context = [pool newBitmapContextWithWidth:kLCTestImageWidth height:kLCTestImageHeight bitsPerComponent:8 bytesPerRow:kLCTestImageWidth * 4 colorSpace:colorSpace bitmapInfo:bitmapInfo];
+    void *buffer = CGBitmapContextGetData(context);
+    CGImageRef imageRef = [pool newImageFromBitmapContext:context];
+    CGContextRelease(context);
+    XCTAssertTrue(imageRef != NULL);
+    XCTAssertEqual(pool.pooledBytes, 0);
+    CGImageRelease(imageRef);
+    XCTAssertGreaterThanOrEqual(pool.pooledBytes, kLCTestImageWidth * kLCTestImageHeight * 4);
+
+    // the next decode of the same size reuses it
+    context = [pool newBitmapContextWithWidth:kLCTestImageWidth height:kLCTestImageHeight bitsPerComponent:8 bytesPerRow:kLCTestImageWidth * 4 colorSpace:colorSpace bitmapInfo:bitmapInfo];
+    XCTAssertEqual(CGBitmapContextGetData(context), buffer);
+    XCTAssertEqual(pool.pooledBytes, 0);
+    [pool recycleBitmapContext:context];
+    CGColorSpaceRelease(colorSpace);
+}
+
+// Draws and releases images the size of a scaled-down photo, one after the other like a scrolling list does.
+- (void)measureImagesDrawnWithPool:(nullable LCImageBufferPool *)pool {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaNoneSkipFirst;
+    CGRect rect = CGRectMake(0, 0, kLCTestImageWidth, kLCTestImageHeight);
+    [self measureWithMetrics:@[[[XCTClockMetric alloc] init], [[XCTMemoryMetric alloc] init]] block:^{
+        for (NSUInteger index = 0; index < kLCTestImageCount; index++) {
+            CGContextRef context = NULL;
+            CGImageRef imageRef = NULL;
+            if (pool) {
+                context = [pool newBitmapContextWithWidth:kLCTestImageWidth height:kLCTestImageHeight bitsPerComponent:8 bytesPerRow:kLCTestImageWidth * 4 colorSpace:colorSpace bitmapInfo:bitmapInfo];
+            } else {
+                context = CGBitmapContextCreate(NULL, kLCTestImageWidth, kLCTestImageHeight, 8, kLCTestImageWidth * 4, colorSpace, bitmapInfo);
+            }
+            CGContextSetGrayFillColor(context, (CGFloat)index / kLCTestImageCount, 1);
+            CGContextFillRect(context, rect);
+            imageRef = pool ? [pool newImageFromBitmapContext:context] : CGBitmapContextCreateImage(context);
+            CGContextRelease(context);
+            XCTAssertTrue(imageRef != NULL);
+            CGImageRelease(imageRef);
+        }
+    }];
+    CGColorSpaceRelease(colorSpace);
+}
+
+- (void)testPooledBufferPerformance {
+    LCImageBufferPool *pool = [[LCImageBufferPool alloc] init];
+    pool.maximumPooledBytes = 64 * 1024 * 1024;
+    [self measureImagesDrawnWithPool:pool];
+}
+
+- (void)testUnpooledBufferPerformance {
+    [self measureImagesDrawnWithPool:nil];
+}
+
+@end
@@ -0,0 +1,145 @@
+//
+//  LCImageHeaderParserTests.m
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import <XCTest/XCTest.h>
+#import "LCImageHeaderParser.h"
+
+@interface LCImageHeaderParserTests : XCTestCase
+
+@end
+
+@implementation LCImageHeaderParserTests
+
+- (NSData *)dataOfImageNamed:(NSString *)name {
+    NSURL *URL = [[NSBundle bundleForClass:[self class]] URLForResource:name withExtension:nil subdirectory:@"Images"];
+    NSData *data = URL ? [NSData dataWithContentsOfURL:URL] : nil;
+    XCTAssertNotNil(data, @"%@", name);
+    return data;
+}
+
+// Every prefix shorter than the header needs more bytes, the header itself is enough.
+- (LCImageHeader *)assertHeaderOfImageNamed:(NSString *)name isReadAfter:(NSUInteger)length {
+    NSData *data = [self dataOfImageNamed:name];
+    for (NSUInteger prefixLength = 0; prefixLength < length; prefixLength++) {
+        NSData *prefix = [data subdataWithRange:NSMakeRange(0, prefixLength)];
+        XCTAssertNil(LCImageProbeHeader(prefix), @"%@ truncated to %lu bytes", name, (unsigned long)prefixLength);
+    }
+    LCImageHeader *header = LCImageProbeHeader([data subdataWithRange:NSMakeRange(0, length)]);
+    XCTAssertNotNil(header, @"%@ truncated to %lu bytes", name, (unsigned long)length);
+    return header;
+}
+
+- (void)testJPEGHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"plain.jpg" isReadAfter:168];
+    XCTAssertEqual(header.type, LCImageTypeJPEG);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(321, 123)));
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationUp);
+    XCTAssertEqual(header.frameCount, 1);
+    XCTAssertFalse(header.hasAlpha);
+}
+
+- (void)testJPEGHeaderWaitsForTheEXIFOrientation {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"o6.jpg" isReadAfter:204];
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(321, 123)));
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationRight);
+    XCTAssertTrue(CGSizeEqualToSize(header.orientedPixelSize, CGSizeMake(123, 321)));
+}
+
+- (void)testPNGHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"rgb.png" isReadAfter:41];
+    XCTAssertEqual(header.type, LCImageTypePNG);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(50, 40)));
+    XCTAssertEqual(header.frameCount, 1);
+    XCTAssertFalse(header.hasAlpha);
+
+    XCTAssertTrue([self assertHeaderOfImageNamed:@"rgba.png" isReadAfter:41].hasAlpha);
+    // a transparent color is declared in tRNS, after the header chunk
+    XCTAssertTrue([self assertHeaderOfImageNamed:@"ptrns.png" isReadAfter:69].hasAlpha);
+}
+
+- (void)testAPNGHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"anim.png" isReadAfter:99];
+    XCTAssertEqual(header.type, LCImageTypePNG);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(30, 20)));
+    XCTAssertEqual(header.frameCount, 3);
+}
+
+- (void)testGIFHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"still.gif" isReadAfter:35];
+    XCTAssertEqual(header.type, LCImageTypeGIF);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(30, 20)));
+    // frames are only counted in the whole data
+    XCTAssertEqual(header.frameCount, 0);
+    XCTAssertFalse(header.hasAlpha);
+    XCTAssertEqual(LCImageProbeHeader([self dataOfImageNamed:@"still.gif"]).frameCount, 1);
+
+    XCTAssertTrue([self assertHeaderOfImageNamed:@"trans.gif" isReadAfter:37].hasAlpha);
+
+    header = LCImageProbeHeader([self dataOfImageNamed:@"anim.gif"]);
+    XCTAssertEqual(header.frameCount, 3);
+    XCTAssertTrue(header.hasAlpha);
+}
+
+- (void)testWebPHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"lossy.webp" isReadAfter:30];
+    XCTAssertEqual(header.type, LCImageTypeWebP);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(77, 66)));
+    XCTAssertEqual(header.frameCount, 1);
+    XCTAssertFalse(header.hasAlpha);
+
+    XCTAssertTrue([self assertHeaderOfImageNamed:@"lossy_alpha.webp" isReadAfter:30].hasAlpha);
+    XCTAssertTrue([self assertHeaderOfImageNamed:@"lossless.webp" isReadAfter:30].hasAlpha);
+
+    header = [self assertHeaderOfImageNamed:@"anim.webp" isReadAfter:30];
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(30, 20)));
+    XCTAssertEqual(header.frameCount, 0);
+    XCTAssertEqual(LCImageProbeHeader([self dataOfImageNamed:@"anim.webp"]).frameCount, 3);
+
+    // the EXIF chunk follows the image data
+    header = LCImageProbeHeader([self dataOfImageNamed:@"exif.webp"]);
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationRight);
+    XCTAssertTrue(CGSizeEqualToSize(header.orientedPixelSize, CGSizeMake(123, 321)));
+}
+
+- (void)testHEIFHeader {
+    LCImageHeader *header = [self assertHeaderOfImageNamed:@"plain.heic" isReadAfter:222];
+    XCTAssertEqual(header.type, LCImageTypeHEIC);
+    XCTAssertTrue(CGSizeEqualToSize(header.pixelSize, CGSizeMake(4032, 3024)));
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationUp);
+    XCTAssertEqual(header.frameCount, 1);
+    XCTAssertFalse(header.hasAlpha);
+
+    // a quarter turn and an alpha auxiliary image
+    header = [self assertHeaderOfImageNamed:@"rot.heic" isReadAfter:254];
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationLeft);
+    XCTAssertTrue(CGSizeEqualToSize(header.orientedPixelSize, CGSizeMake(3024, 4032)));
+    XCTAssertTrue(header.hasAlpha);
+
+    // a quarter turn and a mirroring
+    header = [self assertHeaderOfImageNamed:@"rotmir.heic" isReadAfter:224];
+    XCTAssertEqual(header.orientation, kCGImagePropertyOrientationRightMirrored);
+}
+
+- (void)testPixelSizeFromTruncatedHeader {
+    NSData *data = [self dataOfImageNamed:@"o6.jpg"];
+    XCTAssertTrue(CGSizeEqualToSize(LCImagePixelSizeFromHeader([data subdataWithRange:NSMakeRange(0, 100)]), CGSizeZero));
+    XCTAssertTrue(CGSizeEqualToSize(LCImagePixelSizeFromHeader(data), CGSizeMake(321, 123)));
+    XCTAssertEqual(LCImageDetectType([data subdataWithRange:NSMakeRange(0, 16)]), LCImageTypeJPEG);
+}
+
+- (void)testDictionaryRepresentation {
+    LCImageHeader *header = LCImageProbeHeader([self dataOfImageNamed:@"rot.heic"]);
+    LCImageHeader *decodedHeader = [[LCImageHeader alloc] initWithDictionary:header.dictionaryRepresentation];
+    XCTAssertEqual(decodedHeader.type, header.type);
+    XCTAssertTrue(CGSizeEqualToSize(decodedHeader.pixelSize, header.pixelSize));
+    XCTAssertEqual(decodedHeader.orientation, header.orientation);
+    XCTAssertEqual(decodedHeader.frameCount, header.frameCount);
+    XCTAssertEqual(decodedHeader.hasAlpha, header.hasAlpha);
+    XCTAssertNil([[LCImageHeader alloc] initWithDictionary:@{}]);
+}
+
+@end
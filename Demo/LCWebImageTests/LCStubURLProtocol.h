@@ -0,0 +1,42 @@
+//
+//  LCStubURLProtocol.h
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A canned response of `LCStubURLProtocol`.
+@interface LCStubResponse : NSObject
+
+@property (nonatomic, assign) NSInteger statusCode;
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *headers;
+@property (nonatomic, copy) NSData *body;
+/// The connection is lost after this many bytes of the body. NSNotFound to send it whole.
+@property (nonatomic, assign) NSUInteger failureOffset;
+/// The time before the response is sent.
+@property (nonatomic, assign) NSTimeInterval delay;
+
++ (instancetype)responseWithStatusCode:(NSInteger)statusCode headers:(nullable NSDictionary<NSString *, NSString *> *)headers body:(nullable NSData *)body;
+
+@end
+
+/// Answers every request of a session configured with it with the response of its provider, and records the requests.
+@interface LCStubURLProtocol : NSURLProtocol
+
+/// The configuration of a session whose requests are all stubbed.
++ (NSURLSessionConfiguration *)sessionConfiguration;
+
++ (void)setResponseProvider:(nullable LCStubResponse * (^)(NSURLRequest *request))responseProvider;
+
+/// The requests received so far, in order.
++ (NSArray<NSURLRequest *> *)receivedRequests;
+
++ (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,115 @@
+//
+//  LCStubURLProtocol.m
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import "LCStubURLProtocol.h"
+#import <os/lock.h>
+
+@implementation LCStubResponse
+
++ (instancetype)responseWithStatusCode:(NSInteger)statusCode headers:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body {
+    LCStubResponse *response = [[self alloc] init];
+    response.statusCode = statusCode;
+    response.headers = headers ?: @{};
+    response.body = body ?: [NSData data];
+    response.failureOffset = NSNotFound;
+    return response;
+}
+
+@end
+
+static os_unfair_lock LCStubLock = OS_UNFAIR_LOCK_INIT;
+static LCStubResponse * (^LCStubResponseProvider)(NSURLRequest *request);
+static NSMutableArray<NSURLRequest *> *LCStubReceivedRequests;
+
+@interface LCStubURLProtocol ()
+@property (atomic, assign, getter=isStopped) BOOL stopped;
+@end
+
+@implementation LCStubURLProtocol
+
++ (NSURLSessionConfiguration *)sessionConfiguration {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[self];
+    configuration.URLCache = nil;
+    return configuration;
+}
+
++ (void)setResponseProvider:(LCStubResponse * (^)(NSURLRequest *request))responseProvider {
+    os_unfair_lock_lock(&LCStubLock);
+    LCStubResponseProvider = [responseProvider copy];
+    os_unfair_lock_unlock(&LCStubLock);
+}
+
++ (NSArray<NSURLRequest *> *)receivedRequests {
+    os_unfair_lock_lock(&LCStubLock);
+    NSArray<NSURLRequest *> *requests = [LCStubReceivedRequests copy] ?: @[];
+    os_unfair_lock_unlock(&LCStubLock);
+    return requests;
+}
+
++ (void)reset {
+    os_unfair_lock_lock(&LCStubLock);
+    LCStubResponseProvider = nil;
+    LCStubReceivedRequests = nil;
+    os_unfair_lock_unlock(&LCStubLock);
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+    return YES;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+    return request;
+}
+
+- (void)startLoading {
+    os_unfair_lock_lock(&LCStubLock);
+    if (LCStubReceivedRequests == nil) {
+        LCStubReceivedRequests = [NSMutableArray array];
+    }
+    [LCStubReceivedRequests addObject:self.request];
+    LCStubResponse * (^responseProvider)(NSURLRequest *) = LCStubResponseProvider;
+    os_unfair_lock_unlock(&LCStubLock);
+    LCStubResponse *stubResponse = responseProvider ? responseProvider(self.request) : nil;
+    if (stubResponse == nil) {
+        stubResponse = [LCStubResponse responseWithStatusCode:404 headers:nil body:nil];
+    }
+    // the client is called back on the run loop that started the load
+    CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+    CFRetain(runLoop);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(stubResponse.delay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        CFRunLoopPerformBlock(runLoop, kCFRunLoopCommonModes, ^{
+            [self sendResponse:stubResponse];
+        });
+        CFRunLoopWakeUp(runLoop);
+        CFRelease(runLoop);
+    });
+}
+
+- (void)sendResponse:(LCStubResponse *)stubResponse {
+    if (self.isStopped) {
+        return;
+    }
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:stubResponse.statusCode HTTPVersion:@"HTTP/1.1" headerFields:stubResponse.headers];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    NSData *body = stubResponse.body;
+    if (stubResponse.failureOffset < body.length) {
+        [self.client URLProtocol:self didLoadData:[body subdataWithRange:NSMakeRange(0, stubResponse.failureOffset)]];
+        [self.client URLProtocol:self didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+        return;
+    }
+    if (body.length > 0) {
+        [self.client URLProtocol:self didLoadData:body];
+    }
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading {
+    self.stopped = YES;
+}
+
+@end
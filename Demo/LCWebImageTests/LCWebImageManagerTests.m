@@ -0,0 +1,232 @@
+//
+//  LCWebImageManagerTests.m
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import <XCTest/XCTest.h>
+#import <ImageIO/ImageIO.h>
+#import "LCWebImageManager.h"
+#import "LCStubURLProtocol.h"
+
+@interface LCWebImageManagerTests : XCTestCase
+@property (nonatomic, strong) LCWebImageManager *manager;
+@property (nonatomic, copy) NSString *cachePath;
+@end
+
+@implementation LCWebImageManagerTests
+
+- (void)setUp {
+    [super setUp];
+    [LCStubURLProtocol reset];
+    self.cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    LCAutoPurgingImageCache *imageCache = [[LCAutoPurgingImageCache alloc] init];
+    imageCache.diskCache = [[LCImageDiskCache alloc] initWithCachePath:self.cachePath];
+    AFHTTPSessionManager *sessionManager = [[AFHTTPSessionManager alloc] initWithSessionConfiguration:[LCStubURLProtocol sessionConfiguration]];
+    sessionManager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    self.manager = [[LCWebImageManager alloc] initWithSessionManager:sessionManager
+                                              downloadPrioritization:LCImageDownloadPrioritizationFIFO
+                                              maximumActiveDownloads:4
+                                                          imageCache:imageCache];
+}
+
+- (void)tearDown {
+    [self.manager.sessionManager invalidateSessionCancelingTasks:YES resetSession:NO];
+    self.manager = nil;
+    [LCStubURLProtocol reset];
+    [[NSFileManager defaultManager] removeItemAtPath:self.cachePath error:nil];
+    [super tearDown];
+}
+
+- (NSURL *)imageURL {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"https://example.com/%@.png", [NSUUID UUID].UUIDString]];
+}
+
+// A PNG of random pixels, which barely compresses.
+- (NSData *)noisePNGDataWithWidth:(size_t)width height:(size_t)height {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRelease(colorSpace);
+    arc4random_buf(CGBitmapContextGetData(context), CGBitmapContextGetBytesPerRow(context) * height);
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, (__bridge CFStringRef)@"public.png", 1, NULL);
+    CGImageDestinationAddImage(destination, imageRef, NULL);
+    XCTAssertTrue(CGImageDestinationFinalize(destination));
+    CFRelease(destination);
+    CGImageRelease(imageRef);
+    return data;
+}
+
+// Runs the main run loop until the condition holds, the manager delivers and stores asynchronously.
+- (BOOL)waitForCondition:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+- (void)testDiskLoadJoiningAFailedDownloadCompletes {
+    [LCStubURLProtocol setResponseProvider:^LCStubResponse *(NSURLRequest *request) {
+        LCStubResponse *response = [LCStubResponse responseWithStatusCode:404 headers:nil body:nil];
+        // long enough for the disk load to join the download
+        response.delay = 0.2;
+        return response;
+    }];
+    NSURL *URL = [self imageURL];
+    XCTestExpectation *downloadExpectation = [self expectationWithDescription:@"download"];
+    [self.manager downloadImageForURLRequest:[NSURLRequest requestWithURL:URL] options:0 success:^(NSURLRequest *request, NSHTTPURLResponse *response, UIImage *responseObject) {
+        XCTFail(@"the download should fail");
+    } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error) {
+        [downloadExpectation fulfill];
+    }];
+    XCTestExpectation *diskExpectation = [self expectationWithDescription:@"disk load"];
+    [self.manager diskImageForURL:URL withReceiptID:[NSUUID UUID] completion:^(UIImage *image) {
+        XCTAssertNil(image);
+        [diskExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual([LCStubURLProtocol receivedRequests].count, 1);
+}
+
+- (void)testDroppedDownloadResumesWithRange {
+    NSData *body = [self noisePNGDataWithWidth:64 height:64];
+    NSUInteger dropOffset = body.length / 2;
+    NSString *ETag = @"\"v1\"";
+    self.manager.resumableDownloadMinimumBytes = 1024;
+    [LCStubURLProtocol setResponseProvider:^LCStubResponse *(NSURLRequest *request) {
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        if (range == nil) {
+            LCStubResponse *response = [LCStubResponse responseWithStatusCode:200 headers:@{@"Content-Type": @"image/png", @"Content-Length": @(body.length).stringValue, @"Accept-Ranges": @"bytes", @"ETag": ETag} body:body];
+            response.failureOffset = dropOffset;
+            return response;
+        }
+        long long start = [[range substringFromIndex:@"bytes=".length] longLongValue];
+        NSString *contentRange = [NSString stringWithFormat:@"bytes %lld-%lu/%lu", start, (unsigned long)body.length - 1, (unsigned long)body.length];
+        NSData *rest = [body subdataWithRange:NSMakeRange((NSUInteger)start, body.length - (NSUInteger)start)];
+        return [LCStubResponse responseWithStatusCode:206 headers:@{@"Content-Type": @"image/png", @"Content-Length": @(rest.length).stringValue, @"Content-Range": contentRange, @"ETag": ETag} body:rest];
+    }];
+    NSURL *URL = [self imageURL];
+    NSString *cacheKey = [self.manager cacheKeyForURL:URL];
+    LCAutoPurgingImageCache *imageCache = (LCAutoPurgingImageCache *)self.manager.imageCache;
+
+    XCTestExpectation *droppedExpectation = [self expectationWithDescription:@"dropped download"];
+    [self.manager downloadImageForURLRequest:[NSURLRequest requestWithURL:URL] options:0 success:^(NSURLRequest *request, NSHTTPURLResponse *response, UIImage *responseObject) {
+        XCTFail(@"the download should be dropped");
+    } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error) {
+        XCTAssertEqual(error.code, NSURLErrorNetworkConnectionLost);
+        [droppedExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    // the received half is stored next to the image
+    NSString *partialIdentifier = [@"partial:" stringByAppendingString:cacheKey];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [imageCache diskMetadataWithIdentifier:partialIdentifier] != nil;
+    } timeout:5]);
+
+    XCTestExpectation *resumedExpectation = [self expectationWithDescription:@"resumed download"];
+    [self.manager downloadImageForURLRequest:[NSURLRequest requestWithURL:URL] options:0 success:^(NSURLRequest *request, NSHTTPURLResponse *response, UIImage *responseObject) {
+        XCTAssertEqual(response.statusCode, 206);
+        XCTAssertEqual(CGImageGetWidth(responseObject.CGImage), 64);
+        XCTAssertEqual(CGImageGetHeight(responseObject.CGImage), 64);
+        [resumedExpectation fulfill];
+    } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error) {
+        XCTFail(@"%@", error);
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    NSArray<NSURLRequest *> *requests = [LCStubURLProtocol receivedRequests];
+    XCTAssertEqual(requests.count, 2);
+    XCTAssertNil([requests.firstObject valueForHTTPHeaderField:@"Range"]);
+    NSString *expectedRange = [NSString stringWithFormat:@"bytes=%lu-", (unsigned long)dropOffset];
+    XCTAssertEqualObjects([requests.lastObject valueForHTTPHeaderField:@"Range"], expectedRange);
+    XCTAssertEqualObjects([requests.lastObject valueForHTTPHeaderField:@"If-Range"], ETag);
+    // the stored image is the stitched body, and the partial data is gone
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [[imageCache diskDataWithIdentifier:cacheKey] isEqualToData:body] && ![imageCache containsDiskDataWithIdentifier:partialIdentifier];
+    } timeout:5]);
+}
+
+- (void)testStaleDiskDataIsRevalidated {
+    self.manager.shouldValidateDiskCache = YES;
+    NSData *body = [self noisePNGDataWithWidth:8 height:8];
+    NSString *ETag = @"\"v1\"";
+    NSURL *URL = [self imageURL];
+    NSString *cacheKey = [self.manager cacheKeyForURL:URL];
+    LCAutoPurgingImageCache *imageCache = (LCAutoPurgingImageCache *)self.manager.imageCache;
+    [imageCache addDiskData:body withIdentifier:cacheKey];
+    [imageCache addDiskMetadata:@{LCImageDiskMetadataETagKey: ETag, LCImageDiskMetadataExpirationDateKey: [NSDate dateWithTimeIntervalSinceNow:-60]} withIdentifier:cacheKey];
+    [LCStubURLProtocol setResponseProvider:^LCStubResponse *(NSURLRequest *request) {
+        return [LCStubResponse responseWithStatusCode:304 headers:@{@"ETag": ETag, @"Cache-Control": @"max-age=600"} body:nil];
+    }];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"disk load"];
+    [self.manager diskImageForURL:URL withReceiptID:[NSUUID UUID] completion:^(UIImage *image) {
+        XCTAssertEqual(CGImageGetWidth(image.CGImage), 8);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    NSArray<NSURLRequest *> *requests = [LCStubURLProtocol receivedRequests];
+    XCTAssertEqual(requests.count, 1);
+    XCTAssertEqualObjects([requests.firstObject valueForHTTPHeaderField:@"If-None-Match"], ETag);
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        NSDate *expirationDate = [imageCache diskMetadataWithIdentifier:cacheKey][LCImageDiskMetadataExpirationDateKey];
+        return [expirationDate timeIntervalSinceNow] > 0;
+    } timeout:5]);
+}
+
+- (void)testMetadataWriteKeepsTheModificationDate {
+    LCAutoPurgingImageCache *imageCache = (LCAutoPurgingImageCache *)self.manager.imageCache;
+    NSString *identifier = @"metadata";
+    [imageCache addDiskData:[NSData dataWithBytes:"data" length:4] withIdentifier:identifier];
+    NSString *path = [imageCache.diskCache cachePathWithIdentifier:identifier];
+    NSDate *modificationDate = [NSDate dateWithTimeIntervalSince1970:1000000000];
+    XCTAssertTrue([[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: modificationDate} ofItemAtPath:path error:nil]);
+
+    [imageCache addDiskMetadata:@{LCImageDiskMetadataOpaqueKey: @YES} withIdentifier:identifier];
+    XCTAssertEqualObjects([imageCache diskMetadataWithIdentifier:identifier][LCImageDiskMetadataOpaqueKey], @YES);
+    XCTAssertEqualObjects([[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil].fileModificationDate, modificationDate);
+
+    // a revalidation refreshes it
+    [imageCache refreshDiskDataWithIdentifier:identifier];
+    XCTAssertLessThan(fabs([[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil].fileModificationDate.timeIntervalSinceNow), 60);
+}
+
+- (void)testConcurrentDownloadAndCancelPerformance {
+    [LCStubURLProtocol setResponseProvider:^LCStubResponse *(NSURLRequest *request) {
+        LCStubResponse *response = [LCStubResponse responseWithStatusCode:404 headers:nil body:nil];
+        // the downloads stay in flight while they are joined and cancelled
+        response.delay = 1;
+        return response;
+    }];
+    LCWebImageManager *manager = self.manager;
+    // new URLs for every run, so that no run joins the downloads of the previous one
+    NSMutableArray<NSArray<NSURL *> *> *URLBatches = [NSMutableArray array];
+    for (NSUInteger batch = 0; batch < 10; batch++) {
+        NSMutableArray<NSURL *> *URLs = [NSMutableArray array];
+        for (NSUInteger index = 0; index < 32; index++) {
+            [URLs addObject:[self imageURL]];
+        }
+        [URLBatches addObject:URLs];
+    }
+    __block NSUInteger run = 0;
+    [self measureBlock:^{
+        NSArray<NSURL *> *URLs = URLBatches[run++ % URLBatches.count];
+        dispatch_apply(512, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t iteration) {
+            NSURLRequest *request = [NSURLRequest requestWithURL:URLs[iteration % URLs.count]];
+            LCImageDownloadReceipt *receipt = [manager downloadImageForURLRequest:request options:0 success:nil failure:nil];
+            // every other request is cancelled, the merged tasks lose and regain handlers
+            if (iteration % 2 == 1 && receipt) {
+                [manager cancelTaskForImageDownloadReceipt:receipt];
+            }
+        });
+    }];
+}
+
+@end
@@ -0,0 +1,226 @@
+//
+//  UIImage+LCDecoderTests.m
+//  LCWebImageTests
+//
+//  Created by 刘畅 on 2026/10/19.
+//
+
+#import <XCTest/XCTest.h>
+#import <ImageIO/ImageIO.h>
+#import "UIImage+LCDecoder.h"
+#import "LCImageDecodeScheduler.h"
+
+@interface UIImage_LCDecoderTests : XCTestCase
+
+@end
+
+@implementation UIImage_LCDecoderTests
+
+// A PNG with an alpha channel, filled with a gray of the given alpha, and one pixel of another alpha.
+- (NSData *)PNGDataWithWidth:(size_t)width height:(size_t)height alpha:(uint8_t)alpha pixelAlpha:(uint8_t)pixelAlpha {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    uint8_t *bytes = CGBitmapContextGetData(context);
+    size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t pixelAlphaValue = x == width / 2 && y == height / 2 ? pixelAlpha : alpha;
+            uint8_t *pixel = bytes + y * bytesPerRow + x * 4;
+            pixel[0] = pixel[1] = pixel[2] = pixelAlphaValue / 2;
+            pixel[3] = pixelAlphaValue;
+        }
+    }
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, (__bridge CFStringRef)@"public.png", 1, NULL);
+    CGImageDestinationAddImage(destination, imageRef, NULL);
+    XCTAssertTrue(CGImageDestinationFinalize(destination));
+    CFRelease(destination);
+    CGImageRelease(imageRef);
+    return data;
+}
+
+- (CGImageAlphaInfo)alphaInfoOfImageDecodedFromData:(NSData *)data opacity:(LCImageOpacity)opacity {
+    UIImage *image = [UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:0 maximumPixelSize:0 targetPixelSize:CGSizeZero contentMode:UIViewContentModeScaleToFill opacity:opacity cancelled:nil];
+    XCTAssertNotNil(image);
+    return CGImageGetAlphaInfo(image.CGImage);
+}
+
+- (void)testDeclaredButUnusedAlphaIsDroppedAfterTheScan {
+    NSData *data = [self PNGDataWithWidth:33 height:17 alpha:255 pixelAlpha:255];
+    XCTAssertEqual([self alphaInfoOfImageDecodedFromData:data opacity:LCImageOpacityUnknown], kCGImageAlphaNoneSkipFirst);
+}
+
+- (void)testUsedAlphaIsKept {
+    // a single pixel that is not opaque, past the first vector of the scan
+    NSData *data = [self PNGDataWithWidth:33 height:17 alpha:255 pixelAlpha:128];
+    XCTAssertEqual([self alphaInfoOfImageDecodedFromData:data opacity:LCImageOpacityUnknown], kCGImageAlphaPremultipliedFirst);
+}
+
+- (void)testKnownOpacitySkipsTheScan {
+    NSData *data = [self PNGDataWithWidth:33 height:17 alpha:255 pixelAlpha:255];
+    XCTAssertEqual([self alphaInfoOfImageDecodedFromData:data opacity:LCImageOpacityTranslucent], kCGImageAlphaPremultipliedFirst);
+    data = [self PNGDataWithWidth:33 height:17 alpha:255 pixelAlpha:128];
+    XCTAssertEqual([self alphaInfoOfImageDecodedFromData:data opacity:LCImageOpacityOpaque], kCGImageAlphaNoneSkipFirst);
+}
+
+- (void)testScaledDownBandsAreScanned {
+    UIImage *image = [UIImage imageWithData:[self PNGDataWithWidth:400 height:300 alpha:255 pixelAlpha:255]];
+    UIImage *scaledDownImage = [UIImage lc_decodedAndScaledDownImageWithImage:image limitBytes:100 * 75 * 4];
+    XCTAssertLessThan(CGImageGetWidth(scaledDownImage.CGImage), 400);
+    XCTAssertEqual(CGImageGetAlphaInfo(scaledDownImage.CGImage), kCGImageAlphaNoneSkipFirst);
+}
+
+- (void)testRotatedJPEGFitsTheTargetUpright {
+    // 321x123 pixels stored, displayed 123x321 after a quarter turn
+    NSURL *URL = [[NSBundle bundleForClass:[self class]] URLForResource:@"o6.jpg" withExtension:nil subdirectory:@"Images"];
+    NSData *data = [NSData dataWithContentsOfURL:URL];
+    XCTAssertNotNil(data);
+    UIImage *image = [UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:0 maximumPixelSize:0 targetPixelSize:CGSizeMake(100, 50) contentMode:UIViewContentModeScaleAspectFit cancelled:nil];
+    XCTAssertEqual(image.imageOrientation, UIImageOrientationUp);
+    // fitted by its height, not by the width of the stored pixels
+    size_t width = CGImageGetWidth(image.CGImage);
+    size_t height = CGImageGetHeight(image.CGImage);
+    XCTAssertTrue(height >= 50 && height <= 51, @"%zux%zu", width, height);
+    XCTAssertTrue(width >= 19 && width <= 20, @"%zux%zu", width, height);
+
+    CGSize decodedPixelSize = [UIImage lc_decodedPixelSizeForPixelSize:CGSizeMake(123, 321) limitBytes:0 maximumPixelSize:0 targetPixelSize:CGSizeMake(100, 50) contentMode:UIViewContentModeScaleAspectFit];
+    XCTAssertEqual(decodedPixelSize.width, width);
+    XCTAssertEqual(decodedPixelSize.height, height);
+
+    // a target the image already fits in keeps the full size
+    image = [UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:0 maximumPixelSize:0 targetPixelSize:CGSizeMake(200, 400) contentMode:UIViewContentModeScaleAspectFit cancelled:nil];
+    XCTAssertTrue(CGSizeEqualToSize(image.size, CGSizeMake(123, 321)), @"%@", NSStringFromCGSize(image.size));
+}
+
+// Core Animation uploads a bitmap without copying it at commit time when its rows are aligned to 64 bytes, in 8 bits BGRA of the host order.
+- (void)assertImageNeedsNoCopyAtCommit:(UIImage *)image {
+    CGImageRef imageRef = image.CGImage;
+    XCTAssertTrue(imageRef != NULL);
+    XCTAssertEqual(CGImageGetBytesPerRow(imageRef) % 64, 0);
+    XCTAssertEqual(CGImageGetBitsPerComponent(imageRef), 8);
+    XCTAssertEqual(CGImageGetBitsPerPixel(imageRef), 32);
+    XCTAssertEqual(CGImageGetBitmapInfo(imageRef) & kCGBitmapByteOrderMask, kCGBitmapByteOrder32Host);
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(imageRef);
+    XCTAssertTrue(alphaInfo == kCGImageAlphaPremultipliedFirst || alphaInfo == kCGImageAlphaNoneSkipFirst);
+}
+
+- (void)testDecodedRowsAreAligned {
+    // 33 pixels, 132 bytes, would not be aligned without padding
+    NSData *data = [self PNGDataWithWidth:33 height:17 alpha:255 pixelAlpha:128];
+    [self assertImageNeedsNoCopyAtCommit:[UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:0 maximumPixelSize:0 cancelled:nil]];
+}
+
+- (void)testThumbnailRowsAreAligned {
+    NSData *data = [self PNGDataWithWidth:333 height:217 alpha:255 pixelAlpha:128];
+    UIImage *image = [UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:0 maximumPixelSize:101 cancelled:nil];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), 101);
+    [self assertImageNeedsNoCopyAtCommit:image];
+}
+
+- (void)testScaledDownRowsAreAligned {
+    UIImage *image = [UIImage imageWithData:[self PNGDataWithWidth:333 height:217 alpha:255 pixelAlpha:128]];
+    UIImage *scaledDownImage = [UIImage lc_decodedAndScaledDownImageWithImage:image limitBytes:101 * 66 * 4];
+    XCTAssertLessThan(CGImageGetWidth(scaledDownImage.CGImage), 333);
+    [self assertImageNeedsNoCopyAtCommit:scaledDownImage];
+}
+
+// A JPEG of gradients and a pattern, so that the encoder can't reduce it to flat blocks.
+- (NSData *)JPEGDataWithWidth:(size_t)width height:(size_t)height {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRelease(colorSpace);
+    uint8_t *bytes = CGBitmapContextGetData(context);
+    size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *pixel = bytes + y * bytesPerRow;
+        for (size_t x = 0; x < width; x++, pixel += 4) {
+            pixel[0] = (uint8_t)(x * 255 / width);
+            pixel[1] = (uint8_t)(y * 255 / height);
+            pixel[2] = (uint8_t)((x ^ y) & 0xff);
+        }
+    }
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, (__bridge CFStringRef)@"public.jpeg", 1, NULL);
+    CGImageDestinationAddImage(destination, imageRef, (__bridge CFDictionaryRef)@{(__bridge NSString *)kCGImageDestinationLossyCompressionQuality: @0.8});
+    XCTAssertTrue(CGImageDestinationFinalize(destination));
+    CFRelease(destination);
+    CGImageRelease(imageRef);
+    return data;
+}
+
+// The time and the peak memory of the decode, scaled down to 2048x1536 pixels from the 4:3 JPEG.
+- (void)measureScaledDownDecodeOfJPEGWithWidth:(size_t)width height:(size_t)height usesThumbnail:(BOOL)usesThumbnail {
+    NSData *data = [self JPEGDataWithWidth:width height:height];
+    NSUInteger limitBytes = 2048 * 1536 * 4;
+    NSArray<id<XCTMetric>> *metrics = @[[[XCTClockMetric alloc] init], [[XCTMemoryMetric alloc] init]];
+    [self measureWithMetrics:metrics block:^{
+        UIImage *image = nil;
+        if (usesThumbnail) {
+            image = [UIImage lc_decodedAndScaledDownImageWithData:data limitBytes:limitBytes maximumPixelSize:0 cancelled:nil];
+        } else {
+            // the tile loop over a full size image, the path taken before ImageIO thumbnails
+            image = [UIImage lc_decodedAndScaledDownImageWithImage:[UIImage imageWithData:data] limitBytes:limitBytes];
+        }
+        XCTAssertLessThan(CGImageGetWidth(image.CGImage), width);
+    }];
+}
+
+- (void)testThumbnailDecodePerformance12MP {
+    [self measureScaledDownDecodeOfJPEGWithWidth:4000 height:3000 usesThumbnail:YES];
+}
+
+- (void)testTiledDecodePerformance12MP {
+    [self measureScaledDownDecodeOfJPEGWithWidth:4000 height:3000 usesThumbnail:NO];
+}
+
+- (void)testThumbnailDecodePerformance48MP {
+    [self measureScaledDownDecodeOfJPEGWithWidth:8000 height:6000 usesThumbnail:YES];
+}
+
+- (void)testTiledDecodePerformance48MP {
+    [self measureScaledDownDecodeOfJPEGWithWidth:8000 height:6000 usesThumbnail:NO];
+}
+
+// The banded scale-down of a 4:3 JPEG to 2048x1536 pixels, with at most the given number of idle decode slots, so the bands are drawn by at most 1 + idleSlotCount threads.
+- (void)measureBandedScaleDownOfJPEGWithWidth:(size_t)width height:(size_t)height idleDecodeSlots:(NSUInteger)idleSlotCount {
+    NSData *data = [self JPEGDataWithWidth:width height:height];
+    LCImageDecodeScheduler *scheduler = [LCImageDecodeScheduler sharedScheduler];
+    NSUInteger maximumConcurrentDecodes = scheduler.maximumConcurrentDecodes;
+    NSUInteger takenSlotCount = [scheduler reserveIdleDecodeSlots:maximumConcurrentDecodes - MIN(idleSlotCount, maximumConcurrentDecodes)];
+    [self measureBlock:^{
+        UIImage *image = [UIImage lc_decodedAndScaledDownImageWithImage:[UIImage imageWithData:data] limitBytes:2048 * 1536 * 4];
+        XCTAssertLessThan(CGImageGetWidth(image.CGImage), width);
+    }];
+    [scheduler releaseDecodeSlots:takenSlotCount];
+}
+
+- (void)testSerialScaleDownPerformance12MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:4000 height:3000 idleDecodeSlots:0];
+}
+
+- (void)testParallelScaleDownPerformance12MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:4000 height:3000 idleDecodeSlots:NSUIntegerMax];
+}
+
+- (void)testSerialScaleDownPerformance48MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:8000 height:6000 idleDecodeSlots:0];
+}
+
+- (void)testTwoBandScaleDownPerformance48MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:8000 height:6000 idleDecodeSlots:1];
+}
+
+- (void)testFourBandScaleDownPerformance48MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:8000 height:6000 idleDecodeSlots:3];
+}
+
+- (void)testParallelScaleDownPerformance48MP {
+    [self measureBandedScaleDownOfJPEGWithWidth:8000 height:6000 idleDecodeSlots:NSUIntegerMax];
+}
+
+@end
@@ -30,6 +30,30 @@ typedef NS_ENUM(NSUInteger, LCImageDiskCacheExpireType) {
     LCImageDiskCacheExpireTypeChangeDate,
 };
 
+/// The `ETag` of the response that stored the disk data (NSString).
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataETagKey;
+/// The `Last-Modified` of the response that stored the disk data (NSString).
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataLastModifiedKey;
+/// The `Cache-Control` of the response that stored the disk data (NSString).
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataCacheControlKey;
+/// The date after which the disk data should be revalidated (NSDate). If absent, the data never becomes stale.
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataExpirationDateKey;
+/// Whether every pixel of the image is opaque, found by the alpha scan of a full size decode (NSNumber of BOOL). If absent, unknown.
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataOpaqueKey;
+/// The header of the image data, see `-[LCImageHeader dictionaryRepresentation]` (NSDictionary). If absent, unknown.
+FOUNDATION_EXPORT NSString * const LCImageDiskMetadataHeaderKey;
+
+/// A `BOOL (^)(void)` block returning YES once nobody waits for the decoded image anymore. The decoder should stop as soon as possible and return nil.
+FOUNDATION_EXPORT NSString * const LCImageDecodeOptionCancelledKey;
+/// The largest width or height, in pixels, the image is needed at (NSNumber). Larger images are decoded at this size. 0 for no limit.
+FOUNDATION_EXPORT NSString * const LCImageDecodeOptionMaximumPixelSizeKey;
+/// The size, in pixels, of the view the image is displayed in (NSValue of CGSize). Larger images are decoded at the size they are displayed at.
+FOUNDATION_EXPORT NSString * const LCImageDecodeOptionTargetPixelSizeKey;
+/// The content mode of the view the image is displayed in (NSNumber of UIViewContentMode). `UIViewContentModeScaleToFill` if absent.
+FOUNDATION_EXPORT NSString * const LCImageDecodeOptionContentModeKey;
+/// Whether every pixel of the image is known to be opaque (NSNumber of BOOL), so the decoder skips its alpha scan. Unknown if absent.
+FOUNDATION_EXPORT NSString * const LCImageDecodeOptionOpaqueKey;
+
 /**
  The `LCImageCache` protocol defines a set of APIs for adding, removing and fetching images from a cache synchronously.
  */
@@ -105,6 +129,54 @@ typedef NS_ENUM(NSUInteger, LCImageDiskCacheExpireType) {
  @param identifier The value to be removed. If nil, this method has no effect.
  */
 - (void)removeDiskDataWithIdentifier:(nonnull NSString *)identifier;
+
+@optional
+
+/**
+ Returns the metadata stored next to the disk data associated with a given identifier.
+ This method may blocks the calling thread until file read finished.
+
+ @param identifier A string identifying the data.
+ @return The metadata associated with identifier, or nil if there is no disk data or no metadata.
+ */
+- (nullable NSDictionary<NSString *, id> *)diskMetadataWithIdentifier:(NSString *)identifier;
+
+/**
+ Stores the metadata next to the disk data associated with a given identifier. The disk data must already exist.
+ This method may blocks the calling thread until file write finished.
+
+ @param metadata The property list metadata to store, see `LCImageDiskMetadataETagKey`. If nil, the metadata is removed.
+ @param identifier A string identifying the data.
+ */
+- (void)addDiskMetadata:(nullable NSDictionary<NSString *, id> *)metadata withIdentifier:(NSString *)identifier;
+
+/**
+ Replaces the metadata stored next to the disk data associated with a given identifier by the one the block returns from it. The updates are serialized, so that concurrent updates don't lose each other's keys. The disk data must already exist.
+ This method may blocks the calling thread until file write finished.
+
+ @param identifier A string identifying the data.
+ @param block A block returning the metadata to store from the stored one. If it returns nil, the metadata is removed.
+ */
+- (void)updateDiskMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable metadata))block;
+
+/**
+ Marks the disk data associated with a given identifier as fresh, as if it was stored now. Called when a `304 Not Modified` response revalidated it, metadata updates leave its age as is.
+ This method may blocks the calling thread until file write finished.
+
+ @param identifier A string identifying the data.
+ */
+- (void)refreshDiskDataWithIdentifier:(NSString *)identifier;
+
+/**
+ The decoded image. Used instead of `decodedImageFromData:withIdentifier:` when implemented.
+
+ @param data The origin data.
+ @param identifier The unique identifier for the image in the cache.
+ @param options The decode options, see `LCImageDecodeOptionCancelledKey`, `LCImageDecodeOptionMaximumPixelSizeKey`, `LCImageDecodeOptionTargetPixelSizeKey` and `LCImageDecodeOptionOpaqueKey`.
+
+ @return An image for the data, or nil.
+ */
+- (nullable UIImage *)decodedImageFromData:(nullable NSData *)data withIdentifier:(NSString *)identifier options:(nullable NSDictionary<NSString *, id> *)options;
 @end
 
 /**
@@ -195,6 +267,41 @@ typedef NS_ENUM(NSUInteger, LCImageDiskCacheExpireType) {
  */
 - (void)removeDataWithIdentifier:(nonnull NSString *)identifier;
 
+/**
+ Returns the metadata stored with the data associated with a given identifier. The metadata lives in an extended attribute of the cache file, so it is removed together with the data.
+ This method may blocks the calling thread until file read finished.
+
+ @param identifier A string identifying the data. If nil, just return nil.
+ @return The metadata associated with identifier, or nil if there is no data or no metadata.
+ */
+- (nullable NSDictionary<NSString *, id> *)metadataWithIdentifier:(NSString *)identifier;
+
+/**
+ Sets the metadata of the data associated with a given identifier. The modification date of the data is left as is, see `refreshDataWithIdentifier:`. If there is no data for identifier, this method has no effect.
+ This method may blocks the calling thread until file write finished.
+
+ @param metadata The property list metadata to store. If nil, the metadata is removed.
+ @param identifier A string identifying the data. If nil, this method has no effect.
+ */
+- (void)addMetadata:(nullable NSDictionary<NSString *, id> *)metadata withIdentifier:(NSString *)identifier;
+
+/**
+ Sets the metadata of the data associated with a given identifier to the one the block returns from the stored one. The updates and `addMetadata:withIdentifier:` are serialized, the modification date of the data is left as is. If there is no data for identifier, this method has no effect.
+ This method may blocks the calling thread until file write finished.
+
+ @param identifier A string identifying the data. If nil, this method has no effect.
+ @param block A block returning the metadata to store from the stored one. If it returns nil, the metadata is removed.
+ */
+- (void)updateMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable metadata))block;
+
+/**
+ Marks the data associated with a given identifier as modified now, so that `removeExpiredData` keeps it as long as newly written data.
+ This method may blocks the calling thread until file write finished.
+
+ @param identifier A string identifying the data. If nil, this method has no effect.
+ */
+- (void)refreshDataWithIdentifier:(NSString *)identifier;
+
 /**
  Empties the cache.
  This method may blocks the calling thread until file delete finished.
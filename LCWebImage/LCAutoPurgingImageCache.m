@@ -7,8 +7,24 @@
 //
 
 #import <CommonCrypto/CommonDigest.h>
+#import <sys/xattr.h>
 #import "UIImage+LCDecoder.h"
 #import "LCAutoPurgingImageCache.h"
+#import "LCWebImageTrace.h"
+
+NSString * const LCImageDiskMetadataETagKey = @"ETag";
+NSString * const LCImageDiskMetadataLastModifiedKey = @"Last-Modified";
+NSString * const LCImageDiskMetadataCacheControlKey = @"Cache-Control";
+NSString * const LCImageDiskMetadataExpirationDateKey = @"ExpirationDate";
+NSString * const LCImageDiskMetadataOpaqueKey = @"Opaque";
+NSString * const LCImageDiskMetadataHeaderKey = @"Header";
+NSString * const LCImageDecodeOptionCancelledKey = @"Cancelled";
+NSString * const LCImageDecodeOptionMaximumPixelSizeKey = @"MaximumPixelSize";
+NSString * const LCImageDecodeOptionTargetPixelSizeKey = @"TargetPixelSize";
+NSString * const LCImageDecodeOptionContentModeKey = @"ContentMode";
+NSString * const LCImageDecodeOptionOpaqueKey = @"Opaque";
+
+static const char * const kLCImageDiskMetadataAttributeName = "com.lcwebimage.metadata";
 
 @interface LCCachedImage : NSObject
 
@@ -27,10 +43,19 @@
         self.image = image;
         self.identifier = identifier;
 
-        CGSize imageSize = CGSizeMake(image.size.width * image.scale, image.size.height * image.scale);
-        CGFloat bytesPerPixel = 4.0;
-        CGFloat bytesPerSize = imageSize.width * imageSize.height;
-        self.totalBytes = (UInt64)bytesPerPixel * (UInt64)bytesPerSize;
+        CGImageRef imageRef = image.CGImage;
+        if (image.lc_encodedData) {
+            // not decoded yet, the decoded image replaces it with its own cost
+            self.totalBytes = image.lc_encodedData.length;
+        } else if (imageRef) {
+            // the decoder picks the format, gray and 16 bits images cost less than 4 bytes per pixel
+            self.totalBytes = (UInt64)CGImageGetBytesPerRow(imageRef) * (UInt64)CGImageGetHeight(imageRef);
+        } else {
+            CGSize imageSize = CGSizeMake(image.size.width * image.scale, image.size.height * image.scale);
+            CGFloat bytesPerPixel = 4.0;
+            CGFloat bytesPerSize = imageSize.width * imageSize.height;
+            self.totalBytes = (UInt64)bytesPerPixel * (UInt64)bytesPerSize;
+        }
         self.lastAccessDate = [NSDate date];
     }
     return self;
@@ -54,6 +79,8 @@
 @property (nonatomic, copy) NSString *diskCachePath;
 @property (nonatomic, strong, nonnull) NSFileManager *fileManager;
 @property (nonatomic, strong) dispatch_queue_t synchronizationQueue;
+// Serializes the metadata writes, each one rewrites the whole attribute.
+@property (nonatomic, strong) dispatch_queue_t metadataQueue;
 
 @end
 
@@ -71,6 +98,7 @@
         _shouldRemoveExpiredDataWhenEnterBackground = YES;
         NSString *queueName = [NSString stringWithFormat:@"com.lcwebimage.diskimagecache-%@", [[NSUUID UUID] UUIDString]];
         self.synchronizationQueue = dispatch_queue_create([queueName cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_CONCURRENT);
+        self.metadataQueue = dispatch_queue_create("com.lcwebimage.diskimagecache.metadata", DISPATCH_QUEUE_SERIAL);
         [[NSNotificationCenter defaultCenter] addObserver:self
                                                  selector:@selector(applicationWillTerminate:)
                                                      name:UIApplicationWillTerminateNotification
@@ -102,20 +130,16 @@
 }
 
 - (NSData *)dataWithIdentifier:(NSString *)identifier {
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDiskRead, identifier, 0);
     NSString *filePath = [self cachePathWithIdentifier:identifier];
     NSData *data = [NSData dataWithContentsOfFile:filePath];
-    if (data) {
-        return data;
-    }
-    
-    // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
-    // checking the key with and without the extension
-    data = [NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension];
-    if (data) {
-        return data;
+    if (!data) {
+        // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
+        // checking the key with and without the extension
+        data = [NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension];
     }
-    
-    return nil;
+    LC_TRACE_END(LCWebImageTraceStageDiskRead, traceID, data.length);
+    return data;
 }
 
 - (void)addData:(NSData *)data withIdentifier:(NSString *)identifier {
@@ -128,7 +152,9 @@
     // transform to NSURL
     NSURL *fileURL = [NSURL fileURLWithPath:cachePathForKey];
     
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDiskWrite, identifier, data.length);
     [data writeToURL:fileURL options:NSDataWritingAtomic error:nil];
+    LC_TRACE_END(LCWebImageTraceStageDiskWrite, traceID, data.length);
     
     // disable iCloud backup
     if (self.shouldDisableiCloud) {
@@ -142,6 +168,65 @@
     [self.fileManager removeItemAtPath:filePath error:nil];
 }
 
+- (NSDictionary<NSString *, id> *)metadataWithIdentifier:(NSString *)identifier {
+    NSString *filePath = [self cachePathWithIdentifier:identifier];
+    const char *path = filePath.fileSystemRepresentation;
+    ssize_t length = getxattr(path, kLCImageDiskMetadataAttributeName, NULL, 0, 0, 0);
+    if (length <= 0) {
+        return nil;
+    }
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    length = getxattr(path, kLCImageDiskMetadataAttributeName, data.mutableBytes, data.length, 0, 0);
+    if (length <= 0) {
+        return nil;
+    }
+    data.length = length;
+    id metadata = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:nil];
+    return [metadata isKindOfClass:[NSDictionary class]] ? metadata : nil;
+}
+
+- (void)addMetadata:(NSDictionary<NSString *, id> *)metadata withIdentifier:(NSString *)identifier {
+    [self updateMetadataWithIdentifier:identifier usingBlock:^NSDictionary<NSString *, id> *(NSDictionary<NSString *, id> *storedMetadata) {
+        return metadata;
+    }];
+}
+
+- (void)updateMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable))block {
+    if (!identifier || !block) {
+        return;
+    }
+    dispatch_sync(self.metadataQueue, ^{
+        [self writeMetadataWithIdentifier:identifier usingBlock:block];
+    });
+}
+
+//This method should only be called on the metadata queue
+- (void)writeMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable))block {
+    NSString *filePath = [self cachePathWithIdentifier:identifier];
+    if (![self.fileManager fileExistsAtPath:filePath]) {
+        return;
+    }
+    
+    NSDictionary<NSString *, id> *metadata = block([self metadataWithIdentifier:identifier]);
+    const char *path = filePath.fileSystemRepresentation;
+    if (metadata.count == 0) {
+        removexattr(path, kLCImageDiskMetadataAttributeName, 0);
+    } else {
+        NSData *data = [NSPropertyListSerialization dataWithPropertyList:metadata format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+        if (data) {
+            setxattr(path, kLCImageDiskMetadataAttributeName, data.bytes, data.length, 0, 0);
+        }
+    }
+}
+
+- (void)refreshDataWithIdentifier:(NSString *)identifier {
+    if (!identifier) {
+        return;
+    }
+    NSString *filePath = [self cachePathWithIdentifier:identifier];
+    [self.fileManager setAttributes:@{NSFileModificationDate: [NSDate date]} ofItemAtPath:filePath error:nil];
+}
+
 - (void)removeAllData {
     [self.fileManager removeItemAtPath:self.diskCachePath error:nil];
     [self.fileManager createDirectoryAtPath:self.diskCachePath
@@ -406,6 +491,7 @@ static inline NSString * _Nonnull LCDiskCacheFileNameForKey(NSString * _Nullable
     dispatch_barrier_async(self.synchronizationQueue, ^{
         if (self.currentMemoryUsage > self.memoryCapacity) {
             UInt64 bytesToPurge = self.currentMemoryUsage - self.preferredMemoryUsageAfterPurge;
+            uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStagePurge, nil, bytesToPurge);
             NSMutableArray <LCCachedImage*> *sortedImages = [NSMutableArray arrayWithArray:self.cachedImages.allValues];
             NSSortDescriptor *sortDescriptor = [[NSSortDescriptor alloc] initWithKey:@"lastAccessDate"
                                                                            ascending:YES];
@@ -421,20 +507,34 @@ static inline NSString * _Nonnull LCDiskCacheFileNameForKey(NSString * _Nullable
                 }
             }
             self.currentMemoryUsage -= bytesPurged;
+            LC_TRACE_END(LCWebImageTraceStagePurge, traceID, bytesPurged);
         }
     });
 }
 
 - (UIImage *)decodedImageFromData:(NSData *)data withIdentifier:(NSString *)identifier {
+    return [self decodedImageFromData:data withIdentifier:identifier options:nil];
+}
+
+- (UIImage *)decodedImageFromData:(NSData *)data withIdentifier:(NSString *)identifier options:(NSDictionary<NSString *, id> *)options {
     if (!data) {
         return nil;
     }
     if (self.customDecodedImage) {
         return self.customDecodedImage(data, identifier);
     }
-    UIImage *image = [UIImage imageWithData:data];
-    image = [UIImage lc_decodedAndScaledDownImageWithImage:image limitBytes:0];
-    return image;
+    CGFloat maximumPixelSize = [options[LCImageDecodeOptionMaximumPixelSizeKey] doubleValue];
+    CGSize targetPixelSize = [options[LCImageDecodeOptionTargetPixelSizeKey] CGSizeValue];
+    NSNumber *contentMode = options[LCImageDecodeOptionContentModeKey];
+    NSNumber *opaque = options[LCImageDecodeOptionOpaqueKey];
+    LCImageOpacity opacity = opaque == nil ? LCImageOpacityUnknown : (opaque.boolValue ? LCImageOpacityOpaque : LCImageOpacityTranslucent);
+    return [UIImage lc_decodedAndScaledDownImageWithData:data
+                                              limitBytes:0
+                                        maximumPixelSize:maximumPixelSize
+                                         targetPixelSize:targetPixelSize
+                                             contentMode:contentMode ? contentMode.integerValue : UIViewContentModeScaleToFill
+                                                 opacity:opacity
+                                               cancelled:options[LCImageDecodeOptionCancelledKey]];
 }
 
 - (BOOL)removeMemoryImageWithIdentifier:(NSString *)identifier {
@@ -487,6 +587,22 @@ static inline NSString * _Nonnull LCDiskCacheFileNameForKey(NSString * _Nullable
     [self.diskCache removeDataWithIdentifier:identifier];
 }
 
+- (NSDictionary<NSString *, id> *)diskMetadataWithIdentifier:(NSString *)identifier {
+    return [self.diskCache metadataWithIdentifier:identifier];
+}
+
+- (void)addDiskMetadata:(NSDictionary<NSString *, id> *)metadata withIdentifier:(NSString *)identifier {
+    [self.diskCache addMetadata:metadata withIdentifier:identifier];
+}
+
+- (void)updateDiskMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable))block {
+    [self.diskCache updateMetadataWithIdentifier:identifier usingBlock:block];
+}
+
+- (void)refreshDiskDataWithIdentifier:(NSString *)identifier {
+    [self.diskCache refreshDataWithIdentifier:identifier];
+}
+
 - (void)addImage:(UIImage *)image imageData:(NSData *)data withIdentifier:(NSString *)identifier {
     [self addMemoryImage:image withIdentifier:identifier];
     [self.diskCache addData:data withIdentifier:identifier];
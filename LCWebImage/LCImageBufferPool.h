@@ -0,0 +1,85 @@
+// LCImageBufferPool.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import <CoreGraphics/CoreGraphics.h>
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The `LCImageBufferPool` keeps the page aligned pixel buffers of dead decoded images to back the next decodes of a similar size, instead of allocating and faulting in fresh memory for every image. Buffers are grouped in size classes, four per doubling of the size, so a buffer is at most a quarter larger than needed. The pool is emptied on memory warnings.
+ */
+@interface LCImageBufferPool : NSObject
+
+/**
+ The maximum number of bytes kept by the pool. Buffers given back beyond it are freed. Defaults to a 128th of the device RAM between 8MB and 32MB.
+ */
+@property (nonatomic, assign) NSUInteger maximumPooledBytes;
+
+/**
+ The number of bytes kept by the pool.
+ */
+@property (nonatomic, assign, readonly) NSUInteger pooledBytes;
+
+/**
+ The shared pool used by the decoder.
+ */
++ (instancetype)sharedPool;
+
+/**
+ Returns a page aligned buffer of at least the given length, reused if possible. Its content is undefined.
+
+ @param length The number of bytes needed.
+ @return The buffer, to give back with `recycleBuffer:length:`, or NULL if it could not be allocated.
+ */
+- (nullable void *)allocateBufferWithLength:(size_t)length;
+
+/**
+ Gives back a buffer returned by `allocateBufferWithLength:`.
+
+ @param buffer The buffer.
+ @param length The length it was allocated with.
+ */
+- (void)recycleBuffer:(void *)buffer length:(size_t)length;
+
+/**
+ Creates a bitmap context over a pooled buffer, see `CGBitmapContextCreate`. The buffer is not cleared, draw with `kCGBlendModeCopy` or clear the context when the drawing does not cover it. Release the context with `recycleBitmapContext:`, or turn it into an image with `newImageFromBitmapContext:`.
+ */
+- (nullable CGContextRef)newBitmapContextWithWidth:(size_t)width
+                                            height:(size_t)height
+                                  bitsPerComponent:(size_t)bitsPerComponent
+                                       bytesPerRow:(size_t)bytesPerRow
+                                        colorSpace:(CGColorSpaceRef)colorSpace
+                                        bitmapInfo:(CGBitmapInfo)bitmapInfo CF_RETURNS_RETAINED;
+
+/**
+ Creates an image over the buffer of a context created by `newBitmapContextWithWidth:height:bitsPerComponent:bytesPerRow:colorSpace:bitmapInfo:`, without copying it. The image owns the buffer from now on and gives it back to the pool when it is released. Whether the image could be created or not, release the context with `CGContextRelease` and don't draw into it anymore.
+
+ @param context The context.
+ @return The image, or NULL if it could not be created.
+ */
+- (nullable CGImageRef)newImageFromBitmapContext:(CGContextRef)context CF_RETURNS_RETAINED;
+
+/**
+ Works as `newImageFromBitmapContext:`, with another bitmap info for the same layout, for example to tag opaque a premultiplied bitmap whose alpha is unused.
+ */
+- (nullable CGImageRef)newImageFromBitmapContext:(CGContextRef)context bitmapInfo:(CGBitmapInfo)bitmapInfo CF_RETURNS_RETAINED;
+
+/**
+ Releases a context created by `newBitmapContextWithWidth:height:bitsPerComponent:bytesPerRow:colorSpace:bitmapInfo:` and gives its buffer back to the pool.
+ */
+- (void)recycleBitmapContext:(nullable CGContextRef)context;
+
+/**
+ Frees every kept buffer.
+ */
+- (void)removeAllBuffers;
+
+@end
+
+NS_ASSUME_NONNULL_END
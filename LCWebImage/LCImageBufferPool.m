@@ -0,0 +1,201 @@
+// LCImageBufferPool.m
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import "LCImageBufferPool.h"
+#import <UIKit/UIKit.h>
+#import <os/lock.h>
+#import <unistd.h>
+
+static const NSUInteger kBytesPerMB = 1024 * 1024;
+
+// The length of the buffers the given length is served from, page rounded up to a quarter of its power of two above 16 pages.
+static size_t LCBufferClassLength(size_t length) {
+    size_t pageSize = (size_t)getpagesize();
+    length = (MAX(length, 1) + pageSize - 1) / pageSize * pageSize;
+    if (length <= 16 * pageSize) {
+        return length;
+    }
+    size_t highestBit = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(length - 1);
+    size_t step = (size_t)1 << (highestBit - 2);
+    return (length + step - 1) & ~(step - 1);
+}
+
+static void LCImageBufferPoolReleaseData(void *info, const void *data, size_t size) {
+    LCImageBufferPool *pool = (__bridge_transfer LCImageBufferPool *)info;
+    [pool recycleBuffer:(void *)data length:size];
+}
+
+@interface LCImageBufferPool () {
+    os_unfair_lock _lock;
+}
+
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSMutableArray<NSValue *> *> *buffers;
+
+@end
+
+@implementation LCImageBufferPool
+
+@synthesize pooledBytes = _pooledBytes;
+
++ (instancetype)sharedPool {
+    static LCImageBufferPool *sharedPool = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedPool = [[self alloc] init];
+    });
+    return sharedPool;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        NSUInteger physicalMemory = (NSUInteger)[NSProcessInfo processInfo].physicalMemory;
+        _maximumPooledBytes = MIN(MAX(physicalMemory / 128, 8 * kBytesPerMB), 32 * kBytesPerMB);
+        _lock = OS_UNFAIR_LOCK_INIT;
+        self.buffers = [[NSMutableDictionary alloc] init];
+
+        [[NSNotificationCenter defaultCenter]
+         addObserver:self
+         selector:@selector(removeAllBuffers)
+         name:UIApplicationDidReceiveMemoryWarningNotification
+         object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [self removeAllBuffers];
+}
+
+- (NSUInteger)pooledBytes {
+    os_unfair_lock_lock(&_lock);
+    NSUInteger pooledBytes = _pooledBytes;
+    os_unfair_lock_unlock(&_lock);
+    return pooledBytes;
+}
+
+- (void *)allocateBufferWithLength:(size_t)length {
+    size_t classLength = LCBufferClassLength(length);
+    void *buffer = NULL;
+    os_unfair_lock_lock(&_lock);
+    NSMutableArray<NSValue *> *buffers = self.buffers[@(classLength)];
+    if (buffers.count > 0) {
+        // the most recently used one, its pages are the most likely to still be resident
+        buffer = buffers.lastObject.pointerValue;
+        [buffers removeLastObject];
+        _pooledBytes -= classLength;
+    }
+    os_unfair_lock_unlock(&_lock);
+    if (buffer) {
+        return buffer;
+    }
+    if (posix_memalign(&buffer, (size_t)getpagesize(), classLength) != 0) {
+        return NULL;
+    }
+    return buffer;
+}
+
+- (void)recycleBuffer:(void *)buffer length:(size_t)length {
+    if (!buffer) {
+        return;
+    }
+    size_t classLength = LCBufferClassLength(length);
+    os_unfair_lock_lock(&_lock);
+    if (_pooledBytes + classLength > self.maximumPooledBytes) {
+        os_unfair_lock_unlock(&_lock);
+        free(buffer);
+        return;
+    }
+    NSMutableArray<NSValue *> *buffers = self.buffers[@(classLength)];
+    if (!buffers) {
+        buffers = [[NSMutableArray alloc] init];
+        self.buffers[@(classLength)] = buffers;
+    }
+    [buffers addObject:[NSValue valueWithPointer:buffer]];
+    _pooledBytes += classLength;
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (CGContextRef)newBitmapContextWithWidth:(size_t)width
+                                   height:(size_t)height
+                         bitsPerComponent:(size_t)bitsPerComponent
+                              bytesPerRow:(size_t)bytesPerRow
+                               colorSpace:(CGColorSpaceRef)colorSpace
+                               bitmapInfo:(CGBitmapInfo)bitmapInfo {
+    if (width == 0 || height == 0 || bytesPerRow == 0) {
+        return NULL;
+    }
+    size_t length = bytesPerRow * height;
+    void *buffer = [self allocateBufferWithLength:length];
+    if (!buffer) {
+        return NULL;
+    }
+    CGContextRef context = CGBitmapContextCreate(buffer, width, height, bitsPerComponent, bytesPerRow, colorSpace, bitmapInfo);
+    if (!context) {
+        [self recycleBuffer:buffer length:length];
+    }
+    return context;
+}
+
+- (CGImageRef)newImageFromBitmapContext:(CGContextRef)context {
+    return [self newImageFromBitmapContext:context bitmapInfo:CGBitmapContextGetBitmapInfo(context)];
+}
+
+- (CGImageRef)newImageFromBitmapContext:(CGContextRef)context bitmapInfo:(CGBitmapInfo)bitmapInfo {
+    if (!context) {
+        return NULL;
+    }
+    void *buffer = CGBitmapContextGetData(context);
+    size_t length = CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context);
+    // the provider keeps the pool alive until the image is gone
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)self, buffer, length, LCImageBufferPoolReleaseData);
+    if (!provider) {
+        CFRelease((__bridge CFTypeRef)self);
+        return NULL;
+    }
+    CGImageRef imageRef = CGImageCreate(CGBitmapContextGetWidth(context),
+                                        CGBitmapContextGetHeight(context),
+                                        CGBitmapContextGetBitsPerComponent(context),
+                                        CGBitmapContextGetBitsPerPixel(context),
+                                        CGBitmapContextGetBytesPerRow(context),
+                                        CGBitmapContextGetColorSpace(context),
+                                        bitmapInfo,
+                                        provider,
+                                        NULL,
+                                        false,
+                                        kCGRenderingIntentDefault);
+    // without an image, releasing the provider gives the buffer back
+    CGDataProviderRelease(provider);
+    return imageRef;
+}
+
+- (void)recycleBitmapContext:(CGContextRef)context {
+    if (!context) {
+        return;
+    }
+    void *buffer = CGBitmapContextGetData(context);
+    size_t length = CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context);
+    CGContextRelease(context);
+    [self recycleBuffer:buffer length:length];
+}
+
+- (void)removeAllBuffers {
+    os_unfair_lock_lock(&_lock);
+    NSDictionary<NSNumber *, NSMutableArray<NSValue *> *> *buffers = self.buffers;
+    self.buffers = [[NSMutableDictionary alloc] init];
+    _pooledBytes = 0;
+    os_unfair_lock_unlock(&_lock);
+
+    for (NSMutableArray<NSValue *> *classBuffers in buffers.allValues) {
+        for (NSValue *buffer in classBuffers) {
+            free(buffer.pointerValue);
+        }
+    }
+}
+
+@end
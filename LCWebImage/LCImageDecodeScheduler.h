@@ -0,0 +1,80 @@
+// LCImageDecodeScheduler.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, LCImageDecodePriority) {
+    /// Images that are about to be displayed.
+    LCImageDecodePriorityDefault,
+    /// Images that are prefetched, decoded only when no default priority work is waiting.
+    LCImageDecodePriorityLow
+};
+
+/**
+ The `LCImageDecodeScheduler` runs image decodes with a bounded width instead of letting every decode take its own GCD worker thread. Pending decodes are started in priority order, default before low, and in FIFO order within a priority. Default priority work runs with `QOS_CLASS_USER_INITIATED`, low priority work with `QOS_CLASS_UTILITY`.
+ */
+@interface LCImageDecodeScheduler : NSObject
+
+/**
+ The maximum number of decodes running at the same time. Defaults to the number of active processor cores minus one, so the main thread keeps a core for itself.
+ */
+@property (nonatomic, assign, readonly) NSUInteger maximumConcurrentDecodes;
+
+/**
+ The maximum number of decoded bytes being produced at the same time. A decode whose cost does not fit waits until running decodes finish, unless nothing else is running. Defaults to `64 MB`.
+ */
+@property (nonatomic, assign, readonly) NSUInteger maximumDecodingBytes;
+
+/**
+ The shared scheduler used by every `LCWebImageManager` by default.
+ */
++ (instancetype)sharedScheduler;
+
+/**
+ Initializes a scheduler with the default width and byte limit.
+ */
+- (instancetype)init;
+
+/**
+ Initializes a scheduler.
+
+ @param maximumConcurrentDecodes The maximum number of decodes running at the same time, at least 1.
+ @param maximumDecodingBytes The maximum number of decoded bytes being produced at the same time. Provide 0 for no limit.
+ */
+- (instancetype)initWithMaximumConcurrentDecodes:(NSUInteger)maximumConcurrentDecodes
+                            maximumDecodingBytes:(NSUInteger)maximumDecodingBytes NS_DESIGNATED_INITIALIZER;
+
+/**
+ Schedules a decode.
+
+ @param priority The priority of the decode.
+ @param cost The number of bytes the decode produces, used for the `maximumDecodingBytes` limit. Provide 0 if unknown.
+ @param block The decode to run. It runs on a global queue.
+ */
+- (void)scheduleDecodeWithPriority:(LCImageDecodePriority)priority cost:(NSUInteger)cost block:(dispatch_block_t)block;
+
+/**
+ Takes up to the given number of idle slots, for a running decode that splits its work across threads. The slots count as running decodes until they are released.
+
+ @param count The number of slots wanted.
+ @return The number of slots taken, 0 if none is idle.
+ */
+- (NSUInteger)reserveIdleDecodeSlots:(NSUInteger)count;
+
+/**
+ Gives back slots taken with `reserveIdleDecodeSlots:`.
+
+ @param count The number of slots taken.
+ */
+- (void)releaseDecodeSlots:(NSUInteger)count;
+
+@end
+
+NS_ASSUME_NONNULL_END
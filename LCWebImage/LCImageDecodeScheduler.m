@@ -0,0 +1,151 @@
+// LCImageDecodeScheduler.m
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import "LCImageDecodeScheduler.h"
+#import <os/lock.h>
+
+static const NSUInteger kDefaultMaximumDecodingBytes = 64 * 1024 * 1024; // 64MB
+
+@interface LCImageDecodeOperation : NSObject
+@property (nonatomic, assign) LCImageDecodePriority priority;
+@property (nonatomic, assign) NSUInteger cost;
+@property (nonatomic, copy) dispatch_block_t block;
+@end
+
+@implementation LCImageDecodeOperation
+@end
+
+@interface LCImageDecodeScheduler () {
+    os_unfair_lock _lock;
+}
+
+@property (nonatomic, strong) NSMutableArray<LCImageDecodeOperation *> *defaultOperations;
+@property (nonatomic, strong) NSMutableArray<LCImageDecodeOperation *> *lowOperations;
+@property (nonatomic, assign) NSUInteger runningCount;
+@property (nonatomic, assign) NSUInteger runningBytes;
+
+@end
+
+@implementation LCImageDecodeScheduler
+
++ (instancetype)sharedScheduler {
+    static LCImageDecodeScheduler *sharedScheduler = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedScheduler = [[self alloc] init];
+    });
+    return sharedScheduler;
+}
+
+- (instancetype)init {
+    NSUInteger processorCount = [NSProcessInfo processInfo].activeProcessorCount;
+    return [self initWithMaximumConcurrentDecodes:MAX(1, processorCount - 1)
+                             maximumDecodingBytes:kDefaultMaximumDecodingBytes];
+}
+
+- (instancetype)initWithMaximumConcurrentDecodes:(NSUInteger)maximumConcurrentDecodes
+                            maximumDecodingBytes:(NSUInteger)maximumDecodingBytes {
+    if (self = [super init]) {
+        _maximumConcurrentDecodes = MAX(1, maximumConcurrentDecodes);
+        _maximumDecodingBytes = maximumDecodingBytes;
+        _lock = OS_UNFAIR_LOCK_INIT;
+        self.defaultOperations = [[NSMutableArray alloc] init];
+        self.lowOperations = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)scheduleDecodeWithPriority:(LCImageDecodePriority)priority cost:(NSUInteger)cost block:(dispatch_block_t)block {
+    if (!block) {
+        return;
+    }
+    LCImageDecodeOperation *operation = [[LCImageDecodeOperation alloc] init];
+    operation.priority = priority;
+    operation.cost = cost;
+    operation.block = block;
+
+    os_unfair_lock_lock(&_lock);
+    if (priority == LCImageDecodePriorityLow) {
+        [self.lowOperations addObject:operation];
+    } else {
+        [self.defaultOperations addObject:operation];
+    }
+    NSArray<LCImageDecodeOperation *> *operations = [self dequeueRunnableOperations];
+    os_unfair_lock_unlock(&_lock);
+
+    [self runOperations:operations];
+}
+
+- (void)runOperations:(NSArray<LCImageDecodeOperation *> *)operations {
+    for (LCImageDecodeOperation *operation in operations) {
+        qos_class_t qos = operation.priority == LCImageDecodePriorityLow ? QOS_CLASS_UTILITY : QOS_CLASS_USER_INITIATED;
+        dispatch_async(dispatch_get_global_queue(qos, 0), ^{
+            operation.block();
+            [self finishOperation:operation];
+        });
+    }
+}
+
+- (void)finishOperation:(LCImageDecodeOperation *)operation {
+    os_unfair_lock_lock(&_lock);
+    self.runningCount -= 1;
+    self.runningBytes -= operation.cost;
+    NSArray<LCImageDecodeOperation *> *operations = [self dequeueRunnableOperations];
+    os_unfair_lock_unlock(&_lock);
+
+    [self runOperations:operations];
+}
+
+- (NSUInteger)reserveIdleDecodeSlots:(NSUInteger)count {
+    os_unfair_lock_lock(&_lock);
+    // pending decodes come first
+    BOOL hasPendingOperations = self.defaultOperations.count > 0 || self.lowOperations.count > 0;
+    NSUInteger idleCount = hasPendingOperations || self.runningCount >= self.maximumConcurrentDecodes ? 0 : self.maximumConcurrentDecodes - self.runningCount;
+    NSUInteger reservedCount = MIN(count, idleCount);
+    self.runningCount += reservedCount;
+    os_unfair_lock_unlock(&_lock);
+    return reservedCount;
+}
+
+- (void)releaseDecodeSlots:(NSUInteger)count {
+    if (count == 0) {
+        return;
+    }
+    os_unfair_lock_lock(&_lock);
+    self.runningCount -= count;
+    NSArray<LCImageDecodeOperation *> *operations = [self dequeueRunnableOperations];
+    os_unfair_lock_unlock(&_lock);
+
+    [self runOperations:operations];
+}
+
+//This method should only be called while holding the lock
+- (NSArray<LCImageDecodeOperation *> *)dequeueRunnableOperations {
+    NSMutableArray<LCImageDecodeOperation *> *operations = nil;
+    while (self.runningCount < self.maximumConcurrentDecodes) {
+        NSMutableArray<LCImageDecodeOperation *> *queue = self.defaultOperations.count > 0 ? self.defaultOperations : self.lowOperations;
+        LCImageDecodeOperation *operation = queue.firstObject;
+        if (!operation) {
+            break;
+        }
+        // always let one decode run, even if it is larger than the limit on its own
+        if (self.maximumDecodingBytes > 0 && self.runningCount > 0 && self.runningBytes + operation.cost > self.maximumDecodingBytes) {
+            break;
+        }
+        [queue removeObjectAtIndex:0];
+        self.runningCount += 1;
+        self.runningBytes += operation.cost;
+        if (!operations) {
+            operations = [[NSMutableArray alloc] init];
+        }
+        [operations addObject:operation];
+    }
+    return operations;
+}
+
+@end
@@ -0,0 +1,96 @@
+// LCImageHeaderParser.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import <ImageIO/ImageIO.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSUInteger, LCImageType) {
+    LCImageTypeUnknown,
+    LCImageTypeJPEG,
+    LCImageTypePNG,
+    LCImageTypeGIF,
+    LCImageTypeWebP,
+    LCImageTypeHEIC
+};
+
+/**
+ Detects the image type from the first bytes of the data. 16 bytes are enough.
+
+ Works like `YYImageDetectType` of YYImage, which only the demo app vendors. The pod doesn't depend on it.
+ */
+FOUNDATION_EXPORT LCImageType LCImageDetectType(NSData * _Nullable data);
+
+/**
+ Reads the pixel size of a JPEG, PNG, GIF, WebP or HEIF image from the first bytes of its data, without decoding it. The orientation is not applied.
+
+ @param data The first bytes of the image data. A few dozen bytes are enough for PNG, GIF and WebP, a JPEG needs the bytes up to its frame header, after the EXIF and ICC segments, and a HEIF image its `meta` box.
+ @return The pixel size, or `CGSizeZero` if the type is not supported or more bytes are needed.
+ */
+FOUNDATION_EXPORT CGSize LCImagePixelSizeFromHeader(NSData * _Nullable data);
+
+/**
+ What the header of an image tells before its data is decoded, or even fully loaded.
+ */
+@interface LCImageHeader : NSObject
+
+/**
+ The format. Animated PNG images are `LCImageTypePNG` with more than one frame.
+ */
+@property (nonatomic, assign, readonly) LCImageType type;
+
+/**
+ The size of the stored pixels, before the orientation is applied.
+ */
+@property (nonatomic, assign, readonly) CGSize pixelSize;
+
+/**
+ The orientation of the EXIF data, or of the rotation and mirroring properties of a HEIF image. `kCGImagePropertyOrientationUp` if there is none.
+ */
+@property (nonatomic, assign, readonly) CGImagePropertyOrientation orientation;
+
+/**
+ The size the image is displayed at once the orientation is applied.
+ */
+@property (nonatomic, assign, readonly) CGSize orientedPixelSize;
+
+/**
+ The number of frames, 1 for still images. 0 if unknown: GIF images, animated WebP images and HEIF sequences don't declare it, their frames are only counted when the data holds the whole image.
+ */
+@property (nonatomic, assign, readonly) NSUInteger frameCount;
+
+/**
+ Whether the image has an alpha channel or a transparent color. Its pixels may all be opaque anyway.
+ */
+@property (nonatomic, assign, readonly) BOOL hasAlpha;
+
+/**
+ Initializes a header from its `dictionaryRepresentation`.
+
+ @return The header, or nil if the dictionary is not one.
+ */
+- (nullable instancetype)initWithDictionary:(NSDictionary<NSString *, id> *)dictionary;
+
+/**
+ Returns the header as a property list, for example to store it next to the data.
+ */
+- (NSDictionary<NSString *, id> *)dictionaryRepresentation;
+
+@end
+
+/**
+ Reads the header of a JPEG, PNG, APNG, GIF, WebP or HEIF image from the first bytes of its data, without decoding it. Besides the pixel size, a JPEG needs the same bytes as for `LCImagePixelSizeFromHeader`, a PNG the chunks before its image data and a GIF the start of its first frame, a few hundred bytes in most images.
+
+ @param data The first bytes of the image data, or the whole data.
+ @return The header, or nil if the type is not supported or more bytes are needed.
+ */
+FOUNDATION_EXPORT LCImageHeader * _Nullable LCImageProbeHeader(NSData * _Nullable data);
+
+NS_ASSUME_NONNULL_END
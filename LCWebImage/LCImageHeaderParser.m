@@ -0,0 +1,613 @@
+// LCImageHeaderParser.m
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import "LCImageHeaderParser.h"
+
+static inline uint16_t LCReadUInt16BE(const uint8_t *bytes) {
+    return (uint16_t)(bytes[0] << 8 | bytes[1]);
+}
+
+static inline uint16_t LCReadUInt16LE(const uint8_t *bytes) {
+    return (uint16_t)(bytes[1] << 8 | bytes[0]);
+}
+
+static inline uint32_t LCReadUInt24LE(const uint8_t *bytes) {
+    return (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0];
+}
+
+static inline uint32_t LCReadUInt32BE(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static inline uint32_t LCReadUInt32LE(const uint8_t *bytes) {
+    return (uint32_t)bytes[3] << 24 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0];
+}
+
+// The fields of `LCImageHeader`, filled by the readers of each format.
+typedef struct {
+    CGSize pixelSize;
+    CGImagePropertyOrientation orientation;
+    NSUInteger frameCount;
+    BOOL hasAlpha;
+} LCImageHeaderFields;
+
+// Reads the orientation tag of the first directory of EXIF data, 0 if there is none.
+static uint16_t LCTIFFOrientation(const uint8_t *bytes, NSUInteger length) {
+    if (length < 8) {
+        return 0;
+    }
+    BOOL bigEndian = bytes[0] == 'M' && bytes[1] == 'M';
+    if (!bigEndian && !(bytes[0] == 'I' && bytes[1] == 'I')) {
+        return 0;
+    }
+    uint32_t directoryOffset = bigEndian ? LCReadUInt32BE(bytes + 4) : LCReadUInt32LE(bytes + 4);
+    if (directoryOffset > length - 2) {
+        return 0;
+    }
+    uint16_t entryCount = bigEndian ? LCReadUInt16BE(bytes + directoryOffset) : LCReadUInt16LE(bytes + directoryOffset);
+    for (NSUInteger i = 0; i < entryCount; i++) {
+        NSUInteger entryOffset = directoryOffset + 2 + i * 12;
+        if (entryOffset + 12 > length) {
+            return 0;
+        }
+        const uint8_t *entry = bytes + entryOffset;
+        uint16_t tag = bigEndian ? LCReadUInt16BE(entry) : LCReadUInt16LE(entry);
+        if (tag == 0x0112) {
+            // a SHORT, left justified in the value field
+            uint16_t orientation = bigEndian ? LCReadUInt16BE(entry + 8) : LCReadUInt16LE(entry + 8);
+            return orientation >= 1 && orientation <= 8 ? orientation : 0;
+        }
+    }
+    return 0;
+}
+
+LCImageType LCImageDetectType(NSData *data) {
+    NSUInteger length = data.length;
+    if (length < 12) {
+        return LCImageTypeUnknown;
+    }
+    const uint8_t *bytes = data.bytes;
+    if (bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) {
+        return LCImageTypeJPEG;
+    }
+    if (memcmp(bytes, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        return LCImageTypePNG;
+    }
+    if (memcmp(bytes, "GIF87a", 6) == 0 || memcmp(bytes, "GIF89a", 6) == 0) {
+        return LCImageTypeGIF;
+    }
+    if (memcmp(bytes, "RIFF", 4) == 0 && memcmp(bytes + 8, "WEBP", 4) == 0) {
+        return LCImageTypeWebP;
+    }
+    if (memcmp(bytes + 4, "ftyp", 4) == 0 && (memcmp(bytes + 8, "heic", 4) == 0 || memcmp(bytes + 8, "heix", 4) == 0 || memcmp(bytes + 8, "mif1", 4) == 0 || memcmp(bytes + 8, "msf1", 4) == 0)) {
+        return LCImageTypeHEIC;
+    }
+    return LCImageTypeUnknown;
+}
+
+static BOOL LCReadJPEGHeader(const uint8_t *bytes, NSUInteger length, LCImageHeaderFields *fields) {
+    NSUInteger offset = 2;
+    while (offset + 9 < length) {
+        if (bytes[offset] != 0xFF) {
+            return NO;
+        }
+        uint8_t marker = bytes[offset + 1];
+        if (marker == 0xFF) {
+            // fill byte
+            offset += 1;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // no length
+            offset += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            // the frame header comes before the scan
+            return NO;
+        }
+        // every SOFn except DHT, JPG and DAC
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            uint16_t height = LCReadUInt16BE(bytes + offset + 5);
+            uint16_t width = LCReadUInt16BE(bytes + offset + 7);
+            fields->pixelSize = CGSizeMake(width, height);
+            fields->frameCount = 1;
+            return YES;
+        }
+        NSUInteger segmentLength = LCReadUInt16BE(bytes + offset + 2);
+        // APP1, the segments before the frame header are all in the data once it is found
+        if (marker == 0xE1 && segmentLength >= 8 && offset + 2 + segmentLength <= length && memcmp(bytes + offset + 4, "Exif\0\0", 6) == 0) {
+            uint16_t orientation = LCTIFFOrientation(bytes + offset + 10, segmentLength - 8);
+            if (orientation != 0) {
+                fields->orientation = orientation;
+            }
+        }
+        offset += 2 + segmentLength;
+    }
+    return NO;
+}
+
+static CGSize LCJPEGPixelSize(const uint8_t *bytes, NSUInteger length) {
+    LCImageHeaderFields fields = {0};
+    return LCReadJPEGHeader(bytes, length, &fields) ? fields.pixelSize : CGSizeZero;
+}
+
+// Reads the chunks between the image header and the image data.
+static BOOL LCReadPNGHeader(const uint8_t *bytes, NSUInteger length, LCImageHeaderFields *fields) {
+    // the signature and the IHDR chunk
+    if (length < 33) {
+        return NO;
+    }
+    uint8_t colorType = bytes[25];
+    fields->pixelSize = CGSizeMake(LCReadUInt32BE(bytes + 16), LCReadUInt32BE(bytes + 20));
+    fields->hasAlpha = colorType == 4 || colorType == 6;
+    fields->frameCount = 1;
+    NSUInteger offset = 33;
+    while (offset + 8 <= length) {
+        NSUInteger chunkLength = LCReadUInt32BE(bytes + offset);
+        const uint8_t *chunkType = bytes + offset + 4;
+        if (memcmp(chunkType, "IDAT", 4) == 0 || memcmp(chunkType, "IEND", 4) == 0) {
+            return YES;
+        }
+        NSUInteger dataOffset = offset + 8;
+        if (chunkLength > length - dataOffset) {
+            return NO;
+        }
+        if (memcmp(chunkType, "acTL", 4) == 0 && chunkLength >= 8) {
+            fields->frameCount = MAX(1, LCReadUInt32BE(bytes + dataOffset));
+        } else if (memcmp(chunkType, "tRNS", 4) == 0) {
+            fields->hasAlpha = YES;
+        } else if (memcmp(chunkType, "eXIf", 4) == 0) {
+            uint16_t orientation = LCTIFFOrientation(bytes + dataOffset, chunkLength);
+            if (orientation != 0) {
+                fields->orientation = orientation;
+            }
+        }
+        // and the CRC
+        offset = dataOffset + chunkLength + 4;
+    }
+    return NO;
+}
+
+// Skips the data sub-blocks at the offset, returns NO if the data ends before their terminator.
+static BOOL LCSkipGIFSubBlocks(const uint8_t *bytes, NSUInteger length, NSUInteger *offset) {
+    while (*offset < length) {
+        uint8_t size = bytes[*offset];
+        *offset += 1 + size;
+        if (size == 0) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// The header is read at the first frame, whose transparency comes before it. The frames are counted up to the trailer.
+static BOOL LCReadGIFHeader(const uint8_t *bytes, NSUInteger length, LCImageHeaderFields *fields) {
+    if (length < 13) {
+        return NO;
+    }
+    fields->pixelSize = CGSizeMake(LCReadUInt16LE(bytes + 6), LCReadUInt16LE(bytes + 8));
+    uint8_t flags = bytes[10];
+    NSUInteger offset = 13;
+    if (flags & 0x80) {
+        offset += 3 * (1 << ((flags & 0x07) + 1));
+    }
+    NSUInteger frameCount = 0;
+    while (offset < length) {
+        uint8_t introducer = bytes[offset];
+        if (introducer == 0x3B) {
+            fields->frameCount = frameCount;
+            break;
+        }
+        if (introducer == 0x21) {
+            if (offset + 4 > length) {
+                break;
+            }
+            // the transparency flag of a graphic control extension
+            if (bytes[offset + 1] == 0xF9 && (bytes[offset + 3] & 0x01)) {
+                fields->hasAlpha = YES;
+            }
+            offset += 2;
+        } else if (introducer == 0x2C) {
+            if (offset + 10 > length) {
+                break;
+            }
+            frameCount += 1;
+            uint8_t imageFlags = bytes[offset + 9];
+            offset += 10;
+            if (imageFlags & 0x80) {
+                offset += 3 * (1 << ((imageFlags & 0x07) + 1));
+            }
+            // the LZW minimum code size
+            offset += 1;
+        } else {
+            break;
+        }
+        if (!LCSkipGIFSubBlocks(bytes, length, &offset)) {
+            break;
+        }
+    }
+    return frameCount > 0;
+}
+
+static CGSize LCWebPPixelSize(const uint8_t *bytes, NSUInteger length) {
+    if (length < 30) {
+        return CGSizeZero;
+    }
+    const uint8_t *chunk = bytes + 12;
+    if (memcmp(chunk, "VP8 ", 4) == 0) {
+        // lossy, after the frame tag and the start code
+        return CGSizeMake(LCReadUInt16LE(bytes + 26) & 0x3FFF, LCReadUInt16LE(bytes + 28) & 0x3FFF);
+    }
+    if (memcmp(chunk, "VP8L", 4) == 0) {
+        // lossless, 14 bit dimensions minus one after the signature byte
+        const uint8_t *bits = bytes + 21;
+        uint32_t width = 1 + (bits[0] | (bits[1] & 0x3F) << 8);
+        uint32_t height = 1 + (bits[1] >> 6 | bits[2] << 2 | (bits[3] & 0x0F) << 10);
+        return CGSizeMake(width, height);
+    }
+    if (memcmp(chunk, "VP8X", 4) == 0) {
+        // extended, 24 bit canvas dimensions minus one
+        return CGSizeMake(1 + LCReadUInt24LE(bytes + 24), 1 + LCReadUInt24LE(bytes + 27));
+    }
+    return CGSizeZero;
+}
+
+static BOOL LCReadWebPHeader(const uint8_t *bytes, NSUInteger length, LCImageHeaderFields *fields) {
+    CGSize pixelSize = LCWebPPixelSize(bytes, length);
+    if (pixelSize.width <= 0 || pixelSize.height <= 0) {
+        return NO;
+    }
+    fields->pixelSize = pixelSize;
+    fields->frameCount = 1;
+    const uint8_t *chunk = bytes + 12;
+    if (memcmp(chunk, "VP8L", 4) == 0) {
+        // the bit after the dimensions
+        fields->hasAlpha = (bytes[24] & 0x10) != 0;
+    } else if (memcmp(chunk, "VP8X", 4) == 0) {
+        uint8_t flags = bytes[20];
+        BOOL animated = (flags & 0x02) != 0;
+        fields->hasAlpha = (flags & 0x10) != 0;
+        fields->frameCount = animated ? 0 : 1;
+        // the frames and the EXIF chunk follow the image data, they are only read from the whole image
+        NSUInteger riffLength = (NSUInteger)LCReadUInt32LE(bytes + 4) + 8;
+        if (riffLength <= length) {
+            NSUInteger frameCount = 0;
+            NSUInteger offset = 12;
+            while (offset + 8 <= riffLength) {
+                NSUInteger chunkLength = LCReadUInt32LE(bytes + offset + 4);
+                NSUInteger dataOffset = offset + 8;
+                if (chunkLength > riffLength - dataOffset) {
+                    break;
+                }
+                if (memcmp(bytes + offset, "ANMF", 4) == 0) {
+                    frameCount += 1;
+                } else if (memcmp(bytes + offset, "EXIF", 4) == 0) {
+                    const uint8_t *exif = bytes + dataOffset;
+                    NSUInteger exifLength = chunkLength;
+                    // some encoders keep the JPEG APP1 prefix
+                    if (exifLength >= 6 && memcmp(exif, "Exif\0\0", 6) == 0) {
+                        exif += 6;
+                        exifLength -= 6;
+                    }
+                    uint16_t orientation = LCTIFFOrientation(exif, exifLength);
+                    if (orientation != 0) {
+                        fields->orientation = orientation;
+                    }
+                }
+                // chunks are padded to an even length
+                offset = dataOffset + chunkLength + (chunkLength & 1);
+            }
+            if (animated) {
+                fields->frameCount = frameCount;
+            }
+        }
+    }
+    return YES;
+}
+
+// Finds the next box of ISO base media file format data, returns NO if it is not all in the data.
+static BOOL LCReadBox(const uint8_t *bytes, NSUInteger length, NSUInteger offset, const uint8_t **type, NSUInteger *dataOffset, NSUInteger *boxEnd) {
+    if (offset + 8 > length) {
+        return NO;
+    }
+    uint64_t boxLength = LCReadUInt32BE(bytes + offset);
+    NSUInteger headerLength = 8;
+    if (boxLength == 1) {
+        if (offset + 16 > length) {
+            return NO;
+        }
+        boxLength = (uint64_t)LCReadUInt32BE(bytes + offset + 8) << 32 | LCReadUInt32BE(bytes + offset + 12);
+        headerLength = 16;
+    } else if (boxLength == 0) {
+        // up to the end of the file, never the case of the boxes read here
+        return NO;
+    }
+    if (boxLength < headerLength || boxLength > length - offset) {
+        return NO;
+    }
+    *type = bytes + offset + 4;
+    *dataOffset = offset + headerLength;
+    *boxEnd = offset + (NSUInteger)boxLength;
+    return YES;
+}
+
+// Applies an EXIF orientation and then a mirroring or a clockwise rotation, with the orientation seen as a horizontal mirroring followed by a rotation.
+static CGImagePropertyOrientation LCOrientationByApplying(CGImagePropertyOrientation orientation, BOOL mirrorsHorizontally, BOOL mirrorsVertically, NSUInteger quarterTurns) {
+    static const CGImagePropertyOrientation orientations[2][4] = {
+        {kCGImagePropertyOrientationUp, kCGImagePropertyOrientationRight, kCGImagePropertyOrientationDown, kCGImagePropertyOrientationLeft},
+        {kCGImagePropertyOrientationUpMirrored, kCGImagePropertyOrientationRightMirrored, kCGImagePropertyOrientationDownMirrored, kCGImagePropertyOrientationLeftMirrored}
+    };
+    NSUInteger mirrored = 0;
+    NSUInteger turns = 0;
+    for (NSUInteger i = 0; i < 2; i++) {
+        for (NSUInteger j = 0; j < 4; j++) {
+            if (orientations[i][j] == orientation) {
+                mirrored = i;
+                turns = j;
+            }
+        }
+    }
+    if (mirrorsHorizontally) {
+        // mirroring after a rotation mirrors before the opposite rotation
+        mirrored ^= 1;
+        turns = (4 - turns) % 4;
+    } else if (mirrorsVertically) {
+        // a vertical mirroring is a horizontal one turned upside down
+        mirrored ^= 1;
+        turns = (6 - turns) % 4;
+    }
+    turns = (turns + quarterTurns) % 4;
+    return orientations[mirrored][turns];
+}
+
+// Reads the properties of the primary item from the `meta` box, which the encoders write before the image data.
+static BOOL LCReadHEIFHeader(const uint8_t *bytes, NSUInteger length, LCImageHeaderFields *fields) {
+    // a sequence has its frames in a track, its primary item is the cover
+    fields->frameCount = memcmp(bytes + 8, "msf1", 4) == 0 ? 0 : 1;
+    NSUInteger offset = 0;
+    const uint8_t *type = NULL;
+    NSUInteger dataOffset = 0;
+    NSUInteger boxEnd = 0;
+    while (YES) {
+        if (!LCReadBox(bytes, length, offset, &type, &dataOffset, &boxEnd)) {
+            return NO;
+        }
+        if (memcmp(type, "meta", 4) == 0) {
+            break;
+        }
+        if (memcmp(type, "mdat", 4) == 0) {
+            return NO;
+        }
+        offset = boxEnd;
+    }
+    // a full box
+    NSUInteger metaEnd = boxEnd;
+    offset = dataOffset + 4;
+    uint32_t primaryItemID = 0;
+    BOOL hasPrimaryItem = NO;
+    NSUInteger propertiesOffset = 0;
+    NSUInteger propertiesEnd = 0;
+    NSUInteger associationsOffset = 0;
+    NSUInteger associationsEnd = 0;
+    while (offset < metaEnd && LCReadBox(bytes, metaEnd, offset, &type, &dataOffset, &boxEnd)) {
+        if (memcmp(type, "pitm", 4) == 0 && boxEnd - dataOffset >= 6) {
+            primaryItemID = bytes[dataOffset] == 0 ? LCReadUInt16BE(bytes + dataOffset + 4) : (boxEnd - dataOffset >= 8 ? LCReadUInt32BE(bytes + dataOffset + 4) : 0);
+            hasPrimaryItem = YES;
+        } else if (memcmp(type, "iprp", 4) == 0) {
+            NSUInteger iprpEnd = boxEnd;
+            NSUInteger childOffset = dataOffset;
+            while (childOffset < iprpEnd && LCReadBox(bytes, iprpEnd, childOffset, &type, &dataOffset, &boxEnd)) {
+                if (memcmp(type, "ipco", 4) == 0) {
+                    propertiesOffset = dataOffset;
+                    propertiesEnd = boxEnd;
+                } else if (memcmp(type, "ipma", 4) == 0 && associationsOffset == 0) {
+                    associationsOffset = dataOffset;
+                    associationsEnd = boxEnd;
+                }
+                childOffset = boxEnd;
+            }
+            // the child loop moved boxEnd, and stops short of the end of the box on a truncated child
+            boxEnd = iprpEnd;
+        }
+        offset = boxEnd;
+    }
+    if (!hasPrimaryItem || propertiesOffset == 0 || associationsOffset == 0 || associationsEnd - associationsOffset < 8) {
+        return NO;
+    }
+
+    // the 1-based indexes of the properties of the primary item, in the order they apply
+    uint32_t propertyIndexes[64];
+    NSUInteger propertyCount = 0;
+    uint8_t version = bytes[associationsOffset];
+    BOOL hasLongIndexes = (bytes[associationsOffset + 3] & 0x01) != 0;
+    uint32_t entryCount = LCReadUInt32BE(bytes + associationsOffset + 4);
+    offset = associationsOffset + 8;
+    for (uint32_t i = 0; i < entryCount; i++) {
+        NSUInteger itemIDLength = version < 1 ? 2 : 4;
+        if (offset + itemIDLength + 1 > associationsEnd) {
+            return NO;
+        }
+        uint32_t itemID = version < 1 ? LCReadUInt16BE(bytes + offset) : LCReadUInt32BE(bytes + offset);
+        uint8_t associationCount = bytes[offset + itemIDLength];
+        offset += itemIDLength + 1;
+        NSUInteger indexLength = hasLongIndexes ? 2 : 1;
+        if (offset + associationCount * indexLength > associationsEnd) {
+            return NO;
+        }
+        if (itemID == primaryItemID) {
+            for (NSUInteger j = 0; j < associationCount && propertyCount < 64; j++) {
+                const uint8_t *association = bytes + offset + j * indexLength;
+                // without the essential bit
+                propertyIndexes[propertyCount++] = hasLongIndexes ? (LCReadUInt16BE(association) & 0x7FFF) : (association[0] & 0x7F);
+            }
+        }
+        offset += associationCount * indexLength;
+    }
+
+    BOOL hasPixelSize = NO;
+    for (NSUInteger i = 0; i < propertyCount; i++) {
+        uint32_t index = 0;
+        BOOL found = NO;
+        offset = propertiesOffset;
+        while (offset < propertiesEnd && LCReadBox(bytes, propertiesEnd, offset, &type, &dataOffset, &boxEnd)) {
+            if (++index == propertyIndexes[i]) {
+                found = YES;
+                break;
+            }
+            offset = boxEnd;
+        }
+        if (!found) {
+            continue;
+        }
+        NSUInteger propertyLength = boxEnd - dataOffset;
+        if (memcmp(type, "ispe", 4) == 0 && propertyLength >= 12) {
+            fields->pixelSize = CGSizeMake(LCReadUInt32BE(bytes + dataOffset + 4), LCReadUInt32BE(bytes + dataOffset + 8));
+            hasPixelSize = YES;
+        } else if (memcmp(type, "irot", 4) == 0 && propertyLength >= 1) {
+            // counterclockwise quarter turns
+            fields->orientation = LCOrientationByApplying(fields->orientation, NO, NO, (4 - (bytes[dataOffset] & 0x03)) % 4);
+        } else if (memcmp(type, "imir", 4) == 0 && propertyLength >= 1) {
+            // 0 mirrors about the vertical axis, left and right
+            BOOL horizontalAxis = (bytes[dataOffset] & 0x01) != 0;
+            fields->orientation = LCOrientationByApplying(fields->orientation, !horizontalAxis, horizontalAxis, 0);
+        }
+    }
+
+    // the alpha plane is an auxiliary image of its own, any of them means the primary item has one
+    offset = propertiesOffset;
+    while (offset < propertiesEnd && LCReadBox(bytes, propertiesEnd, offset, &type, &dataOffset, &boxEnd)) {
+        if (memcmp(type, "auxC", 4) == 0 && boxEnd > dataOffset + 4) {
+            const char *auxiliaryType = (const char *)bytes + dataOffset + 4;
+            size_t auxiliaryTypeLength = strnlen(auxiliaryType, boxEnd - dataOffset - 4);
+            if ((auxiliaryTypeLength == strlen("urn:mpeg:hevc:2015:auxid:1") && strncmp(auxiliaryType, "urn:mpeg:hevc:2015:auxid:1", auxiliaryTypeLength) == 0) ||
+                (auxiliaryTypeLength == strlen("urn:mpeg:mpegB:cicp:systems:auxiliary:alpha") && strncmp(auxiliaryType, "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha", auxiliaryTypeLength) == 0)) {
+                fields->hasAlpha = YES;
+            }
+        }
+        offset = boxEnd;
+    }
+    return hasPixelSize;
+}
+
+CGSize LCImagePixelSizeFromHeader(NSData *data) {
+    NSUInteger length = data.length;
+    const uint8_t *bytes = data.bytes;
+    switch (LCImageDetectType(data)) {
+        case LCImageTypeJPEG:
+            return LCJPEGPixelSize(bytes, length);
+        case LCImageTypePNG:
+            // IHDR is always the first chunk
+            if (length < 24) {
+                return CGSizeZero;
+            }
+            return CGSizeMake(LCReadUInt32BE(bytes + 16), LCReadUInt32BE(bytes + 20));
+        case LCImageTypeGIF:
+            return CGSizeMake(LCReadUInt16LE(bytes + 6), LCReadUInt16LE(bytes + 8));
+        case LCImageTypeWebP:
+            return LCWebPPixelSize(bytes, length);
+        case LCImageTypeHEIC: {
+            LCImageHeaderFields fields = {0};
+            return LCReadHEIFHeader(bytes, length, &fields) ? fields.pixelSize : CGSizeZero;
+        }
+        default:
+            return CGSizeZero;
+    }
+}
+
+@interface LCImageHeader ()
+@property (nonatomic, assign, readwrite) LCImageType type;
+@property (nonatomic, assign, readwrite) CGSize pixelSize;
+@property (nonatomic, assign, readwrite) CGImagePropertyOrientation orientation;
+@property (nonatomic, assign, readwrite) NSUInteger frameCount;
+@property (nonatomic, assign, readwrite) BOOL hasAlpha;
+@end
+
+@implementation LCImageHeader
+
+- (instancetype)initWithDictionary:(NSDictionary<NSString *, id> *)dictionary {
+    NSNumber *type = dictionary[@"Type"];
+    NSNumber *width = dictionary[@"Width"];
+    NSNumber *height = dictionary[@"Height"];
+    if (![type isKindOfClass:[NSNumber class]] || ![width isKindOfClass:[NSNumber class]] || ![height isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+    if (self = [super init]) {
+        _type = type.unsignedIntegerValue;
+        _pixelSize = CGSizeMake(width.doubleValue, height.doubleValue);
+        _orientation = [dictionary[@"Orientation"] unsignedIntValue] ?: kCGImagePropertyOrientationUp;
+        _frameCount = [dictionary[@"FrameCount"] unsignedIntegerValue];
+        _hasAlpha = [dictionary[@"Alpha"] boolValue];
+    }
+    return self;
+}
+
+- (NSDictionary<NSString *, id> *)dictionaryRepresentation {
+    return @{@"Type": @(self.type),
+             @"Width": @(self.pixelSize.width),
+             @"Height": @(self.pixelSize.height),
+             @"Orientation": @(self.orientation),
+             @"FrameCount": @(self.frameCount),
+             @"Alpha": @(self.hasAlpha)};
+}
+
+- (CGSize)orientedPixelSize {
+    switch (self.orientation) {
+        case kCGImagePropertyOrientationLeft:
+        case kCGImagePropertyOrientationLeftMirrored:
+        case kCGImagePropertyOrientationRight:
+        case kCGImagePropertyOrientationRightMirrored:
+            return CGSizeMake(self.pixelSize.height, self.pixelSize.width);
+        default:
+            return self.pixelSize;
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<LCImageHeader>type: %lu size: %.0fx%.0f orientation: %u frames: %lu alpha: %d", (unsigned long)self.type, self.pixelSize.width, self.pixelSize.height, (unsigned int)self.orientation, (unsigned long)self.frameCount, self.hasAlpha];
+}
+
+@end
+
+LCImageHeader *LCImageProbeHeader(NSData *data) {
+    NSUInteger length = data.length;
+    const uint8_t *bytes = data.bytes;
+    LCImageType type = LCImageDetectType(data);
+    LCImageHeaderFields fields = {CGSizeZero, kCGImagePropertyOrientationUp, 1, NO};
+    BOOL complete = NO;
+    switch (type) {
+        case LCImageTypeJPEG:
+            complete = LCReadJPEGHeader(bytes, length, &fields);
+            break;
+        case LCImageTypePNG:
+            complete = LCReadPNGHeader(bytes, length, &fields);
+            break;
+        case LCImageTypeGIF:
+            fields.frameCount = 0;
+            complete = LCReadGIFHeader(bytes, length, &fields);
+            break;
+        case LCImageTypeWebP:
+            complete = LCReadWebPHeader(bytes, length, &fields);
+            break;
+        case LCImageTypeHEIC:
+            complete = LCReadHEIFHeader(bytes, length, &fields);
+            break;
+        default:
+            break;
+    }
+    if (!complete || fields.pixelSize.width <= 0 || fields.pixelSize.height <= 0) {
+        return nil;
+    }
+    LCImageHeader *header = [[LCImageHeader alloc] init];
+    header.type = type;
+    header.pixelSize = fields.pixelSize;
+    header.orientation = fields.orientation;
+    header.frameCount = fields.frameCount;
+    header.hasAlpha = fields.hasAlpha;
+    return header;
+}
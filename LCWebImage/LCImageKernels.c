@@ -0,0 +1,343 @@
+// LCImageKernels.c
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#include "LCImageKernels.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define LC_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LC_USE_SSE2 1
+#endif
+
+// the weights are fixed point with 14 fractional bits, a tap times 255 and the sum of the lobes fit an int32
+#define LC_WEIGHT_BITS 14
+#define LC_WEIGHT_ONE (1 << LC_WEIGHT_BITS)
+
+static const double kLCPi = 3.14159265358979323846;
+
+static double LCBoxFilter(double x) {
+    return x > -0.5 && x <= 0.5 ? 1 : 0;
+}
+
+static double LCTriangleFilter(double x) {
+    x = fabs(x);
+    return x < 1 ? 1 - x : 0;
+}
+
+static double LCSinc(double x) {
+    if (x == 0) {
+        return 1;
+    }
+    x *= kLCPi;
+    return sin(x) / x;
+}
+
+static double LCLanczos3Filter(double x) {
+    return fabs(x) < 3 ? LCSinc(x) * LCSinc(x / 3) : 0;
+}
+
+double LCImageResampleSupport(LCImageResampleQuality quality) {
+    switch (quality) {
+        case LCImageResampleQualityLow: return 0.5;
+        case LCImageResampleQualityMedium: return 1;
+        case LCImageResampleQualityHigh: return 3;
+    }
+    return 3;
+}
+
+static double LCImageResampleFilter(LCImageResampleQuality quality, double x) {
+    switch (quality) {
+        case LCImageResampleQualityLow: return LCBoxFilter(x);
+        case LCImageResampleQualityMedium: return LCTriangleFilter(x);
+        case LCImageResampleQualityHigh: return LCLanczos3Filter(x);
+    }
+    return LCLanczos3Filter(x);
+}
+
+// The taps of one axis: output `i` reads `counts[i]` inputs from `firsts[i]`, relative to the input window, with `weights[i * maximumTapCount ...]`.
+typedef struct {
+    size_t *firsts;
+    size_t *counts;
+    int32_t *weights;
+    size_t maximumTapCount;
+} LCResampleCoefficients;
+
+static void LCFreeCoefficients(LCResampleCoefficients *coefficients) {
+    free(coefficients->firsts);
+    free(coefficients->counts);
+    free(coefficients->weights);
+}
+
+// A scale down widens the filter, so each output pixel covers every input pixel it stands for.
+static double LCFilterScale(size_t inputTotal, size_t outputTotal) {
+    double scale = (double)outputTotal / inputTotal;
+    return scale < 1 ? 1 / scale : 1;
+}
+
+static void LCInputRange(double center, double support, size_t inputLow, size_t inputHigh, size_t *first, size_t *last) {
+    double left = floor(center - support);
+    double right = ceil(center + support);
+    *first = left < (double)inputLow ? inputLow : (size_t)left;
+    *last = right > (double)inputHigh ? inputHigh : (size_t)right;
+}
+
+// Computes the taps of the outputs [outputStart, outputStart + outputCount) of an axis scaled from inputTotal to outputTotal, reading only the inputs [inputLow, inputHigh).
+static bool LCComputeCoefficients(size_t inputTotal, size_t outputTotal, size_t outputStart, size_t outputCount, size_t inputLow, size_t inputHigh, LCImageResampleQuality quality, LCResampleCoefficients *coefficients) {
+    double scale = (double)outputTotal / inputTotal;
+    double filterScale = LCFilterScale(inputTotal, outputTotal);
+    double support = LCImageResampleSupport(quality) * filterScale;
+    size_t maximumTapCount = (size_t)ceil(support * 2) + 2;
+    coefficients->maximumTapCount = maximumTapCount;
+    coefficients->firsts = malloc(outputCount * sizeof(size_t));
+    coefficients->counts = malloc(outputCount * sizeof(size_t));
+    coefficients->weights = calloc(outputCount * maximumTapCount, sizeof(int32_t));
+    double *taps = malloc(maximumTapCount * sizeof(double));
+    if (!coefficients->firsts || !coefficients->counts || !coefficients->weights || !taps) {
+        free(taps);
+        LCFreeCoefficients(coefficients);
+        return false;
+    }
+
+    for (size_t i = 0; i < outputCount; i++) {
+        // pixel j covers [j, j + 1), its center is j + 0.5
+        double center = (outputStart + i + 0.5) / scale;
+        size_t first, last;
+        LCInputRange(center, support, inputLow, inputHigh, &first, &last);
+        if (last > first + maximumTapCount) {
+            last = first + maximumTapCount;
+        }
+        double sum = 0;
+        for (size_t j = first; j < last; j++) {
+            taps[j - first] = LCImageResampleFilter(quality, (j + 0.5 - center) / filterScale);
+            sum += taps[j - first];
+        }
+        if (sum == 0 || first >= last) {
+            // no tap reached the input, take the nearest pixel
+            double nearest = floor(center);
+            first = nearest < (double)inputLow ? inputLow : (nearest >= (double)inputHigh ? inputHigh - 1 : (size_t)nearest);
+            last = first + 1;
+            taps[0] = 1;
+            sum = 1;
+        }
+
+        int32_t *weights = coefficients->weights + i * maximumTapCount;
+        int32_t fixedSum = 0;
+        size_t largestTap = 0;
+        for (size_t j = 0; j < last - first; j++) {
+            weights[j] = (int32_t)lround(taps[j] / sum * LC_WEIGHT_ONE);
+            fixedSum += weights[j];
+            if (weights[j] > weights[largestTap]) {
+                largestTap = j;
+            }
+        }
+        // the weights add up to exactly one, flat areas stay flat
+        weights[largestTap] += LC_WEIGHT_ONE - fixedSum;
+        coefficients->firsts[i] = first - inputLow;
+        coefficients->counts[i] = last - first;
+    }
+    free(taps);
+    return true;
+}
+
+static inline uint8_t LCClampWeightedSum(int32_t value) {
+    value += LC_WEIGHT_ONE / 2;
+    if (value < 0) {
+        return 0;
+    }
+    value >>= LC_WEIGHT_BITS;
+    return value > 255 ? 255 : (uint8_t)value;
+}
+
+// One source row into one row of the intermediate image, at the destination width.
+static void LCResampleRowHorizontally(const uint8_t *source, uint8_t *destination, size_t width, const LCResampleCoefficients *coefficients) {
+    for (size_t x = 0; x < width; x++) {
+        const uint8_t *input = source + coefficients->firsts[x] * 4;
+        const int32_t *weights = coefficients->weights + x * coefficients->maximumTapCount;
+        size_t count = coefficients->counts[x];
+        int32_t sums[4] = {0};
+        for (size_t tap = 0; tap < count; tap++) {
+            int32_t weight = weights[tap];
+            // the 4 channels of a pixel at once, a vector lane each
+            for (size_t channel = 0; channel < 4; channel++) {
+                sums[channel] += weight * input[tap * 4 + channel];
+            }
+        }
+        for (size_t channel = 0; channel < 4; channel++) {
+            destination[x * 4 + channel] = LCClampWeightedSum(sums[channel]);
+        }
+    }
+}
+
+static void LCResampleGrayRowHorizontally(const uint8_t *source, uint8_t *destination, size_t width, const LCResampleCoefficients *coefficients) {
+    for (size_t x = 0; x < width; x++) {
+        const uint8_t *input = source + coefficients->firsts[x];
+        const int32_t *weights = coefficients->weights + x * coefficients->maximumTapCount;
+        size_t count = coefficients->counts[x];
+        int32_t sum = 0;
+        for (size_t tap = 0; tap < count; tap++) {
+            sum += weights[tap] * input[tap];
+        }
+        destination[x] = LCClampWeightedSum(sum);
+    }
+}
+
+// Premultiplied colors can't exceed their alpha, the negative lobes of Lanczos may overshoot it.
+static void LCClampToAlpha(uint8_t *row, size_t width, int alphaChannel) {
+    for (size_t x = 0; x < width; x++) {
+        uint8_t *pixel = row + x * 4;
+        uint8_t alpha = pixel[alphaChannel];
+        for (int channel = 0; channel < 4; channel++) {
+            if (pixel[channel] > alpha) {
+                pixel[channel] = alpha;
+            }
+        }
+    }
+}
+
+void LCImageResampleSourceRows(size_t destinationTop, size_t destinationHeight, size_t destinationTotalHeight, size_t sourceTotalHeight, LCImageResampleQuality quality, size_t *sourceTop, size_t *sourceHeight) {
+    if (destinationHeight == 0 || destinationTotalHeight == 0 || sourceTotalHeight == 0) {
+        *sourceTop = 0;
+        *sourceHeight = 0;
+        return;
+    }
+    double scale = (double)destinationTotalHeight / sourceTotalHeight;
+    double support = LCImageResampleSupport(quality) * LCFilterScale(sourceTotalHeight, destinationTotalHeight);
+    size_t first, unused, last;
+    LCInputRange((destinationTop + 0.5) / scale, support, 0, sourceTotalHeight, &first, &unused);
+    LCInputRange((destinationTop + destinationHeight - 0.5) / scale, support, 0, sourceTotalHeight, &unused, &last);
+    // the nearest pixel fallback may read one row past the taps
+    double nearest = floor((destinationTop + destinationHeight - 0.5) / scale);
+    if (nearest >= (double)last && last < sourceTotalHeight) {
+        last = (size_t)nearest + 1 < sourceTotalHeight ? (size_t)nearest + 1 : sourceTotalHeight;
+    }
+    *sourceTop = first;
+    *sourceHeight = last > first ? last - first : 0;
+}
+
+bool LCImageResampleRows(const LCImageBuffer *source, size_t sourceTop, size_t sourceTotalHeight, LCImageBuffer *destination, size_t destinationTop, size_t destinationTotalHeight, LCImageResampleQuality quality, int alphaChannel) {
+    if (!source || !destination || !source->data || !destination->data ||
+        source->width == 0 || source->height == 0 || destination->width == 0 || destination->height == 0 ||
+        sourceTop + source->height > sourceTotalHeight || destinationTop + destination->height > destinationTotalHeight ||
+        source->channels != destination->channels || (source->channels != 1 && source->channels != 4)) {
+        return false;
+    }
+    size_t channels = source->channels;
+    if (alphaChannel >= (int)channels) {
+        alphaChannel = -1;
+    }
+
+    LCResampleCoefficients horizontal;
+    LCResampleCoefficients vertical;
+    if (!LCComputeCoefficients(source->width, destination->width, 0, destination->width, 0, source->width, quality, &horizontal)) {
+        return false;
+    }
+    if (!LCComputeCoefficients(sourceTotalHeight, destinationTotalHeight, destinationTop, destination->height, sourceTop, sourceTop + source->height, quality, &vertical)) {
+        LCFreeCoefficients(&horizontal);
+        return false;
+    }
+
+    // only the source rows some destination row reads go through the horizontal pass
+    size_t rowLow = vertical.firsts[0];
+    size_t rowHigh = vertical.firsts[destination->height - 1] + vertical.counts[destination->height - 1];
+    size_t intermediateBytesPerRow = destination->width * channels;
+    uint8_t *intermediate = malloc((rowHigh - rowLow) * intermediateBytesPerRow);
+    int32_t *sums = malloc(intermediateBytesPerRow * sizeof(int32_t));
+    if (!intermediate || !sums) {
+        free(intermediate);
+        free(sums);
+        LCFreeCoefficients(&horizontal);
+        LCFreeCoefficients(&vertical);
+        return false;
+    }
+
+    for (size_t y = rowLow; y < rowHigh; y++) {
+        const uint8_t *sourceRow = source->data + y * source->bytesPerRow;
+        uint8_t *intermediateRow = intermediate + (y - rowLow) * intermediateBytesPerRow;
+        if (channels == 4) {
+            LCResampleRowHorizontally(sourceRow, intermediateRow, destination->width, &horizontal);
+        } else {
+            LCResampleGrayRowHorizontally(sourceRow, intermediateRow, destination->width, &horizontal);
+        }
+    }
+
+    for (size_t y = 0; y < destination->height; y++) {
+        const int32_t *weights = vertical.weights + y * vertical.maximumTapCount;
+        const uint8_t *input = intermediate + (vertical.firsts[y] - rowLow) * intermediateBytesPerRow;
+        memset(sums, 0, intermediateBytesPerRow * sizeof(int32_t));
+        // whole rows at a time, contiguous and easy to vectorize
+        for (size_t tap = 0; tap < vertical.counts[y]; tap++) {
+            int32_t weight = weights[tap];
+            const uint8_t *row = input + tap * intermediateBytesPerRow;
+            for (size_t i = 0; i < intermediateBytesPerRow; i++) {
+                sums[i] += weight * row[i];
+            }
+        }
+        uint8_t *output = destination->data + y * destination->bytesPerRow;
+        for (size_t i = 0; i < intermediateBytesPerRow; i++) {
+            output[i] = LCClampWeightedSum(sums[i]);
+        }
+        if (alphaChannel >= 0) {
+            LCClampToAlpha(output, destination->width, alphaChannel);
+        }
+    }
+
+    free(intermediate);
+    free(sums);
+    LCFreeCoefficients(&horizontal);
+    LCFreeCoefficients(&vertical);
+    return true;
+}
+
+bool LCImageResample(const LCImageBuffer *source, LCImageBuffer *destination, LCImageResampleQuality quality, int alphaChannel) {
+    if (!source || !destination) {
+        return false;
+    }
+    return LCImageResampleRows(source, 0, source->height, destination, 0, destination->height, quality, alphaChannel);
+}
+
+bool LCImageIsOpaque(const LCImageBuffer *buffer, int alphaChannel) {
+    if (!buffer || !buffer->data || buffer->channels != 4 || alphaChannel < 0 || alphaChannel >= 4) {
+        return true;
+    }
+#if LC_USE_SSE2
+    const __m128i opaque = _mm_set1_epi8((char)0xFF);
+    // the movemask bits of the alpha bytes of 4 pixels
+    const int alphaMask = 0x1111 << alphaChannel;
+#endif
+    for (size_t y = 0; y < buffer->height; y++) {
+        const uint8_t *row = buffer->data + y * buffer->bytesPerRow;
+        size_t x = 0;
+#if LC_USE_NEON
+        for (; x + 16 <= buffer->width; x += 16) {
+            uint8x16x4_t pixels = vld4q_u8(row + x * 4);
+            if (vminvq_u8(pixels.val[alphaChannel]) != 255) {
+                return false;
+            }
+        }
+#elif LC_USE_SSE2
+        for (; x + 16 <= buffer->width; x += 16) {
+            const __m128i *pixels = (const __m128i *)(row + x * 4);
+            __m128i all = _mm_and_si128(_mm_and_si128(_mm_loadu_si128(pixels), _mm_loadu_si128(pixels + 1)),
+                                        _mm_and_si128(_mm_loadu_si128(pixels + 2), _mm_loadu_si128(pixels + 3)));
+            if ((_mm_movemask_epi8(_mm_cmpeq_epi8(all, opaque)) & alphaMask) != alphaMask) {
+                return false;
+            }
+        }
+#endif
+        for (; x < buffer->width; x++) {
+            if (row[x * 4 + alphaChannel] != 255) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
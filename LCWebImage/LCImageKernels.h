@@ -0,0 +1,101 @@
+// LCImageKernels.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+/*
+ The pixel kernels of the decoder, in portable C with no Apple framework, so they can be
+ built, checked against reference images and benchmarked on any platform.
+ */
+
+#ifndef LCImageKernels_h
+#define LCImageKernels_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The filter used to resample an image.
+typedef enum {
+    /// Averages the source pixels covered by each destination pixel. The fastest, sharp enough for large downscales.
+    LCImageResampleQualityLow = 0,
+    /// A triangle filter, bilinear when scaling up.
+    LCImageResampleQualityMedium = 1,
+    /// A Lanczos filter with 3 lobes. The sharpest, and the slowest.
+    LCImageResampleQualityHigh = 2
+} LCImageResampleQuality;
+
+/// An image of 8 bits per channel, in any channel order.
+typedef struct {
+    uint8_t *data;
+    size_t width;
+    size_t height;
+    size_t bytesPerRow;
+    /// 1 for gray images, 4 for color images.
+    size_t channels;
+} LCImageBuffer;
+
+/**
+ Returns the radius of the filter of the quality, in destination pixels when scaling down.
+ */
+double LCImageResampleSupport(LCImageResampleQuality quality);
+
+/**
+ Resamples the whole source into the whole destination.
+
+ @param source The source image.
+ @param destination The destination image, its data is overwritten.
+ @param quality The filter.
+ @param alphaChannel The index of the alpha channel of premultiplied images, whose colors are kept no greater than their alpha. -1 for images without alpha.
+ @return false if the sizes are empty, the channels differ or the working memory could not be allocated.
+ */
+bool LCImageResample(const LCImageBuffer *source, LCImageBuffer *destination, LCImageResampleQuality quality, int alphaChannel);
+
+/**
+ Returns the source rows needed to produce some rows of the destination, so that an image can be resampled band by band.
+
+ @param destinationTop The first destination row.
+ @param destinationHeight The number of destination rows.
+ @param destinationTotalHeight The height of the whole destination image.
+ @param sourceTotalHeight The height of the whole source image.
+ @param quality The filter.
+ @param sourceTop On return, the first source row needed.
+ @param sourceHeight On return, the number of source rows needed.
+ */
+void LCImageResampleSourceRows(size_t destinationTop, size_t destinationHeight, size_t destinationTotalHeight, size_t sourceTotalHeight, LCImageResampleQuality quality, size_t *sourceTop, size_t *sourceHeight);
+
+/**
+ Resamples a band of the source into a band of the destination. The bands are the same as resampling the whole images, without seams, as long as the source band holds the rows returned by `LCImageResampleSourceRows`.
+
+ @param source The source band, holding the full width of the source image.
+ @param sourceTop The row of the whole source image the band starts at.
+ @param sourceTotalHeight The height of the whole source image.
+ @param destination The destination band, holding the full width of the destination image.
+ @param destinationTop The row of the whole destination image the band starts at.
+ @param destinationTotalHeight The height of the whole destination image.
+ @param quality The filter.
+ @param alphaChannel The index of the alpha channel of premultiplied images, -1 for images without alpha.
+ @return false if the sizes are empty, the channels differ or the working memory could not be allocated.
+ */
+bool LCImageResampleRows(const LCImageBuffer *source, size_t sourceTop, size_t sourceTotalHeight, LCImageBuffer *destination, size_t destinationTop, size_t destinationTotalHeight, LCImageResampleQuality quality, int alphaChannel);
+
+/**
+ Returns whether every pixel of the image has a full alpha, scanning 16 pixels at a time with NEON or SSE2 where available and stopping at the first pixel that is not opaque.
+
+ @param buffer The image.
+ @param alphaChannel The index of the alpha channel. -1 for images without alpha, which are opaque.
+ */
+bool LCImageIsOpaque(const LCImageBuffer *buffer, int alphaChannel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCImageKernels_h */
@@ -8,6 +8,9 @@
 
 #import <Foundation/Foundation.h>
 #import "LCAutoPurgingImageCache.h"
+#import "LCImageDecodeScheduler.h"
+#import "LCImageHeaderParser.h"
+#import "LCWebImageMetrics.h"
 #if __has_include(<AFNetworking/AFHTTPSessionManager.h>)
 #import <AFNetworking/AFHTTPSessionManager.h>
 #else
@@ -21,6 +24,35 @@ typedef NS_ENUM(NSInteger, LCImageDownloadPrioritization) {
     LCImageDownloadPrioritizationLIFO
 };
 
+/// The size, in pixels, the image is displayed at (NSValue of CGSize).
+FOUNDATION_EXPORT NSString * const LCWebImageContextTargetPixelSizeKey;
+/// The scale of the screen the image is displayed on (NSNumber).
+FOUNDATION_EXPORT NSString * const LCWebImageContextScreenScaleKey;
+/// The content mode of the view the image is displayed in (NSNumber of UIViewContentMode). `UIViewContentModeScaleToFill` if absent. With `LCWebImageContextTargetPixelSizeKey`, the image is decoded at the size it is displayed at.
+FOUNDATION_EXPORT NSString * const LCWebImageContextContentModeKey;
+/// The largest response, in bytes, the request accepts (NSNumber), overriding `maximumDownloadBytes`. 0 for no limit.
+FOUNDATION_EXPORT NSString * const LCWebImageContextMaximumByteCountKey;
+/// The largest image, in pixels, the request accepts (NSNumber), overriding `maximumPixelCount`. 0 for no limit.
+FOUNDATION_EXPORT NSString * const LCWebImageContextMaximumPixelCountKey;
+/// When the image is decoded (NSNumber of LCWebImageDecodePolicy). `LCWebImageDecodePolicyEager` if absent.
+FOUNDATION_EXPORT NSString * const LCWebImageContextDecodePolicyKey;
+
+/// When a loaded image is decoded. When requests with different policies are merged, the most eager one applies.
+typedef NS_ENUM(NSInteger, LCWebImageDecodePolicy) {
+    /// Decode the image before it is delivered, for the images on screen.
+    LCWebImageDecodePolicyEager,
+    /// Like `LCWebImageDecodePolicyLazy`, and decode the image in the background once the main run loop waits for events in its default mode, so not while scrolling.
+    LCWebImageDecodePolicyIdle,
+    /// Keep the image encoded in the memory cache, which charges its data length. It is decoded by the first eager request that finds it there, or by Core Animation if the delivered image is displayed. For prefetched images that may never be shown.
+    LCWebImageDecodePolicyLazy
+};
+
+/// Rewrites the URL of an image for the display context, see `LCWebImageContextTargetPixelSizeKey`. Return nil to keep the URL.
+typedef NSURL * _Nullable (^LCWebImageURLTransformer)(NSURL *URL, NSDictionary<NSString *, id> *context);
+
+/// Maps the URL of an image to the key it is cached and merged under.
+typedef NSString * _Nullable (^LCWebImageCacheKeyFilter)(NSURL *URL);
+
 /// The options to control image operation.
 typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
     
@@ -29,6 +61,15 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
     
     /// If the returned image is empty, use the placeHolder.
     LCWebImageOptionNilImageUsePlaceHolder = 1 << 1,
+    
+    /// The image is prefetched or offscreen. Its download and decode run after the ones of visible images.
+    LCWebImageOptionLowPriority = 1 << 2,
+    
+    /// If every request for the image is cancelled after its data arrived, still write the data to the disk cache. By default the data is dropped.
+    LCWebImageOptionCacheCancelledData = 1 << 3,
+    
+    /// Download the image even if it recently failed, see `negativeCacheDurationForClientErrors`.
+    LCWebImageOptionRetryFailed = 1 << 4,
 };
 
 /**
@@ -39,9 +80,9 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
 @property (nonatomic, strong) NSURL *url;
 
 /**
- The data task created by the `LCWebImageManager`.
+ The data task created by the `LCWebImageManager`. `nil` if the image is loaded from the disk cache or decoded from the memory cache. The task is created off the calling thread, it is `nil` until then.
 */
-@property (nonatomic, strong, nullable) NSURLSessionDataTask *task;
+@property (atomic, strong, nullable) NSURLSessionDataTask *task;
 
 /**
  The unique identifier for the success and failure blocks when duplicate requests are made.
@@ -51,6 +92,20 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
 
 /** The `LCWebImageManager` class is responsible for downloading images in parallel on a prioritized queue. Incoming downloads are added to the front or back of the queue depending on the download prioritization. Each downloaded image is cached in the underlying `NSURLCache` as well as the in-memory image cache. By default, any download request with a cached image equivalent in the image cache will automatically be served the cached image representation.
  */
+@class LCWebImageManager;
+
+@protocol LCWebImageMetricsDelegate <NSObject>
+
+/**
+ Called on the main thread once a sampled load has delivered its result.
+
+ @param imageManager The manager that loaded the image.
+ @param metrics The metrics of the load.
+ */
+- (void)imageManager:(LCWebImageManager *)imageManager didCollectMetrics:(LCWebImageLoadMetrics *)metrics;
+
+@end
+
 @interface LCWebImageManager : NSObject
 
 /**
@@ -63,16 +118,200 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
  */
 @property (nonatomic, strong) AFHTTPSessionManager *sessionManager;
 
+/**
+ The scheduler that decodes the downloaded and disk cached images. `[LCImageDecodeScheduler sharedScheduler]` by default.
+ */
+@property (nonatomic, strong) LCImageDecodeScheduler *decodeScheduler;
+
+/**
+ The main thread time, in seconds, that delivering results may take per frame. The success and failure blocks are not dispatched to the main queue one by one: the results finished during a run loop turn are delivered together, and once this budget is used up the remaining results wait for the next display refresh. `0.005` by default. Provide 0 to deliver every pending result at once.
+ */
+@property (nonatomic, assign) NSTimeInterval deliveryTimeBudget;
+
 /**
  Defines the order prioritization of incoming download requests being inserted into the queue. `LCImageDownloadPrioritizationFIFO` by default.
  */
 @property (nonatomic, assign) LCImageDownloadPrioritization downloadPrioritization;
 
+/**
+ Whether the disk cache is validated with the HTTP validators of the image responses instead of the `NSURLCache` of the session. `NO` by default.
+
+ When enabled, image responses are no longer stored in the `NSURLCache`, so every image is only cached once on disk. The `ETag`, `Last-Modified` and `Cache-Control` of each response are stored next to the disk data. Once the `max-age` of an entry has passed, it is revalidated with a conditional request, and a `304 Not Modified` response refreshes the entry without transferring the body. If the revalidation fails, the stale disk data is used.
+ */
+@property (nonatomic, assign) BOOL shouldValidateDiskCache;
+
+/**
+ Maps the URL of an image to the key used by the image cache, by the merging of concurrent requests and by the categories to tell whether a request is already active. Requests whose URLs map to the same key share one download and one cache entry. If nil, or if it returns nil, the absolute string of the URL is used. nil by default.
+
+ @see `cacheKeyFilterRemovingQueryItemNames:`
+ */
+@property (nonatomic, copy, nullable) LCWebImageCacheKeyFilter cacheKeyFilter;
+
+/**
+ Rewrites the URLs of the images requested by the categories for the size they are displayed at, for example to a sized variant served by a CDN. The rewritten URL is the one downloaded and cached. nil by default.
+
+ @see `URLTransformerSettingQueryItemName:toWidthBuckets:`
+ */
+@property (nonatomic, copy, nullable) LCWebImageURLTransformer URLTransformer;
+
+/**
+ Whether the requests of the categories carry the `Width` and `DPR` client hints of the size the image is displayed at. `NO` by default.
+ */
+@property (nonatomic, assign) BOOL shouldSendClientHints;
+
+/**
+ The time, in seconds, a URL that failed with a 4xx status fails again right away instead of being downloaded, unless `LCWebImageOptionRetryFailed` is used. `300` by default. Provide 0 to not remember these failures.
+ */
+@property (nonatomic, assign) NSTimeInterval negativeCacheDurationForClientErrors;
+
+/**
+ The time, in seconds, a URL that failed with a 5xx, 408 or 429 status, once its retries are used up, fails again right away. `30` by default.
+ */
+@property (nonatomic, assign) NSTimeInterval negativeCacheDurationForServerErrors;
+
+/**
+ The time, in seconds, a URL that failed without a response, such as a timeout, once its retries are used up, fails again right away. `5` by default.
+ */
+@property (nonatomic, assign) NSTimeInterval negativeCacheDurationForNetworkErrors;
+
+/**
+ The largest response, in bytes, a download accepts. A response whose `Content-Length` is larger is cancelled before its body is downloaded, and fails with `NSURLErrorDataLengthExceedsMaximum`. `0` by default, for no limit.
+ */
+@property (nonatomic, assign) NSUInteger maximumDownloadBytes;
+
+/**
+ The largest image, in pixels, a download accepts. The dimensions are read from the JPEG, PNG, GIF or WebP header as soon as it arrives, and a larger image is cancelled and fails with `NSURLErrorDataLengthExceedsMaximum`, so it is neither downloaded in full nor decoded. `0` by default, for no limit.
+ */
+@property (nonatomic, assign) NSUInteger maximumPixelCount;
+
+/**
+ The largest ratio between the pixels of an image and the pixels it is displayed at, see `LCWebImageContextTargetPixelSizeKey`, for example `16` for an image 4 times wider and taller than its view. Larger images are cancelled like the ones above `maximumPixelCount`. `0` by default, for no limit.
+ */
+@property (nonatomic, assign) double maximumPixelCountRatio;
+
+/**
+ The fraction of extra requests hedging may send, for example `0.05` for at most one hedge every 20 downloads. When a download has no response after the p95 time to first byte of its host, a second request is sent on a separate connection, or to a mirror host, see `hedgingMirrorHosts`. The first one to complete wins and the other is cancelled. A host is hedged once 20 downloads from it were measured. `0` by default, hedging is disabled.
+ */
+@property (nonatomic, assign) double hedgingBudget;
+
+/**
+ The hosts serving the same images as a host, keyed by host, for example `@{@"img.example.com": @[@"img2.example.com"]}`. Hedged requests are sent to them in turn. nil by default, hedged requests go to the same host.
+ */
+@property (nonatomic, copy, nullable) NSDictionary<NSString *, NSArray<NSString *> *> *hedgingMirrorHosts;
+
+/**
+ The number of times a download is retried after a transient failure: a timeout, a lost connection, or a 408, 429, 500, 502, 503 or 504 status. `2` by default.
+ */
+@property (nonatomic, assign) NSUInteger maximumRetryCount;
+
+/**
+ The delay, in seconds, the retries back off from. The n-th retry waits a random time up to `retryBaseDelay * 2^(n-1)`, capped at 30 seconds, or the `Retry-After` of the response. `0.5` by default.
+ */
+@property (nonatomic, assign) NSTimeInterval retryBaseDelay;
+
+/**
+ The fraction of the expected length past which a download keeps running into the disk cache when its last request is cancelled, so that scrolling back does not transfer the image again. `0.8` by default. Provide a value greater than 1 to never keep downloads alive.
+ */
+@property (nonatomic, assign) double keepAliveProgressThreshold;
+
+/**
+ The time, in seconds, a download below `keepAliveProgressThreshold` is suspended instead of cancelled when its last request is cancelled. If the image is requested again within this period, the download resumes where it stopped, otherwise it is cancelled. `10` by default. Provide 0 to cancel immediately.
+ */
+@property (nonatomic, assign) NSTimeInterval cancellationGracePeriod;
+
+/**
+ The number of received bytes that were reused after every request of their download was cancelled: the bytes a suspended or kept alive download had received when the image was requested again. Counted once each time the download is requested again.
+ */
+@property (nonatomic, assign, readonly) int64_t savedDownloadBytes;
+
+/**
+ The expected length, in bytes, from which a download is resumable. When such a download is cancelled or fails, the bytes received so far are stored in the disk cache together with the `ETag` or `Last-Modified` of the response, and the next download of the image only requests the missing bytes with `Range` and `If-Range` headers. Only responses with `Accept-Ranges: bytes` are resumed. `1MB` by default. Provide 0 to disable.
+ */
+@property (nonatomic, assign) NSUInteger resumableDownloadMinimumBytes;
+
+/**
+ The fraction of loads whose timings are recorded, from 0 to 1. Loads that are not sampled don't pay for the recording. `0` by default.
+ */
+@property (nonatomic, assign) double metricsSamplingRate;
+
+/**
+ The delegate receiving the metrics of the sampled loads.
+ */
+@property (nonatomic, weak, nullable) id <LCWebImageMetricsDelegate> metricsDelegate;
+
+/**
+ The aggregator the metrics of the sampled loads are added to, for the p50, p90 and p99 of each stage. nil by default.
+ */
+@property (nonatomic, strong, nullable) LCWebImageMetricsAggregator *metricsAggregator;
+
 /**
  The shared default instance of `LCWebImageManager` initialized with default values.
  */
 + (instancetype)defaultInstance;
 
+/**
+ Returns a cache key filter that removes the query items with the given names, such as expiring signatures, and sorts the remaining ones, so that the same image always gets the same key. A `?` inside the query is treated as a separator as well, since some URLs append their signed parameters with a second `?`.
+
+ @param names The names of the query items to remove.
+ */
++ (LCWebImageCacheKeyFilter)cacheKeyFilterRemovingQueryItemNames:(NSArray<NSString *> *)names;
+
+/**
+ Returns the key the image of the URL is cached under, see `cacheKeyFilter`.
+
+ @param URL The URL of the image.
+ @return The key, or nil if the URL is nil.
+ */
+- (nullable NSString *)cacheKeyForURL:(nullable NSURL *)URL;
+
+/**
+ Returns the key the image of the URL is kept under in the memory cache once decoded for the display context. Images decoded at their display size get a key of their own, the disk data stays under `cacheKeyForURL:`.
+
+ @param URL The URL of the image.
+ @param context The display context, see `LCWebImageContextTargetPixelSizeKey` and `LCWebImageContextContentModeKey`.
+ @return The key, or nil if the URL is nil.
+ */
+- (nullable NSString *)cacheKeyForURL:(nullable NSURL *)URL context:(nullable NSDictionary<NSString *, id> *)context;
+
+/**
+ Returns the image of the memory cache that can be shown in the display context right away. The categories call it before loading the image.
+
+ @param URL The URL of the image.
+ @param context The display context, see `LCWebImageContextTargetPixelSizeKey` and `LCWebImageContextDecodePolicyKey`.
+ @return The image, or nil if it is not in the memory cache, or is still encoded and the context decodes eagerly.
+ */
+- (nullable UIImage *)memoryImageForURL:(nullable NSURL *)URL context:(nullable NSDictionary<NSString *, id> *)context;
+
+/**
+ Returns the header of the image of the URL in the disk cache, stored next to the data when it was downloaded, so the size of an image can be known for layout without reading it.
+ This method may blocks the calling thread until the metadata is read.
+
+ @param URL The URL of the image.
+ @return The header, or nil if the image is not in the disk cache or its header is unknown.
+ */
+- (nullable LCImageHeader *)diskImageHeaderForURL:(nullable NSURL *)URL;
+
+/**
+ Returns a URL transformer that sets the query item with the given name to the smallest bucket that is at least the target pixel width, or to the largest bucket. URLs without a target pixel size in their context are kept.
+
+ @param name The name of the width query item, for example `w`.
+ @param buckets The widths, in pixels, the server provides.
+ */
++ (LCWebImageURLTransformer)URLTransformerSettingQueryItemName:(NSString *)name toWidthBuckets:(NSArray<NSNumber *> *)buckets;
+
+/**
+ Returns the request to send for an image displayed in the given context, rewritten by `URLTransformer` and carrying the client hints if `shouldSendClientHints`. The categories call it before looking up the caches.
+
+ @param request The request of the image.
+ @param context The display context, see `LCWebImageContextTargetPixelSizeKey`.
+ */
+- (NSURLRequest *)transformedRequestForRequest:(NSURLRequest *)request context:(nullable NSDictionary<NSString *, id> *)context;
+
+/**
+ Forgets every failed URL, for example once the network is reachable again.
+ */
+- (void)removeAllFailedURLs;
+
 /**
  Creates a default `NSURLCache` with common usage parameter values.
 
@@ -117,17 +356,33 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
                             imageCache:(nullable id <LCImageCache>)imageCache;
 
 /**
- The disk image.
+ Loads and decodes the image stored in the disk cache for the specified URL.
+
+ If the same image is already being loaded from disk or downloaded, the completion block is appended to the existing load, so the file is read and decoded only once. The load can be cancelled with the returned receipt.
 
  @param URL The URL.
- @param receiptID The options to control image operation.
- @param completion A block to be executed when the image data task finished.
+ @param receiptID The identifier to use for the receipt that will be created for this load.
+ @param completion A block to be executed when the image data task finished. It is always called, with nil if the load fails or joins a download that fails.
 
  @return LCImageDownloadReceipt.
  */
+- (nullable LCImageDownloadReceipt *)diskImageForURL:(NSURL *)URL
+                                       withReceiptID:(nonnull NSUUID *)receiptID
+                                          completion:(nullable void (^)(UIImage *image))completion;
+
+/**
+ Loads the image stored in the disk cache for the specified URL, decoded for the display context.
 
+ @param URL The URL.
+ @param receiptID The identifier to use for the receipt that will be created for this load.
+ @param context The display context, see `LCWebImageContextTargetPixelSizeKey`. When loads for different contexts are merged, the image is decoded large enough for all of them.
+ @param completion A block to be executed when the image data task finished.
+
+ @return LCImageDownloadReceipt.
+ */
 - (nullable LCImageDownloadReceipt *)diskImageForURL:(NSURL *)URL
                                        withReceiptID:(nonnull NSUUID *)receiptID
+                                             context:(nullable NSDictionary<NSString *, id> *)context
                                           completion:(nullable void (^)(UIImage *image))completion;
 
 /**
@@ -172,10 +427,45 @@ typedef NS_OPTIONS(NSUInteger, LCWebImageOptions) {
                                                         options:(LCWebImageOptions)options
                                                         success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
                                                         failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure;
+
+/**
+ Creates a data task using the `sessionManager` instance for the specified URL request, with the display context of the image.
+
+ @param request The URL request.
+ @param receiptID The identifier to use for the download receipt that will be created for this request.
+ @param options The options to control image operation.
+ @param context The display context and budgets of the image, see `LCWebImageContextTargetPixelSizeKey`, `LCWebImageContextMaximumPixelCountKey` and `LCWebImageContextDecodePolicyKey`. The image is decoded at the size it is displayed at. When requests with different contexts are merged, the largest budget and decode size and the most eager decode policy apply.
+ @param success A block to be executed when the image data task finishes successfully.
+ @param failure A block object to be executed when the image data task finishes unsuccessfully.
+
+ @return The image download receipt for the data task if available. `nil` if the image is stored in the cache.
+ */
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                        options:(LCWebImageOptions)options
+                                                        context:(nullable NSDictionary<NSString *, id> *)context
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure;
+
+/**
+ Works as `downloadImageForURLRequest:withReceiptID:options:context:success:failure:`, and reports the header of the image as soon as it is read, before the image is decoded. A download reads it from the first bytes of the response, usually a few hundred, a disk cache load from the metadata stored next to the data.
+
+ @param header A block to be executed on the main thread with the header of the image, before the success block. Not executed for an image found in the memory cache, nor for the formats `LCImageProbeHeader` doesn't read.
+
+ @return The image download receipt for the data task if available. `nil` if the image is stored in the cache.
+ */
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                        options:(LCWebImageOptions)options
+                                                        context:(nullable NSDictionary<NSString *, id> *)context
+                                                         header:(nullable void (^)(NSURLRequest *request, LCImageHeader *header))header
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure;
+
 /**
  Cancels the data task in the receipt by removing the corresponding success and failure blocks and cancelling the data task if necessary.
 
- If the data task is pending in the queue, it will be cancelled if no other success and failure blocks are registered with the data task. If the data task is currently executing or is already completed, the success and failure blocks are removed and will not be called when the task finishes.
+ If the data task is pending in the queue, it will be cancelled if no other success and failure blocks are registered with the data task. If the data task is currently executing or is already completed, the success and failure blocks are removed and will not be called when the task finishes. Disk cache loads are cancelled the same way, and stop before reading or decoding once no blocks are left. A data task that is executing when its last blocks are removed is kept running or suspended instead, see `keepAliveProgressThreshold` and `cancellationGracePeriod`.
 
  @param imageDownloadReceipt The image download receipt to cancel.
  */
@@ -7,11 +7,149 @@
 //
 
 #import "LCWebImageManager.h"
+#import "LCWebImageTrace.h"
+#import "LCImageHeaderParser.h"
+#import "UIImage+LCDecoder.h"
+#import <ImageIO/ImageIO.h>
+#import <QuartzCore/QuartzCore.h>
+#import <os/lock.h>
+#import <objc/runtime.h>
+
+NSString * const LCWebImageContextTargetPixelSizeKey = @"TargetPixelSize";
+NSString * const LCWebImageContextScreenScaleKey = @"ScreenScale";
+NSString * const LCWebImageContextContentModeKey = @"ContentMode";
+NSString * const LCWebImageContextMaximumByteCountKey = @"MaximumByteCount";
+NSString * const LCWebImageContextMaximumPixelCountKey = @"MaximumPixelCount";
+NSString * const LCWebImageContextDecodePolicyKey = @"DecodePolicy";
+
+// The number of time to first byte samples a host needs before its downloads are hedged, and the number kept.
+static const NSUInteger kLCMinimumHedgingSampleCount = 20;
+static const NSUInteger kLCMaximumHedgingSampleCount = 64;
+
+// The bytes after which a header that still has no dimensions is given up on, large EXIF segments come before the JPEG frame header.
+static const NSUInteger kLCMaximumHeaderProbeBytes = 256 * 1024;
+
+// The idle decodes running at once, an idle main run loop starts more as they finish.
+static const NSUInteger kLCMaximumIdleDecodeCount = 2;
+
+// The order of the main run loop observer that starts the idle decodes, after the Core Animation commit.
+static const CFIndex kLCIdleDecodeObserverOrder = 2000001;
+
+// The number of images whose decoded sizes are remembered for the memory cache lookups.
+static const NSUInteger kLCMaximumDecodedVariantImageCount = 1024;
+
+// The merged task of a data task, read by the session blocks that stream the response.
+static char LCMergedTaskKey;
+
+// The disk cache metadata key of the length of a partial download (NSNumber).
+static NSString * const LCPartialDataLengthKey = @"PartialLength";
+
+// The disk cache identifier of the bytes received by an interrupted download.
+static NSString * LCPartialDataIdentifier(NSString *identifier) {
+    return [@"partial:" stringByAppendingString:identifier];
+}
+
+// The first byte position of a `206 Partial Content` response, or -1.
+static long long LCContentRangeStart(NSHTTPURLResponse *response) {
+    NSString *contentRange = response.allHeaderFields[@"Content-Range"];
+    if (![contentRange.lowercaseString hasPrefix:@"bytes "]) {
+        return -1;
+    }
+    NSScanner *scanner = [NSScanner scannerWithString:[contentRange substringFromIndex:6]];
+    long long start = -1;
+    if (![scanner scanLongLong:&start]) {
+        return -1;
+    }
+    return start;
+}
+
+// The size of the bitmap the data decodes to for the target, read from the image header without decoding. Still images are decoded as thumbnails no larger than the target, animated ones at full size.
+static NSUInteger LCDecodedByteCountForImageData(NSData *data, CGSize targetPixelSize, UIViewContentMode contentMode) {
+    LCImageHeader *header = LCImageProbeHeader(data);
+    if (header == nil) {
+        return 0;
+    }
+    CGSize pixelSize = header.orientedPixelSize;
+    if (header.frameCount <= 1) {
+        pixelSize = [UIImage lc_decodedPixelSizeForPixelSize:pixelSize limitBytes:0 maximumPixelSize:0 targetPixelSize:targetPixelSize contentMode:contentMode];
+    }
+    return (NSUInteger)(pixelSize.width * pixelSize.height * 4);
+}
+
+// Reads the size the image should be decoded at from the display context. Only the modes that scale the image have one, aspect fit is the only one that doesn't cover the target.
+static BOOL LCDecodeTargetFromContext(NSDictionary<NSString *, id> *context, CGSize *pixelSize, UIViewContentMode *contentMode) {
+    CGSize size = [context[LCWebImageContextTargetPixelSizeKey] CGSizeValue];
+    if (size.width <= 0 || size.height <= 0) {
+        return NO;
+    }
+    NSNumber *mode = context[LCWebImageContextContentModeKey];
+    switch (mode ? mode.integerValue : UIViewContentModeScaleToFill) {
+        case UIViewContentModeScaleAspectFit:
+            *contentMode = UIViewContentModeScaleAspectFit;
+            break;
+        case UIViewContentModeScaleToFill:
+        case UIViewContentModeScaleAspectFill:
+        case UIViewContentModeRedraw:
+            *contentMode = UIViewContentModeScaleAspectFill;
+            break;
+        default:
+            return NO;
+    }
+    *pixelSize = size;
+    return YES;
+}
+
+static LCWebImageDecodePolicy LCDecodePolicyFromContext(NSDictionary<NSString *, id> *context) {
+    NSNumber *policy = context[LCWebImageContextDecodePolicyKey];
+    switch (policy ? policy.integerValue : LCWebImageDecodePolicyEager) {
+        case LCWebImageDecodePolicyIdle:
+            return LCWebImageDecodePolicyIdle;
+        case LCWebImageDecodePolicyLazy:
+            return LCWebImageDecodePolicyLazy;
+        default:
+            return LCWebImageDecodePolicyEager;
+    }
+}
+
+// Whether an image of the memory cache can be shown in the context, an eager context decodes the encoded ones first.
+static BOOL LCIsCachedImageShowable(UIImage *image, NSDictionary<NSString *, id> *context) {
+    return image.lc_encodedData == nil || LCDecodePolicyFromContext(context) != LCWebImageDecodePolicyEager;
+}
+
+// The memory cache key of an image decoded for a target, the identifier itself for a full size image.
+static NSString * LCMemoryCacheKey(NSString *identifier, CGSize pixelSize, UIViewContentMode contentMode) {
+    if (pixelSize.width <= 0 || pixelSize.height <= 0) {
+        return identifier;
+    }
+    return [NSString stringWithFormat:@"%@#%.0fx%.0f-%@", identifier, pixelSize.width, pixelSize.height, contentMode == UIViewContentModeScaleAspectFit ? @"fit" : @"fill"];
+}
+
+static NSDate * LCExpirationDateFromCacheControl(NSString *cacheControl, NSTimeInterval age) {
+    if (cacheControl.length == 0) {
+        return nil;
+    }
+    NSTimeInterval maxAge = -1;
+    for (NSString *component in [cacheControl.lowercaseString componentsSeparatedByString:@","]) {
+        NSString *directive = [component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([directive isEqualToString:@"no-cache"] || [directive isEqualToString:@"no-store"]) {
+            // must be revalidated before every use
+            return [NSDate date];
+        }
+        if ([directive hasPrefix:@"max-age="]) {
+            maxAge = [[directive substringFromIndex:8] doubleValue];
+        }
+    }
+    if (maxAge < 0) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSinceNow:MAX(0, maxAge - age)];
+}
 
 @interface LCImageDownloaderResponseHandler : NSObject
 @property (nonatomic, strong) NSUUID *uuid;
 @property (nonatomic, copy) void (^successBlock)(NSURLRequest *, NSHTTPURLResponse *, UIImage *);
 @property (nonatomic, copy) void (^failureBlock)(NSURLRequest *, NSHTTPURLResponse *, NSError *);
+@property (nonatomic, copy) void (^headerBlock)(NSURLRequest *, LCImageHeader *);
 @end
 
 @implementation LCImageDownloaderResponseHandler
@@ -33,28 +171,174 @@
 
 @end
 
+// A URL that failed recently, with the error its requests fail with until it expires.
+@interface LCImageFailedURL : NSObject
+@property (nonatomic, strong) NSError *error;
+@property (nonatomic, strong) NSHTTPURLResponse *response;
+@property (nonatomic, assign) CFTimeInterval expirationTime;
+@end
+
+@implementation LCImageFailedURL
+@end
+
+// An image kept encoded in the memory cache, to decode once the main run loop is idle.
+@interface LCImageIdleDecode : NSObject
+@property (nonatomic, strong) UIImage *encodedImage;
+@property (nonatomic, copy) NSString *URLIdentifier;
+@property (nonatomic, assign) CGSize pixelSize;
+@property (nonatomic, assign) UIViewContentMode contentMode;
+@property (nonatomic, assign) BOOL usesDiskMetadata;
+// The decoded byte count, read from the header off the main thread.
+@property (nonatomic, assign) NSUInteger cost;
+@end
+
+@implementation LCImageIdleDecode
+@end
+
+// An image decoded for a target and kept in the memory cache, it serves smaller targets too.
+@interface LCImageDecodedVariant : NSObject
+@property (nonatomic, copy) NSString *memoryCacheKey;
+// Zero for a full size image.
+@property (nonatomic, assign) CGSize pixelSize;
+@property (nonatomic, assign) UIViewContentMode contentMode;
+@end
+
+@implementation LCImageDecodedVariant
+
+// A full size image serves any target. An image covering a larger target covers, and fits in, a smaller one, an image fitting in a larger target only serves the fit of a smaller one.
+- (BOOL)servesPixelSize:(CGSize)pixelSize contentMode:(UIViewContentMode)contentMode {
+    if (self.pixelSize.width <= 0 || self.pixelSize.height <= 0) {
+        return YES;
+    }
+    if (self.pixelSize.width < pixelSize.width || self.pixelSize.height < pixelSize.height) {
+        return NO;
+    }
+    return self.contentMode == UIViewContentModeScaleAspectFill || contentMode == UIViewContentModeScaleAspectFit;
+}
+
+@end
+
+// The recent times to first byte of a host, and the delay after which its downloads are hedged.
+@interface LCHostLatency : NSObject
+@property (nonatomic, strong) LCWebImageMetricsAggregator *aggregator;
+@property (atomic, assign) NSUInteger sampleCount;
+// The p95 time to first byte, 0 until there are enough samples.
+@property (atomic, assign) NSTimeInterval hedgeDelay;
+@end
+
+@implementation LCHostLatency
+
+- (instancetype)init {
+    if (self = [super init]) {
+        self.aggregator = [[LCWebImageMetricsAggregator alloc] initWithCapacity:kLCMaximumHedgingSampleCount];
+    }
+    return self;
+}
+
+- (void)addFirstByteDuration:(NSTimeInterval)duration {
+    LCWebImageLoadMetrics *sample = [[LCWebImageLoadMetrics alloc] init];
+    [sample setDuration:duration forStage:LCWebImageMetricsStageTimeToFirstByte];
+    [self.aggregator addMetrics:sample];
+    self.sampleCount += 1;
+    if (self.sampleCount >= kLCMinimumHedgingSampleCount) {
+        self.hedgeDelay = [self.aggregator durationAtPercentile:0.95 forStage:LCWebImageMetricsStageTimeToFirstByte];
+    }
+}
+
+@end
+
 @interface LCImageDownloaderMergedTask : NSObject
 @property (nonatomic, strong) NSString *URLIdentifier;
-@property (nonatomic, strong) NSUUID *identifier;
 @property (nonatomic, strong) NSURLSessionDataTask *task;
+// The request the task was created for, passed to the handlers.
+@property (nonatomic, strong) NSURLRequest *request;
+// Set when a disk load found the data stale and validates it with a download instead. The stale data is used if the download fails.
+@property (atomic, assign) BOOL revalidatesDiskData;
 @property (nonatomic, strong) NSMutableArray <LCImageDownloaderResponseHandler*> *responseHandlers;
+// Set once every handler has been removed, the pending work for the task should stop.
+@property (atomic, assign, getter=isCancelled) BOOL cancelled;
+// The highest priority of the handlers, used to schedule the decode.
+@property (nonatomic, assign) LCImageDecodePriority priority;
+// Whether the task holds one of the `maximumActiveDownloads` slots.
+@property (nonatomic, assign, getter=isStarted) BOOL started;
+// The union of the options of every handler that was added.
+@property (atomic, assign) LCWebImageOptions options;
+// The number of retries after transient failures.
+@property (nonatomic, assign) NSUInteger retryCount;
+// Whether the network task completed.
+@property (nonatomic, assign, getter=isFinished) BOOL finished;
+// The length of the partial disk data the task requests the rest of, 0 if the task downloads the whole image.
+@property (nonatomic, assign) long long resumeOffset;
+// The validators of the partial data, stored next to it if the download is interrupted again.
+@property (nonatomic, copy) NSDictionary<NSString *, id> *partialMetadata;
+// Whether the response continues the partial data.
+@property (nonatomic, assign, getter=isResumed) BOOL resumed;
+// The bytes received so far, only kept for resumable responses.
+@property (nonatomic, strong) NSMutableData *receivedData;
+// The timings of the load, nil if it is not sampled.
+@property (nonatomic, strong) LCWebImageLoadMetrics *metrics;
+// The number of stages that still have to finish before the metrics are reported.
+@property (nonatomic, assign) NSInteger pendingMetricsCount;
+// The identifier of the traced download interval.
+@property (nonatomic, assign) uint64_t traceID;
+// Set when the task keeps running into the disk cache without handlers.
+@property (nonatomic, assign, getter=isKeptAlive) BOOL keptAlive;
+// Set while the task is suspended without handlers, waiting to be requested again.
+@property (nonatomic, assign, getter=isPaused) BOOL paused;
+// Incremented on every pause, so that an expired grace period only cancels the pause it belongs to.
+@property (nonatomic, assign) NSUInteger pauseCount;
+// Whether the budgets were set by a first request.
+@property (nonatomic, assign) BOOL hasBudgets;
+// The largest budgets of the handlers, 0 for no limit. Read by the session blocks.
+@property (atomic, assign) long long maximumByteCount;
+@property (atomic, assign) double maximumPixelCount;
+// The first bytes of the response, until the header is read.
+@property (nonatomic, strong) NSMutableData *headerData;
+// Whether the header was read or given up on.
+@property (nonatomic, assign, getter=isHeaderProbed) BOOL headerProbed;
+// Whether a handler has a header block. Read by the session blocks.
+@property (atomic, assign) BOOL wantsHeader;
+// The header delivered to the handlers, nil until it is read.
+@property (atomic, strong) LCImageHeader *header;
+// Whether the decode target was set by a first request.
+@property (nonatomic, assign) BOOL hasDecodeTarget;
+// The size the image is decoded at, zero for the full size, and whether it fits in or covers it.
+@property (nonatomic, assign) CGSize decodePixelSize;
+@property (nonatomic, assign) UIViewContentMode decodeContentMode;
+// The most eager decode policy of the requests.
+@property (nonatomic, assign) LCWebImageDecodePolicy decodePolicy;
+// The error the task fails with once it is cancelled for exceeding its budgets.
+@property (atomic, strong) NSError *abortError;
+// The host time the task took its slot at.
+@property (atomic, assign) CFTimeInterval requestStartTime;
+// Whether the task received its response.
+@property (atomic, assign, getter=isFirstByteReceived) BOOL firstByteReceived;
+// The second request sent when the response is late, nil if the task is not hedged.
+@property (nonatomic, strong) NSURLSessionDataTask *hedgeTask;
+// Whether the hedge completed.
+@property (nonatomic, assign, getter=isHedgeFinished) BOOL hedgeFinished;
+// Set once the task or its hedge completes the merged task.
+@property (nonatomic, assign, getter=isCompletionClaimed) BOOL completionClaimed;
 
 @end
 
 @implementation LCImageDownloaderMergedTask
 
-- (instancetype)initWithURLIdentifier:(NSString *)URLIdentifier identifier:(NSUUID *)identifier task:(NSURLSessionDataTask *)task {
+- (instancetype)initWithURLIdentifier:(NSString *)URLIdentifier {
     if (self = [self init]) {
         self.URLIdentifier = URLIdentifier;
-        self.task = task;
-        self.identifier = identifier;
         self.responseHandlers = [[NSMutableArray alloc] init];
+        self.priority = LCImageDecodePriorityLow;
+        self.decodePolicy = LCWebImageDecodePolicyLazy;
     }
     return self;
 }
 
 - (void)addResponseHandler:(LCImageDownloaderResponseHandler *)handler {
     [self.responseHandlers addObject:handler];
+    if (handler.headerBlock) {
+        self.wantsHeader = YES;
+    }
 }
 
 - (void)removeResponseHandler:(LCImageDownloaderResponseHandler *)handler {
@@ -63,6 +347,109 @@
 
 @end
 
+@interface LCImageDeliveryWeakProxy : NSObject
+@property (nonatomic, weak) id target;
+@end
+
+@implementation LCImageDeliveryWeakProxy
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink {
+    [self.target performSelector:@selector(displayLinkDidFire:) withObject:displayLink];
+}
+
+@end
+
+/**
+ Batches the blocks delivering results to the main thread. All the blocks enqueued before a run loop turn are run by one main queue block, and once the time budget of a frame is used up the rest waits for the next display refresh.
+ */
+@interface LCImageDeliveryQueue : NSObject {
+    os_unfair_lock _lock;
+}
+@property (nonatomic, assign) NSTimeInterval timeBudget;
+@property (nonatomic, strong) NSMutableArray<dispatch_block_t> *pendingBlocks;
+@property (nonatomic, assign) BOOL flushScheduled;
+@property (nonatomic, strong) CADisplayLink *displayLink;
+@end
+
+@implementation LCImageDeliveryQueue
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        self.pendingBlocks = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_displayLink invalidate];
+}
+
+- (void)enqueueBlock:(dispatch_block_t)block {
+    os_unfair_lock_lock(&_lock);
+    [self.pendingBlocks addObject:block];
+    BOOL shouldSchedule = !self.flushScheduled;
+    self.flushScheduled = YES;
+    os_unfair_lock_unlock(&_lock);
+
+    if (shouldSchedule) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self flush];
+        });
+    }
+}
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink {
+    displayLink.paused = YES;
+    [self flush];
+}
+
+- (void)flush {
+    os_unfair_lock_lock(&_lock);
+    NSArray<dispatch_block_t> *blocks = self.pendingBlocks;
+    self.pendingBlocks = [[NSMutableArray alloc] init];
+    os_unfair_lock_unlock(&_lock);
+
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDelivery, nil, blocks.count);
+    CFTimeInterval startTime = CACurrentMediaTime();
+    NSUInteger index = 0;
+    while (index < blocks.count) {
+        blocks[index]();
+        index++;
+        if (self.timeBudget > 0 && CACurrentMediaTime() - startTime >= self.timeBudget) {
+            break;
+        }
+    }
+    LC_TRACE_END(LCWebImageTraceStageDelivery, traceID, index);
+
+    os_unfair_lock_lock(&_lock);
+    BOOL deferred = index < blocks.count;
+    if (deferred) {
+        [self.pendingBlocks insertObjects:[blocks subarrayWithRange:NSMakeRange(index, blocks.count - index)]
+                                atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, blocks.count - index)]];
+    }
+    BOOL hasPendingBlocks = self.pendingBlocks.count > 0;
+    self.flushScheduled = hasPendingBlocks;
+    os_unfair_lock_unlock(&_lock);
+
+    if (deferred) {
+        // the frame budget is used up, continue after the next display refresh
+        if (!self.displayLink) {
+            LCImageDeliveryWeakProxy *proxy = [[LCImageDeliveryWeakProxy alloc] init];
+            proxy.target = self;
+            self.displayLink = [CADisplayLink displayLinkWithTarget:proxy selector:@selector(displayLinkDidFire:)];
+            [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        }
+        self.displayLink.paused = NO;
+    } else if (hasPendingBlocks) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self flush];
+        });
+    }
+}
+
+@end
+
 @implementation LCImageDownloadReceipt
 
 - (instancetype)initWithReceiptID:(NSUUID *)receiptID url:(NSURL *)url task:(nullable NSURLSessionDataTask *)task {
@@ -76,16 +463,41 @@
 
 @end
 
-@interface LCWebImageManager ()
+@interface LCWebImageManager () {
+    // Guards `activeRequestCount`, `queuedMergedTasks`, `mergedTasks`, `failedURLs`, the hedging state, the idle decodes and `savedDownloadBytes`. Every event takes it once and only for bookkeeping.
+    os_unfair_lock _lock;
+    // Starts the idle decodes, added with the first one.
+    CFRunLoopObserverRef _idleDecodeObserver;
+}
+
+@property (nonatomic, strong) LCImageDeliveryQueue *deliveryQueue;
 
-@property (nonatomic, strong) dispatch_queue_t synchronizationQueue;
+// Disk reads and writes, decoding happens on `decodeScheduler`.
 @property (nonatomic, strong) dispatch_queue_t responseQueue;
 
+// Creates the data tasks, in the order of the requests, after reading the disk metadata they are sent with.
+@property (nonatomic, strong) dispatch_queue_t requestQueue;
+
 @property (nonatomic, assign) NSInteger maximumActiveDownloads;
 @property (nonatomic, assign) NSInteger activeRequestCount;
 
-@property (nonatomic, strong) NSMutableArray *queuedMergedTasks;
+@property (nonatomic, strong) NSMutableOrderedSet<LCImageDownloaderMergedTask *> *queuedMergedTasks;
 @property (nonatomic, strong) NSMutableDictionary *mergedTasks;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, LCImageFailedURL *> *failedURLs;
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, LCHostLatency *> *hostLatencies;
+// Sends the hedged requests, its connections are not the ones of `sessionManager`.
+@property (nonatomic, strong) AFHTTPSessionManager *hedgingSessionManager;
+@property (nonatomic, assign) NSUInteger hedgeableRequestCount;
+@property (nonatomic, assign) NSUInteger hedgedRequestCount;
+
+@property (nonatomic, assign, readwrite) int64_t savedDownloadBytes;
+
+@property (nonatomic, strong) NSMutableArray<LCImageIdleDecode *> *idleDecodes;
+@property (nonatomic, assign) NSUInteger activeIdleDecodeCount;
+
+// The sizes each image was decoded at into the memory cache, keyed by cache key.
+@property (nonatomic, strong) NSCache<NSString *, NSArray<LCImageDecodedVariant *> *> *decodedVariants;
 
 @end
 
@@ -144,21 +556,108 @@
         self.downloadPrioritization = downloadPrioritization;
         self.maximumActiveDownloads = maximumActiveDownloads;
         _imageCache = imageCache;
+        self.decodeScheduler = [LCImageDecodeScheduler sharedScheduler];
+        self.deliveryQueue = [[LCImageDeliveryQueue alloc] init];
+        self.deliveryQueue.timeBudget = 0.005;
+        self.keepAliveProgressThreshold = 0.8;
+        self.cancellationGracePeriod = 10;
+        self.resumableDownloadMinimumBytes = 1024 * 1024;
+        self.negativeCacheDurationForClientErrors = 300;
+        self.negativeCacheDurationForServerErrors = 30;
+        self.negativeCacheDurationForNetworkErrors = 5;
+        self.maximumRetryCount = 2;
+        self.retryBaseDelay = 0.5;
 
-        self.queuedMergedTasks = [[NSMutableArray alloc] init];
+        self.queuedMergedTasks = [[NSMutableOrderedSet alloc] init];
         self.mergedTasks = [[NSMutableDictionary alloc] init];
+        self.failedURLs = [[NSMutableDictionary alloc] init];
+        self.hostLatencies = [[NSMutableDictionary alloc] init];
+        self.idleDecodes = [[NSMutableArray alloc] init];
+        self.decodedVariants = [[NSCache alloc] init];
+        self.decodedVariants.countLimit = kLCMaximumDecodedVariantImageCount;
         self.activeRequestCount = 0;
+        _lock = OS_UNFAIR_LOCK_INIT;
 
-        NSString *name = [NSString stringWithFormat:@"com.lcwebimage.imagedownloader.synchronizationqueue-%@", [[NSUUID UUID] UUIDString]];
-        self.synchronizationQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
-
-        name = [NSString stringWithFormat:@"com.lcwebimage.imagedownloader.responsequeue-%@", [[NSUUID UUID] UUIDString]];
+        NSString *name = [NSString stringWithFormat:@"com.lcwebimage.imagedownloader.responsequeue-%@", [[NSUUID UUID] UUIDString]];
         self.responseQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_CONCURRENT);
+        name = [NSString stringWithFormat:@"com.lcwebimage.imagedownloader.requestqueue-%@", [[NSUUID UUID] UUIDString]];
+        self.requestQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
     }
 
     return self;
 }
 
+- (void)dealloc {
+    if (_idleDecodeObserver) {
+        CFRunLoopObserverInvalidate(_idleDecodeObserver);
+        CFRelease(_idleDecodeObserver);
+    }
+}
+
+- (NSTimeInterval)deliveryTimeBudget {
+    return self.deliveryQueue.timeBudget;
+}
+
+- (void)setDeliveryTimeBudget:(NSTimeInterval)deliveryTimeBudget {
+    self.deliveryQueue.timeBudget = deliveryTimeBudget;
+}
+
+- (void)setHedgingBudget:(double)hedgingBudget {
+    _hedgingBudget = hedgingBudget;
+    // created once here rather than by the first hedge, on the download path
+    if (hedgingBudget > 0 && self.hedgingSessionManager == nil) {
+        AFHTTPSessionManager *hedgingSessionManager = [[AFHTTPSessionManager alloc] initWithSessionConfiguration:self.sessionManager.session.configuration];
+        hedgingSessionManager.responseSerializer = self.sessionManager.responseSerializer;
+        self.hedgingSessionManager = hedgingSessionManager;
+    }
+}
+
+- (int64_t)savedDownloadBytes {
+    os_unfair_lock_lock(&_lock);
+    int64_t savedDownloadBytes = _savedDownloadBytes;
+    os_unfair_lock_unlock(&_lock);
+    return savedDownloadBytes;
+}
+
+- (void)setSessionManager:(AFHTTPSessionManager *)sessionManager {
+    _sessionManager = sessionManager;
+    __weak __typeof__(self) weakSelf = self;
+    [sessionManager setDataTaskWillCacheResponseBlock:^NSCachedURLResponse * _Nonnull(NSURLSession * _Nonnull session, NSURLSessionDataTask * _Nonnull dataTask, NSCachedURLResponse * _Nonnull proposedResponse) {
+        if (!weakSelf.shouldValidateDiskCache) {
+            return proposedResponse;
+        }
+        // the disk cache already keeps the bytes, don't store them a second time
+        return [[NSCachedURLResponse alloc] initWithResponse:proposedResponse.response
+                                                        data:proposedResponse.data
+                                                    userInfo:proposedResponse.userInfo
+                                               storagePolicy:NSURLCacheStorageNotAllowed];
+    }];
+    [sessionManager setDataTaskDidReceiveResponseBlock:^NSURLSessionResponseDisposition(NSURLSession * _Nonnull session, NSURLSessionDataTask * _Nonnull dataTask, NSURLResponse * _Nonnull response) {
+        LCImageDownloaderMergedTask *mergedTask = objc_getAssociatedObject(dataTask, &LCMergedTaskKey);
+        if (mergedTask) {
+            [weakSelf recordFirstByteOfMergedTask:mergedTask dataTask:dataTask];
+            if ([weakSelf mergedTask:mergedTask exceedsByteBudgetWithResponse:response]) {
+                return NSURLSessionResponseCancel;
+            }
+            [weakSelf mergedTask:mergedTask didReceiveResponse:response];
+        }
+        return NSURLSessionResponseAllow;
+    }];
+    [sessionManager setDataTaskDidReceiveDataBlock:^(NSURLSession * _Nonnull session, NSURLSessionDataTask * _Nonnull dataTask, NSData * _Nonnull data) {
+        LCImageDownloaderMergedTask *mergedTask = objc_getAssociatedObject(dataTask, &LCMergedTaskKey);
+        [mergedTask.receivedData appendData:data];
+        if ((mergedTask.maximumPixelCount > 0 || mergedTask.wantsHeader) && !mergedTask.isHeaderProbed) {
+            [weakSelf mergedTask:mergedTask probeHeaderWithData:data ofDataTask:dataTask];
+        }
+    }];
+    [sessionManager setTaskDidFinishCollectingMetricsBlock:^(NSURLSession * _Nonnull session, NSURLSessionTask * _Nonnull task, NSURLSessionTaskMetrics * _Nullable metrics) {
+        LCImageDownloaderMergedTask *mergedTask = objc_getAssociatedObject(task, &LCMergedTaskKey);
+        if (mergedTask.metrics && metrics) {
+            [mergedTask.metrics setNetworkDurationsWithTaskMetrics:metrics];
+        }
+    }];
+}
+
 + (instancetype)defaultInstance {
     static LCWebImageManager *sharedInstance = nil;
     static dispatch_once_t onceToken;
@@ -168,221 +667,1675 @@
     return sharedInstance;
 }
 
-- (LCImageDownloadReceipt *)diskImageForURL:(NSURL *)URL
-                              withReceiptID:(nonnull NSUUID *)receiptID
-                                 completion:(nullable void (^)(UIImage *image))completion {
-    dispatch_sync(self.synchronizationQueue, ^{
-        dispatch_async(self.responseQueue, ^{
-            NSData *imageData = [self.imageCache diskDataWithIdentifier:URL.absoluteString];
-            UIImage *image = [self.imageCache decodedImageFromData:imageData withIdentifier:URL.absoluteString];
-            [self.imageCache addMemoryImage:image withIdentifier:URL.absoluteString];
-            dispatch_async(dispatch_get_main_queue(), ^{
-                if (completion) {
-                    completion(image);
-                }
-            });
-        });
-    });
-    return [[LCImageDownloadReceipt alloc] initWithReceiptID:receiptID url:URL task:nil];
-    
-}
-- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
-                                                        options:(LCWebImageOptions)options
-                                                        success:(void (^)(NSURLRequest * _Nonnull, NSHTTPURLResponse * _Nullable, UIImage * _Nonnull))success
-                                                        failure:(void (^)(NSURLRequest * _Nonnull, NSHTTPURLResponse * _Nullable, NSError * _Nonnull))failure {
-    return [self downloadImageForURLRequest:request withReceiptID:[NSUUID UUID] options:options success:success failure:failure];
++ (LCWebImageCacheKeyFilter)cacheKeyFilterRemovingQueryItemNames:(NSArray<NSString *> *)names {
+    NSSet<NSString *> *removedNames = [NSSet setWithArray:names];
+    NSCharacterSet *separators = [NSCharacterSet characterSetWithCharactersInString:@"&?"];
+    return ^NSString *(NSURL *URL) {
+        NSURLComponents *components = [NSURLComponents componentsWithURL:URL resolvingAgainstBaseURL:NO];
+        NSString *query = components.percentEncodedQuery;
+        if (query.length == 0) {
+            return URL.absoluteString;
+        }
+        NSMutableArray<NSString *> *queryItems = [NSMutableArray array];
+        for (NSString *queryItem in [query componentsSeparatedByCharactersInSet:separators]) {
+            if (queryItem.length == 0) {
+                continue;
+            }
+            NSString *name = [queryItem componentsSeparatedByString:@"="].firstObject;
+            if ([removedNames containsObject:name.stringByRemovingPercentEncoding ?: name]) {
+                continue;
+            }
+            [queryItems addObject:queryItem];
+        }
+        [queryItems sortUsingSelector:@selector(compare:)];
+        components.percentEncodedQuery = queryItems.count > 0 ? [queryItems componentsJoinedByString:@"&"] : nil;
+        return components.string ?: URL.absoluteString;
+    };
 }
 
-- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
-                                                  withReceiptID:(nonnull NSUUID *)receiptID
-                                                        options:(LCWebImageOptions)options
-                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
-                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
-    __block NSURLSessionDataTask *task = nil;
-    dispatch_sync(self.synchronizationQueue, ^{
-        NSString *URLIdentifier = request.URL.absoluteString;
-        if (URLIdentifier == nil) {
-            if (failure) {
-                NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadURL userInfo:nil];
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    failure(request, nil, error);
-                });
++ (LCWebImageURLTransformer)URLTransformerSettingQueryItemName:(NSString *)name toWidthBuckets:(NSArray<NSNumber *> *)buckets {
+    NSArray<NSNumber *> *sortedBuckets = [buckets sortedArrayUsingSelector:@selector(compare:)];
+    return ^NSURL *(NSURL *URL, NSDictionary<NSString *, id> *context) {
+        CGFloat width = [context[LCWebImageContextTargetPixelSizeKey] CGSizeValue].width;
+        if (width <= 0 || sortedBuckets.count == 0) {
+            return nil;
+        }
+        NSNumber *bucket = sortedBuckets.lastObject;
+        for (NSNumber *candidate in sortedBuckets) {
+            if (candidate.doubleValue >= width) {
+                bucket = candidate;
+                break;
             }
-            return;
         }
-    
-        // 1) Append the success and failure blocks to a pre-existing request if it already exists
-        LCImageDownloaderMergedTask *existingMergedTask = self.mergedTasks[URLIdentifier];
-        if (existingMergedTask != nil) {
-            LCImageDownloaderResponseHandler *handler = [[LCImageDownloaderResponseHandler alloc] initWithUUID:receiptID success:success failure:failure];
-            [existingMergedTask addResponseHandler:handler];
-            task = existingMergedTask.task;
-            return;
+        NSURLComponents *components = [NSURLComponents componentsWithURL:URL resolvingAgainstBaseURL:NO];
+        NSMutableArray<NSURLQueryItem *> *queryItems = [NSMutableArray array];
+        for (NSURLQueryItem *queryItem in components.queryItems) {
+            if (![queryItem.name isEqualToString:name]) {
+                [queryItems addObject:queryItem];
+            }
         }
+        [queryItems addObject:[NSURLQueryItem queryItemWithName:name value:bucket.stringValue]];
+        components.queryItems = queryItems;
+        return components.URL;
+    };
+}
 
-        // 2) Attempt to load the image from the image cache if the cache policy allows it
-        switch (request.cachePolicy) {
-            case NSURLRequestUseProtocolCachePolicy:
-            case NSURLRequestReturnCacheDataElseLoad:
-            case NSURLRequestReturnCacheDataDontLoad: {
-                UIImage *cachedImage = [self.imageCache memoryImageWithIdentifier:URLIdentifier];
-                if (cachedImage != nil) {
-                    if (success) {
-                        dispatch_async(dispatch_get_main_queue(), ^{
-                            success(request, nil, cachedImage);
-                        });
-                    }
-                    return;
-                }
-                break;
-            }
-            default:
-                break;
+- (NSURLRequest *)transformedRequestForRequest:(NSURLRequest *)request context:(NSDictionary<NSString *, id> *)context {
+    LCWebImageURLTransformer URLTransformer = self.URLTransformer;
+    if (request.URL == nil || context == nil || (URLTransformer == nil && !self.shouldSendClientHints)) {
+        return request;
+    }
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    NSURL *URL = URLTransformer ? URLTransformer(request.URL, context) : nil;
+    if (URL) {
+        mutableRequest.URL = URL;
+    }
+    CGSize targetPixelSize = [context[LCWebImageContextTargetPixelSizeKey] CGSizeValue];
+    if (self.shouldSendClientHints && targetPixelSize.width > 0) {
+        [mutableRequest setValue:[NSString stringWithFormat:@"%.0f", ceil(targetPixelSize.width)] forHTTPHeaderField:@"Width"];
+        NSNumber *scale = context[LCWebImageContextScreenScaleKey];
+        if (scale) {
+            [mutableRequest setValue:[NSString stringWithFormat:@"%g", scale.doubleValue] forHTTPHeaderField:@"DPR"];
         }
+    }
+    return mutableRequest;
+}
 
-        // 3) Create the request and set up authentication, validation and response serialization
-        NSUUID *mergedTaskIdentifier = [NSUUID UUID];
-        NSURLSessionDataTask *createdTask;
-        __weak __typeof__(self) weakSelf = self;
-        createdTask = [self.sessionManager
-                       dataTaskWithRequest:request
-                       uploadProgress:nil
-                       downloadProgress:nil
-                       completionHandler:^(NSURLResponse * _Nonnull response, id  _Nullable responseObject, NSError * _Nullable error) {
-            dispatch_async(self.responseQueue, ^{
-                __strong __typeof__(weakSelf) strongSelf = weakSelf;
-                LCImageDownloaderMergedTask *mergedTask = [strongSelf safelyGetMergedTask:URLIdentifier];
-                if ([mergedTask.identifier isEqual:mergedTaskIdentifier]) {
-                    mergedTask = [strongSelf safelyRemoveMergedTaskWithURLIdentifier:URLIdentifier];
-                    if (error) {
-                        for (LCImageDownloaderResponseHandler *handler in mergedTask.responseHandlers) {
-                            if (handler.failureBlock) {
-                                dispatch_async(dispatch_get_main_queue(), ^{
-                                    handler.failureBlock(request, (NSHTTPURLResponse *)response, error);
-                                });
-                            }
-                        }
-                    } else {
-                        UIImage *image = [strongSelf.imageCache decodedImageFromData:responseObject withIdentifier:URLIdentifier];
-                        [strongSelf.imageCache addMemoryImage:image withIdentifier:URLIdentifier];
-                        if (!(options & LCWebImageOptionIgnoreDiskCache)) {
-                            [strongSelf.imageCache addDiskData:responseObject withIdentifier:URLIdentifier];
-                        }
-                        for (LCImageDownloaderResponseHandler *handler in mergedTask.responseHandlers) {
-                            if (handler.successBlock) {
-                                dispatch_async(dispatch_get_main_queue(), ^{
-                                    handler.successBlock(request, (NSHTTPURLResponse *)response, image);
-                                });
-                            }
-                        }
-                    }
-                }
-                [strongSelf safelyDecrementActiveTaskCount];
-                [strongSelf safelyStartNextTaskIfNecessary];
-            });
-        }];
+- (NSString *)cacheKeyForURL:(NSURL *)URL {
+    if (URL == nil) {
+        return nil;
+    }
+    LCWebImageCacheKeyFilter cacheKeyFilter = self.cacheKeyFilter;
+    NSString *cacheKey = cacheKeyFilter ? cacheKeyFilter(URL) : nil;
+    return cacheKey ?: URL.absoluteString;
+}
 
-        // 4) Store the response handler for use when the request completes
-        LCImageDownloaderResponseHandler *handler = [[LCImageDownloaderResponseHandler alloc] initWithUUID:receiptID
-                                                                                                   success:success
-                                                                                                   failure:failure];
-        LCImageDownloaderMergedTask *mergedTask = [[LCImageDownloaderMergedTask alloc]
-                                                   initWithURLIdentifier:URLIdentifier
-                                                   identifier:mergedTaskIdentifier
-                                                   task:createdTask];
-        [mergedTask addResponseHandler:handler];
-        self.mergedTasks[URLIdentifier] = mergedTask;
+- (NSString *)cacheKeyForURL:(NSURL *)URL context:(NSDictionary<NSString *, id> *)context {
+    NSString *cacheKey = [self cacheKeyForURL:URL];
+    CGSize pixelSize = CGSizeZero;
+    UIViewContentMode contentMode = UIViewContentModeScaleAspectFill;
+    if (cacheKey == nil || !LCDecodeTargetFromContext(context, &pixelSize, &contentMode)) {
+        return cacheKey;
+    }
+    return LCMemoryCacheKey(cacheKey, pixelSize, contentMode);
+}
 
-        // 5) Either start the request or enqueue it depending on the current active request count
-        if ([self isActiveRequestCountBelowMaximumLimit]) {
-            [self startMergedTask:mergedTask];
+- (UIImage *)memoryImageForURL:(NSURL *)URL context:(NSDictionary<NSString *, id> *)context {
+    NSString *cacheKey = [self cacheKeyForURL:URL];
+    if (cacheKey == nil) {
+        return nil;
+    }
+    UIImage *image = [self memoryImageWithIdentifier:cacheKey context:context];
+    return LCIsCachedImageShowable(image, context) ? image : nil;
+}
+
+// The image decoded for the target of the context, or for a larger one.
+- (nullable UIImage *)memoryImageWithIdentifier:(NSString *)URLIdentifier context:(nullable NSDictionary<NSString *, id> *)context {
+    CGSize pixelSize = CGSizeZero;
+    UIViewContentMode contentMode = UIViewContentModeScaleAspectFill;
+    BOOL hasTarget = LCDecodeTargetFromContext(context, &pixelSize, &contentMode);
+    UIImage *image = [self.imageCache memoryImageWithIdentifier:LCMemoryCacheKey(URLIdentifier, pixelSize, contentMode)];
+    if (image || !hasTarget) {
+        return image;
+    }
+    os_unfair_lock_lock(&_lock);
+    NSArray<LCImageDecodedVariant *> *variants = [self.decodedVariants objectForKey:URLIdentifier];
+    os_unfair_lock_unlock(&_lock);
+    NSMutableArray<LCImageDecodedVariant *> *purgedVariants = [NSMutableArray array];
+    for (LCImageDecodedVariant *variant in variants) {
+        if (![variant servesPixelSize:pixelSize contentMode:contentMode]) {
+            continue;
+        }
+        image = [self.imageCache memoryImageWithIdentifier:variant.memoryCacheKey];
+        if (image) {
+            break;
+        }
+        [purgedVariants addObject:variant];
+    }
+    if (purgedVariants.count > 0) {
+        os_unfair_lock_lock(&_lock);
+        NSMutableArray<LCImageDecodedVariant *> *remainingVariants = [[self.decodedVariants objectForKey:URLIdentifier] mutableCopy];
+        [remainingVariants removeObjectsInArray:purgedVariants];
+        if (remainingVariants.count > 0) {
+            [self.decodedVariants setObject:remainingVariants forKey:URLIdentifier];
         } else {
-            [self enqueueMergedTask:mergedTask];
+            [self.decodedVariants removeObjectForKey:URLIdentifier];
         }
-
-        task = mergedTask.task;
-    });
-    if (task) {
-        return [[LCImageDownloadReceipt alloc] initWithReceiptID:receiptID url:request.URL task:task];
-    } else {
-        return nil;
+        os_unfair_lock_unlock(&_lock);
     }
+    return image;
 }
 
-- (void)cancelTaskForImageDownloadReceipt:(LCImageDownloadReceipt *)imageDownloadReceipt {
-    if (!imageDownloadReceipt.task) {
+// Stores the image decoded for the target, and remembers its size so that smaller targets find it.
+- (void)addMemoryImage:(UIImage *)image identifier:(NSString *)URLIdentifier pixelSize:(CGSize)pixelSize contentMode:(UIViewContentMode)contentMode {
+    if (!image) {
         return;
     }
-    dispatch_sync(self.synchronizationQueue, ^{
-        NSString *URLIdentifier = imageDownloadReceipt.task.originalRequest.URL.absoluteString;
-        LCImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
-        NSUInteger index = [mergedTask.responseHandlers indexOfObjectPassingTest:^BOOL(LCImageDownloaderResponseHandler * _Nonnull handler, __unused NSUInteger idx, __unused BOOL * _Nonnull stop) {
-            return handler.uuid == imageDownloadReceipt.receiptID;
-        }];
+    NSString *memoryCacheKey = LCMemoryCacheKey(URLIdentifier, pixelSize, contentMode);
+    [self.imageCache addMemoryImage:image withIdentifier:memoryCacheKey];
+    os_unfair_lock_lock(&_lock);
+    NSArray<LCImageDecodedVariant *> *variants = [self.decodedVariants objectForKey:URLIdentifier] ?: @[];
+    NSUInteger index = [variants indexOfObjectPassingTest:^BOOL(LCImageDecodedVariant * _Nonnull variant, __unused NSUInteger idx, __unused BOOL * _Nonnull stop) {
+        return [variant.memoryCacheKey isEqualToString:memoryCacheKey];
+    }];
+    if (index == NSNotFound) {
+        LCImageDecodedVariant *variant = [[LCImageDecodedVariant alloc] init];
+        variant.memoryCacheKey = memoryCacheKey;
+        variant.pixelSize = pixelSize;
+        variant.contentMode = contentMode;
+        [self.decodedVariants setObject:[variants arrayByAddingObject:variant] forKey:URLIdentifier];
+    }
+    os_unfair_lock_unlock(&_lock);
+}
 
-        if (index != NSNotFound) {
-            LCImageDownloaderResponseHandler *handler = mergedTask.responseHandlers[index];
-            [mergedTask removeResponseHandler:handler];
-            NSString *failureReason = [NSString stringWithFormat:@"ImageDownloader cancelled URL request: %@",imageDownloadReceipt.task.originalRequest.URL.absoluteString];
-            NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey:failureReason};
-            NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:userInfo];
-            if (handler.failureBlock) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    handler.failureBlock(imageDownloadReceipt.task.originalRequest, nil, error);
-                });
-            }
-        }
+- (LCImageHeader *)diskImageHeaderForURL:(NSURL *)URL {
+    NSString *cacheKey = [self cacheKeyForURL:URL];
+    if (cacheKey == nil) {
+        return nil;
+    }
+    return [self diskImageHeaderWithIdentifier:cacheKey];
+}
 
-        if (mergedTask.responseHandlers.count == 0) {
-            [mergedTask.task cancel];
-            [self removeMergedTaskWithURLIdentifier:URLIdentifier];
-        }
-    });
+- (nullable LCImageHeader *)diskImageHeaderWithIdentifier:(NSString *)identifier {
+    NSDictionary<NSString *, id> *header = [self diskMetadataWithIdentifier:identifier][LCImageDiskMetadataHeaderKey];
+    return [header isKindOfClass:[NSDictionary class]] ? [[LCImageHeader alloc] initWithDictionary:header] : nil;
 }
 
-- (LCImageDownloaderMergedTask *)safelyRemoveMergedTaskWithURLIdentifier:(NSString *)URLIdentifier {
-    __block LCImageDownloaderMergedTask *mergedTask = nil;
-    dispatch_sync(self.synchronizationQueue, ^{
-        mergedTask = [self removeMergedTaskWithURLIdentifier:URLIdentifier];
-    });
-    return mergedTask;
+- (LCImageDownloadReceipt *)diskImageForURL:(NSURL *)URL
+                              withReceiptID:(nonnull NSUUID *)receiptID
+                                 completion:(nullable void (^)(UIImage *image))completion {
+    return [self diskImageForURL:URL withReceiptID:receiptID context:nil completion:completion];
 }
 
-//This method should only be called from safely within the synchronizationQueue
-- (LCImageDownloaderMergedTask *)removeMergedTaskWithURLIdentifier:(NSString *)URLIdentifier {
-    LCImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
-    [self.mergedTasks removeObjectForKey:URLIdentifier];
-    return mergedTask;
+- (LCImageDownloadReceipt *)diskImageForURL:(NSURL *)URL
+                              withReceiptID:(nonnull NSUUID *)receiptID
+                                    context:(nullable NSDictionary<NSString *, id> *)context
+                                 completion:(nullable void (^)(UIImage *image))completion {
+    // stale data is found and revalidated on the response queue, see `loadImageForRequest:`
+    return [self loadDiskImageForURL:URL withReceiptID:receiptID options:0 context:context completion:completion];
 }
 
-- (void)safelyDecrementActiveTaskCount {
-    dispatch_sync(self.synchronizationQueue, ^{
-        if (self.activeRequestCount > 0) {
-            self.activeRequestCount -= 1;
+- (LCImageDownloadReceipt *)loadDiskImageForURL:(NSURL *)URL
+                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                        options:(LCWebImageOptions)options
+                                        context:(nullable NSDictionary<NSString *, id> *)context
+                                     completion:(nullable void (^)(UIImage *image))completion {
+    LCImageDownloaderResponseHandler *handler = [[LCImageDownloaderResponseHandler alloc] initWithUUID:receiptID success:^(NSURLRequest *request, NSHTTPURLResponse *response, UIImage *responseObject) {
+        if (completion) {
+            completion(responseObject);
         }
-    });
+    } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error) {
+        // the load may have joined a download that failed, the completion is always called
+        if (completion) {
+            completion(nil);
+        }
+    }];
+    // an image the memory cache keeps encoded needs no disk read
+    NSString *URLIdentifier = [self cacheKeyForURL:URL];
+    UIImage *encodedImage = URLIdentifier ? [self memoryImageWithIdentifier:URLIdentifier context:context] : nil;
+    return [self loadImageForRequest:[NSURLRequest requestWithURL:URL] encodedData:encodedImage.lc_encodedData responseHandler:handler options:options context:context];
 }
 
-- (void)safelyStartNextTaskIfNecessary {
-    dispatch_sync(self.synchronizationQueue, ^{
-        if ([self isActiveRequestCountBelowMaximumLimit]) {
-            while (self.queuedMergedTasks.count > 0) {
-                LCImageDownloaderMergedTask *mergedTask = [self dequeueMergedTask];
-                if (mergedTask.task.state == NSURLSessionTaskStateSuspended) {
-                    [self startMergedTask:mergedTask];
-                    break;
+// Decodes the encoded data, or the disk data if it is nil, merged with the loads of the same image.
+- (LCImageDownloadReceipt *)loadImageForRequest:(NSURLRequest *)request
+                                    encodedData:(nullable NSData *)encodedData
+                                responseHandler:(LCImageDownloaderResponseHandler *)handler
+                                        options:(LCWebImageOptions)options
+                                        context:(nullable NSDictionary<NSString *, id> *)context {
+    NSURL *URL = request.URL;
+    NSString *URLIdentifier = [self cacheKeyForURL:URL];
+    BOOL shouldLoad = NO;
+    BOOL shouldResumeTask = NO;
+    LCImageHeader *header = nil;
+    os_unfair_lock_lock(&_lock);
+    // Append the handler to a disk load or download of the same image if it already exists
+    LCImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
+    if (mergedTask == nil) {
+        mergedTask = [[LCImageDownloaderMergedTask alloc] initWithURLIdentifier:URLIdentifier];
+        mergedTask.metrics = [self sampledMetricsForURL:URL cacheTier:encodedData ? LCImageCacheTierMemory : LCImageCacheTierDisk];
+        [self raiseBudgetsOfMergedTask:mergedTask context:nil];
+        self.mergedTasks[URLIdentifier] = mergedTask;
+        shouldLoad = YES;
+    }
+    [mergedTask addResponseHandler:handler];
+    header = mergedTask.header;
+    [self raisePriorityOfMergedTask:mergedTask options:options];
+    [self raiseDecodeTargetOfMergedTask:mergedTask context:context];
+    shouldResumeTask = [self reviveMergedTask:mergedTask];
+    os_unfair_lock_unlock(&_lock);
+
+    if (shouldResumeTask) {
+        [mergedTask.task resume];
+    }
+    if (header && handler.headerBlock) {
+        [self.deliveryQueue enqueueBlock:^{
+            handler.headerBlock(request, header);
+        }];
+    }
+
+    if (shouldLoad) {
+        void (^finish)(UIImage *) = ^(UIImage *image) {
+            NSArray<LCImageDownloaderResponseHandler *> *responseHandlers = [self removeMergedTask:mergedTask];
+            [self deliverImage:image error:nil toResponseHandlers:responseHandlers ofMergedTask:mergedTask request:request response:nil];
+        };
+        mergedTask.pendingMetricsCount = 1;
+        dispatch_async(self.responseQueue, ^{
+            if (mergedTask.isCancelled) {
+                finish(nil);
+                return;
+            }
+            if (encodedData) {
+                if (mergedTask.wantsHeader) {
+                    [self deliverHeader:LCImageProbeHeader(encodedData) ofMergedTask:mergedTask request:request];
                 }
+                [self decodeImageData:encodedData forMergedTask:mergedTask usesDiskMetadata:NO completion:finish];
+                return;
             }
-        }
-    });
+            if ([self shouldRevalidateDiskDataWithIdentifier:URLIdentifier options:options]) {
+                [self revalidateDiskDataOfMergedTask:mergedTask request:request options:options];
+                return;
+            }
+            if (mergedTask.wantsHeader) {
+                [self deliverHeader:[self diskImageHeaderWithIdentifier:URLIdentifier] ofMergedTask:mergedTask request:request];
+            }
+            CFTimeInterval readStartTime = CACurrentMediaTime();
+            NSData *imageData = [self.imageCache diskDataWithIdentifier:URLIdentifier];
+            [mergedTask.metrics setDuration:CACurrentMediaTime() - readStartTime forStage:LCWebImageMetricsStageDiskRead];
+            if (mergedTask.wantsHeader && mergedTask.header == nil) {
+                // the data was stored without its header, it is stored for the next loads
+                LCImageHeader *header = LCImageProbeHeader(imageData);
+                [self addHeaderDiskMetadata:header identifier:URLIdentifier];
+                [self deliverHeader:header ofMergedTask:mergedTask request:request];
+            }
+            [self decodeImageData:imageData forMergedTask:mergedTask usesDiskMetadata:YES completion:finish];
+        });
+    }
+    return [[LCImageDownloadReceipt alloc] initWithReceiptID:handler.uuid url:URL task:nil];
 }
 
-- (void)startMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
-    [mergedTask.task resume];
-    ++self.activeRequestCount;
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                        options:(LCWebImageOptions)options
+                                                        success:(void (^)(NSURLRequest * _Nonnull, NSHTTPURLResponse * _Nullable, UIImage * _Nonnull))success
+                                                        failure:(void (^)(NSURLRequest * _Nonnull, NSHTTPURLResponse * _Nullable, NSError * _Nonnull))failure {
+    return [self downloadImageForURLRequest:request withReceiptID:[NSUUID UUID] options:options success:success failure:failure];
 }
 
-- (void)enqueueMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                        options:(LCWebImageOptions)options
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    return [self downloadImageForURLRequest:request withReceiptID:receiptID options:options context:nil success:success failure:failure];
+}
+
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                        options:(LCWebImageOptions)options
+                                                        context:(nullable NSDictionary<NSString *, id> *)context
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    return [self downloadImageForURLRequest:request withReceiptID:receiptID options:options context:context header:nil success:success failure:failure];
+}
+
+- (nullable LCImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                        options:(LCWebImageOptions)options
+                                                        context:(nullable NSDictionary<NSString *, id> *)context
+                                                         header:(nullable void (^)(NSURLRequest *request, LCImageHeader *header))header
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    NSString *URLIdentifier = [self cacheKeyForURL:request.URL];
+    if (URLIdentifier == nil) {
+        if (failure) {
+            NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadURL userInfo:nil];
+            [self.deliveryQueue enqueueBlock:^{
+                failure(request, nil, error);
+            }];
+        }
+        return nil;
+    }
+
+    // 1) Attempt to load the image from the image cache if the cache policy allows it
+    switch (request.cachePolicy) {
+        case NSURLRequestUseProtocolCachePolicy:
+        case NSURLRequestReturnCacheDataElseLoad:
+        case NSURLRequestReturnCacheDataDontLoad: {
+            UIImage *cachedImage = [self memoryImageWithIdentifier:URLIdentifier context:context];
+            if (!LCIsCachedImageShowable(cachedImage, context)) {
+                // decoded off the main thread rather than by Core Animation when it is displayed
+                LCImageDownloaderResponseHandler *handler = [[LCImageDownloaderResponseHandler alloc] initWithUUID:receiptID success:success failure:failure];
+                handler.headerBlock = header;
+                return [self loadImageForRequest:request encodedData:cachedImage.lc_encodedData responseHandler:handler options:options context:context];
+            }
+            if (cachedImage != nil) {
+                if (success) {
+                    [self.deliveryQueue enqueueBlock:^{
+                        success(request, nil, cachedImage);
+                    }];
+                }
+                LCWebImageLoadMetrics *metrics = [self sampledMetricsForURL:request.URL cacheTier:LCImageCacheTierMemory];
+                if (metrics) {
+                    [self.deliveryQueue enqueueBlock:^{
+                        NSTimeInterval duration = CACurrentMediaTime() - metrics.startTime;
+                        [metrics setDuration:duration forStage:LCWebImageMetricsStageDelivery];
+                        [metrics setDuration:duration forStage:LCWebImageMetricsStageTotal];
+                        metrics.successful = YES;
+                        [self reportMetrics:metrics];
+                    }];
+                }
+                return nil;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    LCImageDownloaderResponseHandler *handler = [[LCImageDownloaderResponseHandler alloc] initWithUUID:receiptID
+                                                                                               success:success
+                                                                                               failure:failure];
+    handler.headerBlock = header;
+    NSURLSessionDataTask *task = nil;
+    BOOL shouldStartTask = NO;
+    BOOL shouldCreateTask = NO;
+    LCImageHeader *knownHeader = nil;
+    os_unfair_lock_lock(&_lock);
+    // 2) Fail right away if the URL is known to be broken
+    LCImageFailedURL *failedURL = [self failedURLWithIdentifier:URLIdentifier options:options];
+    if (failedURL != nil) {
+        os_unfair_lock_unlock(&_lock);
+        if (failure) {
+            [self.deliveryQueue enqueueBlock:^{
+                failure(request, failedURL.response, failedURL.error);
+            }];
+        }
+        return nil;
+    }
+    // 3) Append the success and failure blocks to a pre-existing request if it already exists
+    LCImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
+    if (mergedTask != nil) {
+        [mergedTask addResponseHandler:handler];
+        knownHeader = mergedTask.header;
+        [self raisePriorityOfMergedTask:mergedTask options:options];
+        [self raiseBudgetsOfMergedTask:mergedTask context:context];
+        [self raiseDecodeTargetOfMergedTask:mergedTask context:context];
+        shouldStartTask = [self reviveMergedTask:mergedTask];
+    } else {
+        // 4) Store the response handler for use when the request completes, the data task is created on the request queue
+        mergedTask = [[LCImageDownloaderMergedTask alloc] initWithURLIdentifier:URLIdentifier];
+        mergedTask.metrics = [self sampledMetricsForURL:request.URL cacheTier:LCImageCacheTierNetwork];
+        mergedTask.request = request;
+        [self raiseBudgetsOfMergedTask:mergedTask context:context];
+        [self raiseDecodeTargetOfMergedTask:mergedTask context:context];
+        [mergedTask addResponseHandler:handler];
+        [self raisePriorityOfMergedTask:mergedTask options:options];
+        self.mergedTasks[URLIdentifier] = mergedTask;
+        shouldCreateTask = YES;
+    }
+    task = mergedTask.task;
+    os_unfair_lock_unlock(&_lock);
+
+    if (shouldStartTask) {
+        [task resume];
+    }
+    if (knownHeader && header) {
+        [self.deliveryQueue enqueueBlock:^{
+            header(request, knownHeader);
+        }];
+    }
+    // the task is nil when the handler was appended to a disk cache load, or until it is created
+    LCImageDownloadReceipt *receipt = [[LCImageDownloadReceipt alloc] initWithReceiptID:receiptID url:request.URL task:task];
+    if (shouldCreateTask) {
+        // 5) Create the data task and either start it or enqueue it depending on the current active request count
+        [self sendMergedTask:mergedTask request:request options:options receipt:receipt];
+    }
+    return receipt;
+}
+
+// Creates the data task of a new merged task on the request queue, and starts or enqueues it.
+- (void)sendMergedTask:(LCImageDownloaderMergedTask *)mergedTask
+               request:(NSURLRequest *)request
+               options:(LCWebImageOptions)options
+               receipt:(nullable LCImageDownloadReceipt *)receipt {
+    dispatch_async(self.requestQueue, ^{
+        if (mergedTask.isCancelled) {
+            return;
+        }
+        // the disk metadata is read off the caller thread, and only for the download that is sent
+        NSDictionary<NSString *, id> *partialMetadata = nil;
+        NSURLRequest *taskRequest = [self taskRequestForRequest:request identifier:mergedTask.URLIdentifier options:options partialMetadata:&partialMetadata];
+        os_unfair_lock_lock(&self->_lock);
+        mergedTask.resumeOffset = [partialMetadata[LCPartialDataLengthKey] longLongValue];
+        mergedTask.partialMetadata = partialMetadata;
+        os_unfair_lock_unlock(&self->_lock);
+        NSURLSessionDataTask *task = [self dataTaskForMergedTask:mergedTask request:request taskRequest:taskRequest options:options];
+        receipt.task = task;
+        if ([self publishTask:task ofMergedTask:mergedTask]) {
+            [task resume];
+        }
+    });
+}
+
+// Adds the validators of the disk data and the range of the partial data to the request. Reads the disk metadata, so it is called on the request queue or the retry queue, without holding the lock.
+- (NSURLRequest *)taskRequestForRequest:(NSURLRequest *)request
+                             identifier:(NSString *)URLIdentifier
+                                options:(LCWebImageOptions)options
+                        partialMetadata:(NSDictionary<NSString *, id> * _Nullable __autoreleasing *)partialMetadata {
+    NSURLRequest *taskRequest = request;
+    BOOL validatesDiskCache = self.shouldValidateDiskCache && !(options & LCWebImageOptionIgnoreDiskCache);
+    if (validatesDiskCache) {
+        taskRequest = [self validatingRequestForRequest:request identifier:URLIdentifier];
+    }
+    if (self.resumableDownloadMinimumBytes > 0 && !(options & LCWebImageOptionIgnoreDiskCache)) {
+        taskRequest = [self resumingRequestForRequest:taskRequest identifier:URLIdentifier partialMetadata:partialMetadata];
+    }
+    return taskRequest;
+}
+
+// Sets the task created outside the lock and takes a slot or a place in the queue for it. Returns whether the caller should resume the task, a task cancelled meanwhile is cancelled instead.
+- (BOOL)publishTask:(NSURLSessionDataTask *)task ofMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    BOOL shouldStartTask = NO;
+    os_unfair_lock_lock(&_lock);
+    mergedTask.task = task;
+    BOOL isCancelled = mergedTask.isCancelled;
+    if (!isCancelled) {
+        if ([self isActiveRequestCountBelowMaximumLimit]) {
+            [self startMergedTask:mergedTask];
+            shouldStartTask = YES;
+        } else {
+            [self enqueueMergedTask:mergedTask];
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    if (isCancelled) {
+        [task cancel];
+    }
+    return shouldStartTask;
+}
+
+- (NSURLSessionDataTask *)dataTaskForMergedTask:(LCImageDownloaderMergedTask *)mergedTask
+                                        request:(NSURLRequest *)request
+                                    taskRequest:(NSURLRequest *)taskRequest
+                                        options:(LCWebImageOptions)options {
+    __weak __typeof__(self) weakSelf = self;
+    NSURLSessionDataTask *task = [self.sessionManager
+            dataTaskWithRequest:taskRequest
+            uploadProgress:nil
+            downloadProgress:nil
+            completionHandler:^(NSURLResponse * _Nonnull response, id  _Nullable responseObject, NSError * _Nullable error) {
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+        objc_setAssociatedObject(mergedTask.task, &LCMergedTaskKey, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        if (mergedTask.abortError) {
+            error = mergedTask.abortError;
+        }
+        LC_TRACE_END(LCWebImageTraceStageDownload, mergedTask.traceID, [responseObject length]);
+        // no hedge starts once the task finished
+        NSURLSessionDataTask *hedgeTask = [strongSelf releaseSlotOfMergedTask:mergedTask];
+        if (hedgeTask) {
+            if (![strongSelf shouldCompleteHedgedMergedTask:mergedTask hedgeTask:nil error:error]) {
+                return;
+            }
+            [hedgeTask cancel];
+        }
+        BOOL shouldRetry = error && !hedgeTask && [strongSelf shouldRetryMergedTask:mergedTask error:error response:response];
+        if ((error && mergedTask.receivedData.length > 0) || shouldRetry) {
+            dispatch_async(strongSelf.responseQueue, ^{
+                if (mergedTask.receivedData.length > 0) {
+                    [strongSelf addPartialDataOfMergedTask:mergedTask];
+                    mergedTask.receivedData = nil;
+                }
+                // the retry may resume from the partial data
+                if (shouldRetry) {
+                    [strongSelf retryMergedTask:mergedTask request:request options:options response:response];
+                }
+            });
+        }
+        if (shouldRetry) {
+            return;
+        }
+        [strongSelf handleResponse:response data:responseObject error:error ofMergedTask:mergedTask options:options];
+    }];
+    objc_setAssociatedObject(task, &LCMergedTaskKey, mergedTask, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return task;
+}
+
+// Stores and decodes the response of the task or of its hedge, and delivers the image.
+- (void)handleResponse:(NSURLResponse *)response
+                  data:(nullable NSData *)responseObject
+                 error:(nullable NSError *)error
+          ofMergedTask:(LCImageDownloaderMergedTask *)mergedTask
+               options:(LCWebImageOptions)options {
+    if (mergedTask.isCancelled && (error || !(mergedTask.options & LCWebImageOptionCacheCancelledData))) {
+        return;
+    }
+    NSString *URLIdentifier = mergedTask.URLIdentifier;
+    NSURLRequest *request = mergedTask.request;
+    BOOL validatesDiskCache = self.shouldValidateDiskCache && !(options & LCWebImageOptionIgnoreDiskCache);
+    __weak __typeof__(self) weakSelf = self;
+    dispatch_async(self.responseQueue, ^{
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+        NSError *responseError = error;
+        NSData *imageData = [strongSelf dataByResumingPartialDataOfMergedTask:mergedTask data:responseObject response:response error:&responseError];
+        if (!responseError) {
+            mergedTask.receivedData = nil;
+        }
+        BOOL notModified = NO;
+        if (validatesDiskCache && [response isKindOfClass:[NSHTTPURLResponse class]] && ((NSHTTPURLResponse *)response).statusCode == 304) {
+            // the body was not transferred, the disk data is still valid
+            CFTimeInterval readStartTime = CACurrentMediaTime();
+            imageData = [strongSelf.imageCache diskDataWithIdentifier:URLIdentifier];
+            [mergedTask.metrics setDuration:CACurrentMediaTime() - readStartTime forStage:LCWebImageMetricsStageDiskRead];
+            if (imageData) {
+                responseError = nil;
+                notModified = YES;
+            }
+        }
+        BOOL usesStaleData = NO;
+        NSHTTPURLResponse *deliveredResponse = (NSHTTPURLResponse *)response;
+        if (responseError) {
+            [strongSelf addFailedURLWithIdentifier:URLIdentifier error:responseError response:response];
+            // a failed revalidation falls back to the stale data, it is better than nothing
+            NSData *staleData = mergedTask.revalidatesDiskData ? [strongSelf.imageCache diskDataWithIdentifier:URLIdentifier] : nil;
+            if (staleData == nil) {
+                NSArray<LCImageDownloaderResponseHandler *> *responseHandlers = [strongSelf removeMergedTask:mergedTask];
+                mergedTask.pendingMetricsCount = 1;
+                [strongSelf deliverImage:nil error:responseError toResponseHandlers:responseHandlers ofMergedTask:mergedTask request:request response:(NSHTTPURLResponse *)response];
+                return;
+            }
+            imageData = staleData;
+            responseError = nil;
+            notModified = YES;
+            usesStaleData = YES;
+            // delivered as a disk cache load
+            deliveredResponse = nil;
+        }
+        // the stored header is still valid for a 304, the whole data tells the frame counts the first bytes did not
+        LCImageHeader *header = notModified ? [strongSelf diskImageHeaderWithIdentifier:URLIdentifier] : nil;
+        BOOL storesHeader = header == nil;
+        header = header ?: LCImageProbeHeader(imageData);
+        [strongSelf deliverHeader:header ofMergedTask:mergedTask request:request];
+        // the merged task stays registered until the decode finishes, so a cancel still reaches it
+        if ([strongSelf shouldDecodeMergedTask:mergedTask]) {
+            mergedTask.pendingMetricsCount = 2;
+            // a fresh body has no metadata yet, the disk still holds the previous one
+            [strongSelf decodeImageData:imageData forMergedTask:mergedTask usesDiskMetadata:notModified completion:^(UIImage *image) {
+                NSArray<LCImageDownloaderResponseHandler *> *responseHandlers = [strongSelf removeMergedTask:mergedTask];
+                [strongSelf deliverImage:image error:nil toResponseHandlers:responseHandlers ofMergedTask:mergedTask request:request response:deliveredResponse];
+            }];
+        } else {
+            // nobody waits, the metrics are not reported
+            mergedTask.metrics = nil;
+        }
+        CFTimeInterval writeStartTime = CACurrentMediaTime();
+        BOOL shouldStore = !mergedTask.isCancelled || (mergedTask.options & LCWebImageOptionCacheCancelledData);
+        if (!(options & LCWebImageOptionIgnoreDiskCache) && shouldStore) {
+            if (!notModified) {
+                [strongSelf.imageCache addDiskData:imageData withIdentifier:URLIdentifier];
+            }
+            if (validatesDiskCache && !usesStaleData) {
+                [strongSelf addDiskMetadataFromResponse:(NSHTTPURLResponse *)response identifier:URLIdentifier notModified:notModified];
+                // a revalidated entry is as fresh as a newly written one for the expiration check
+                if (notModified && [strongSelf.imageCache respondsToSelector:@selector(refreshDiskDataWithIdentifier:)]) {
+                    [strongSelf.imageCache refreshDiskDataWithIdentifier:URLIdentifier];
+                }
+            }
+            if (storesHeader) {
+                [strongSelf addHeaderDiskMetadata:header identifier:URLIdentifier];
+            }
+            if (mergedTask.resumeOffset > 0) {
+                [strongSelf.imageCache removeDiskDataWithIdentifier:LCPartialDataIdentifier(URLIdentifier)];
+            }
+            [mergedTask.metrics setDuration:CACurrentMediaTime() - writeStartTime forStage:LCWebImageMetricsStageDiskWrite];
+        }
+        [strongSelf finishMetricsStageOfMergedTask:mergedTask];
+    });
+}
+
+// Decodes on the decode scheduler and stores the image in the memory cache. Lazy and idle policies store the image encoded instead.
+- (void)decodeImageData:(NSData *)imageData forMergedTask:(LCImageDownloaderMergedTask *)mergedTask usesDiskMetadata:(BOOL)usesDiskMetadata completion:(void (^)(UIImage * _Nullable image))completion {
+    NSString *URLIdentifier = mergedTask.URLIdentifier;
+    os_unfair_lock_lock(&_lock);
+    CGSize decodePixelSize = mergedTask.decodePixelSize;
+    UIViewContentMode decodeContentMode = mergedTask.decodeContentMode;
+    LCWebImageDecodePolicy decodePolicy = mergedTask.decodePolicy;
+    os_unfair_lock_unlock(&_lock);
+    if (decodePolicy != LCWebImageDecodePolicyEager) {
+        UIImage *image = mergedTask.isCancelled ? nil : [UIImage lc_encodedImageWithData:imageData];
+        if (image) {
+            [self addMemoryImage:image identifier:URLIdentifier pixelSize:decodePixelSize contentMode:decodeContentMode];
+            if (decodePolicy == LCWebImageDecodePolicyIdle) {
+                [self addIdleDecodeOfImage:image identifier:URLIdentifier pixelSize:decodePixelSize contentMode:decodeContentMode usesDiskMetadata:usesDiskMetadata];
+            }
+        }
+        completion(image);
+        return;
+    }
+    NSUInteger cost = LCDecodedByteCountForImageData(imageData, decodePixelSize, decodeContentMode);
+    [self.decodeScheduler scheduleDecodeWithPriority:mergedTask.priority cost:cost block:^{
+        UIImage *image = nil;
+        if (!mergedTask.isCancelled) {
+            CFTimeInterval decodeStartTime = CACurrentMediaTime();
+            uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDecode, URLIdentifier, imageData.length);
+            image = [self decodedImageWithData:imageData identifier:URLIdentifier pixelSize:decodePixelSize contentMode:decodeContentMode usesDiskMetadata:usesDiskMetadata cancelled:^BOOL{
+                return mergedTask.isCancelled;
+            }];
+            LC_TRACE_END(LCWebImageTraceStageDecode, traceID, cost);
+            [mergedTask.metrics setDuration:CACurrentMediaTime() - decodeStartTime forStage:LCWebImageMetricsStageDecode];
+            // the decode may have been cut short, nobody wants the image
+            if (!mergedTask.isCancelled) {
+                [self addMemoryImage:image identifier:URLIdentifier pixelSize:decodePixelSize contentMode:decodeContentMode];
+            }
+        }
+        completion(image);
+    }];
+}
+
+// Decodes with the image cache for the target. Data read from the disk cache reuses and records the opacity in its metadata.
+- (nullable UIImage *)decodedImageWithData:(NSData *)imageData
+                                identifier:(NSString *)URLIdentifier
+                                 pixelSize:(CGSize)decodePixelSize
+                               contentMode:(UIViewContentMode)decodeContentMode
+                          usesDiskMetadata:(BOOL)usesDiskMetadata
+                                 cancelled:(nullable BOOL (^)(void))cancelled {
+    if (![self.imageCache respondsToSelector:@selector(decodedImageFromData:withIdentifier:options:)]) {
+        return [self.imageCache decodedImageFromData:imageData withIdentifier:URLIdentifier];
+    }
+    NSMutableDictionary<NSString *, id> *options = [NSMutableDictionary dictionary];
+    options[LCImageDecodeOptionCancelledKey] = cancelled;
+    if (decodePixelSize.width > 0 && decodePixelSize.height > 0) {
+        options[LCImageDecodeOptionTargetPixelSizeKey] = [NSValue valueWithCGSize:decodePixelSize];
+        options[LCImageDecodeOptionContentModeKey] = @(decodeContentMode);
+    }
+    NSNumber *opaque = usesDiskMetadata ? [self diskMetadataWithIdentifier:URLIdentifier][LCImageDiskMetadataOpaqueKey] : nil;
+    options[LCImageDecodeOptionOpaqueKey] = opaque;
+    UIImage *image = [self.imageCache decodedImageFromData:imageData withIdentifier:URLIdentifier options:options];
+    if (usesDiskMetadata && opaque == nil && image) {
+        [self addOpaqueDiskMetadataOfImage:image imageData:imageData identifier:URLIdentifier];
+    }
+    return image;
+}
+
+//This method should only be called while holding the lock
+- (void)raisePriorityOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask options:(LCWebImageOptions)options {
+    mergedTask.options |= options;
+    if (!(options & LCWebImageOptionLowPriority)) {
+        mergedTask.priority = LCImageDecodePriorityDefault;
+    }
+    mergedTask.task.priority = mergedTask.priority == LCImageDecodePriorityLow ? NSURLSessionTaskPriorityLow : NSURLSessionTaskPriorityDefault;
+}
+
+// Enqueues the blocks of the handlers on the delivery queue. The metrics are finished once they all ran.
+- (void)deliverImage:(nullable UIImage *)image
+               error:(nullable NSError *)error
+  toResponseHandlers:(NSArray<LCImageDownloaderResponseHandler *> *)responseHandlers
+        ofMergedTask:(LCImageDownloaderMergedTask *)mergedTask
+             request:(NSURLRequest *)request
+            response:(nullable NSHTTPURLResponse *)response {
+    for (LCImageDownloaderResponseHandler *handler in responseHandlers) {
+        if (error && handler.failureBlock) {
+            [self.deliveryQueue enqueueBlock:^{
+                handler.failureBlock(request, response, error);
+            }];
+        } else if (!error && handler.successBlock) {
+            [self.deliveryQueue enqueueBlock:^{
+                handler.successBlock(request, response, image);
+            }];
+        }
+    }
+    LCWebImageLoadMetrics *metrics = mergedTask.metrics;
+    if (metrics) {
+        CFTimeInterval readyTime = CACurrentMediaTime();
+        // the delivery queue is FIFO, this runs after the handlers
+        [self.deliveryQueue enqueueBlock:^{
+            CFTimeInterval now = CACurrentMediaTime();
+            [metrics setDuration:now - readyTime forStage:LCWebImageMetricsStageDelivery];
+            [metrics setDuration:now - metrics.startTime forStage:LCWebImageMetricsStageTotal];
+            metrics.successful = error == nil && image != nil;
+            [self finishMetricsStageOfMergedTask:mergedTask];
+        }];
+    }
+}
+
+// Removes the finished merged task and returns the handlers waiting for it.
+- (NSArray<LCImageDownloaderResponseHandler *> *)removeMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    NSArray<LCImageDownloaderResponseHandler *> *responseHandlers = nil;
+    os_unfair_lock_lock(&_lock);
+    if (self.mergedTasks[mergedTask.URLIdentifier] == mergedTask) {
+        [self.mergedTasks removeObjectForKey:mergedTask.URLIdentifier];
+        responseHandlers = [mergedTask.responseHandlers copy];
+    }
+    os_unfair_lock_unlock(&_lock);
+    return responseHandlers;
+}
+
+// Frees the slot of the finished network task and starts the next queued one in one critical section.
+// Marks the task finished and returns its hedge, nil if it is not hedged.
+- (nullable NSURLSessionDataTask *)releaseSlotOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    LCImageDownloaderMergedTask *nextMergedTask = nil;
+    os_unfair_lock_lock(&_lock);
+    mergedTask.finished = YES;
+    NSURLSessionDataTask *hedgeTask = mergedTask.hedgeTask;
+    if (mergedTask.isStarted) {
+        mergedTask.started = NO;
+        if (self.activeRequestCount > 0) {
+            self.activeRequestCount -= 1;
+        }
+    }
+    nextMergedTask = [self startNextMergedTaskIfNecessary];
+    os_unfair_lock_unlock(&_lock);
+
+    [nextMergedTask.task resume];
+    return hedgeTask;
+}
+
+// Removes the merged task if nobody waits for the image anymore, in which case the decode is skipped.
+- (BOOL)shouldDecodeMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    os_unfair_lock_lock(&_lock);
+    BOOL shouldDecode = !mergedTask.isCancelled && mergedTask.responseHandlers.count > 0;
+    if (!shouldDecode) {
+        if (self.mergedTasks[mergedTask.URLIdentifier] == mergedTask) {
+            [self.mergedTasks removeObjectForKey:mergedTask.URLIdentifier];
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+    return shouldDecode;
+}
+
+- (void)cancelTaskForImageDownloadReceipt:(LCImageDownloadReceipt *)imageDownloadReceipt {
+    NSString *URLIdentifier = [self cacheKeyForURL:imageDownloadReceipt.url];
+    if (URLIdentifier == nil) {
+        return;
+    }
+    LCImageDownloaderResponseHandler *handler = nil;
+    NSURLSessionDataTask *cancelledTask = nil;
+    NSURLSessionDataTask *cancelledHedgeTask = nil;
+    NSURLSessionDataTask *pausedTask = nil;
+    LCImageDownloaderMergedTask *nextMergedTask = nil;
+    NSUInteger pauseCount = 0;
+    BOOL paused = NO;
+    os_unfair_lock_lock(&_lock);
+    LCImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
+    NSUInteger index = [mergedTask.responseHandlers indexOfObjectPassingTest:^BOOL(LCImageDownloaderResponseHandler * _Nonnull handler, __unused NSUInteger idx, __unused BOOL * _Nonnull stop) {
+        return handler.uuid == imageDownloadReceipt.receiptID;
+    }];
+    if (index != NSNotFound) {
+        handler = mergedTask.responseHandlers[index];
+        [mergedTask removeResponseHandler:handler];
+    }
+    if (mergedTask != nil && mergedTask.responseHandlers.count == 0) {
+        BOOL isReceiving = mergedTask.isStarted && !mergedTask.isFinished;
+        if (isReceiving && [self hasMergedTaskReachedKeepAliveProgress:mergedTask]) {
+            // let it run into the disk cache
+            mergedTask.keptAlive = YES;
+        } else if (isReceiving && self.cancellationGracePeriod > 0) {
+            [self pauseMergedTask:mergedTask];
+            nextMergedTask = [self startNextMergedTaskIfNecessary];
+            pausedTask = mergedTask.task;
+            cancelledHedgeTask = mergedTask.hedgeTask;
+            pauseCount = mergedTask.pauseCount;
+            paused = YES;
+        } else {
+            mergedTask.cancelled = YES;
+            cancelledTask = mergedTask.task;
+            cancelledHedgeTask = mergedTask.hedgeTask;
+            [self.mergedTasks removeObjectForKey:URLIdentifier];
+            if (!mergedTask.isStarted) {
+                [self.queuedMergedTasks removeObject:mergedTask];
+            }
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    [cancelledTask cancel];
+    [cancelledHedgeTask cancel];
+    [nextMergedTask.task resume];
+    if (paused) {
+        [self suspendTask:pausedTask ofMergedTask:mergedTask pauseCount:pauseCount];
+        __weak __typeof__(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.cancellationGracePeriod * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [weakSelf cancelPausedMergedTask:mergedTask pauseCount:pauseCount];
+        });
+    }
+    if (handler.failureBlock) {
+        NSString *failureReason = [NSString stringWithFormat:@"ImageDownloader cancelled URL request: %@",URLIdentifier];
+        NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey:failureReason};
+        NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:userInfo];
+        NSURLRequest *request = imageDownloadReceipt.task.originalRequest ?: [NSURLRequest requestWithURL:imageDownloadReceipt.url];
+        [self.deliveryQueue enqueueBlock:^{
+            handler.failureBlock(request, nil, error);
+        }];
+    }
+}
+
+// Cancels the merged task if it is still suspended by the same pause once the grace period has passed.
+- (void)cancelPausedMergedTask:(LCImageDownloaderMergedTask *)mergedTask pauseCount:(NSUInteger)pauseCount {
+    NSURLSessionDataTask *cancelledTask = nil;
+    os_unfair_lock_lock(&_lock);
+    if (mergedTask.isPaused && mergedTask.pauseCount == pauseCount) {
+        mergedTask.paused = NO;
+        mergedTask.cancelled = YES;
+        cancelledTask = mergedTask.task;
+        if (self.mergedTasks[mergedTask.URLIdentifier] == mergedTask) {
+            [self.mergedTasks removeObjectForKey:mergedTask.URLIdentifier];
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    [cancelledTask cancel];
+}
+
+#pragma mark - Disk cache validation
+
+- (NSDictionary<NSString *, id> *)diskMetadataWithIdentifier:(NSString *)identifier {
+    if (![self.imageCache respondsToSelector:@selector(diskMetadataWithIdentifier:)]) {
+        return nil;
+    }
+    return [self.imageCache diskMetadataWithIdentifier:identifier];
+}
+
+- (BOOL)isDiskDataStaleWithIdentifier:(NSString *)identifier {
+    NSDate *expirationDate = [self diskMetadataWithIdentifier:identifier][LCImageDiskMetadataExpirationDateKey];
+    return expirationDate != nil && [expirationDate timeIntervalSinceNow] <= 0;
+}
+
+// Called on the response queue, it reads the disk metadata. A URL that failed recently is not asked again, its stale data is used.
+- (BOOL)shouldRevalidateDiskDataWithIdentifier:(NSString *)identifier options:(LCWebImageOptions)options {
+    if (!self.shouldValidateDiskCache || (options & LCWebImageOptionIgnoreDiskCache) || ![self isDiskDataStaleWithIdentifier:identifier]) {
+        return NO;
+    }
+    os_unfair_lock_lock(&_lock);
+    LCImageFailedURL *failedURL = [self failedURLWithIdentifier:identifier options:options];
+    os_unfair_lock_unlock(&_lock);
+    return failedURL == nil;
+}
+
+// Called on the response queue. Turns the disk load of stale data into a download validating it, the handlers joined so far receive its result.
+- (void)revalidateDiskDataOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask request:(NSURLRequest *)request options:(LCWebImageOptions)options {
+    NSMutableURLRequest *validatingRequest = [NSMutableURLRequest requestWithURL:request.URL];
+    [validatingRequest addValue:@"image/*" forHTTPHeaderField:@"Accept"];
+    os_unfair_lock_lock(&_lock);
+    mergedTask.request = validatingRequest;
+    mergedTask.revalidatesDiskData = YES;
+    mergedTask.metrics.cacheTier = LCImageCacheTierNetwork;
+    os_unfair_lock_unlock(&_lock);
+    [self sendMergedTask:mergedTask request:validatingRequest options:options receipt:nil];
+}
+
+- (NSURLRequest *)validatingRequestForRequest:(NSURLRequest *)request identifier:(NSString *)identifier {
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    // the disk cache takes the place of NSURLCache, so always ask the origin
+    mutableRequest.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    NSDictionary<NSString *, id> *metadata = [self diskMetadataWithIdentifier:identifier];
+    NSString *ETag = metadata[LCImageDiskMetadataETagKey];
+    if (ETag && ![mutableRequest valueForHTTPHeaderField:@"If-None-Match"]) {
+        [mutableRequest setValue:ETag forHTTPHeaderField:@"If-None-Match"];
+    }
+    NSString *lastModified = metadata[LCImageDiskMetadataLastModifiedKey];
+    if (lastModified && ![mutableRequest valueForHTTPHeaderField:@"If-Modified-Since"]) {
+        [mutableRequest setValue:lastModified forHTTPHeaderField:@"If-Modified-Since"];
+    }
+    return mutableRequest;
+}
+
+// Read-modify-writes the disk metadata, serialized with the other updates when the cache supports it.
+- (void)updateDiskMetadataWithIdentifier:(NSString *)identifier usingBlock:(NSDictionary<NSString *, id> * _Nullable (^)(NSDictionary<NSString *, id> * _Nullable metadata))block {
+    if ([self.imageCache respondsToSelector:@selector(updateDiskMetadataWithIdentifier:usingBlock:)]) {
+        [self.imageCache updateDiskMetadataWithIdentifier:identifier usingBlock:block];
+    } else if ([self.imageCache respondsToSelector:@selector(addDiskMetadata:withIdentifier:)]) {
+        [self.imageCache addDiskMetadata:block([self diskMetadataWithIdentifier:identifier]) withIdentifier:identifier];
+    }
+}
+
+- (void)addDiskMetadataFromResponse:(NSHTTPURLResponse *)response identifier:(NSString *)identifier notModified:(BOOL)notModified {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return;
+    }
+    NSDictionary *headers = response.allHeaderFields;
+    [self updateDiskMetadataWithIdentifier:identifier usingBlock:^NSDictionary<NSString *, id> *(NSDictionary<NSString *, id> *storedMetadata) {
+        // a 304 only carries the headers that changed
+        NSMutableDictionary<NSString *, id> *metadata = [NSMutableDictionary dictionary];
+        if (notModified) {
+            [metadata addEntriesFromDictionary:storedMetadata ?: @{}];
+            [metadata removeObjectForKey:LCImageDiskMetadataExpirationDateKey];
+        }
+        metadata[LCImageDiskMetadataETagKey] = headers[@"ETag"] ?: metadata[LCImageDiskMetadataETagKey];
+        metadata[LCImageDiskMetadataLastModifiedKey] = headers[@"Last-Modified"] ?: metadata[LCImageDiskMetadataLastModifiedKey];
+        metadata[LCImageDiskMetadataCacheControlKey] = headers[@"Cache-Control"] ?: metadata[LCImageDiskMetadataCacheControlKey];
+        NSTimeInterval age = [headers[@"Age"] doubleValue];
+        metadata[LCImageDiskMetadataExpirationDateKey] = LCExpirationDateFromCacheControl(metadata[LCImageDiskMetadataCacheControlKey], age);
+        return metadata;
+    }];
+}
+
+// Stores the header next to the data, so that it is known before the data is read.
+- (void)addHeaderDiskMetadata:(nullable LCImageHeader *)header identifier:(NSString *)identifier {
+    if (!header) {
+        return;
+    }
+    NSDictionary<NSString *, id> *headerRepresentation = header.dictionaryRepresentation;
+    [self updateDiskMetadataWithIdentifier:identifier usingBlock:^NSDictionary<NSString *, id> *(NSDictionary<NSString *, id> *storedMetadata) {
+        NSMutableDictionary<NSString *, id> *metadata = [NSMutableDictionary dictionaryWithDictionary:storedMetadata ?: @{}];
+        metadata[LCImageDiskMetadataHeaderKey] = headerRepresentation;
+        return metadata;
+    }];
+}
+
+// Delivers the header to the handlers of the task that asked for it, once.
+- (void)deliverHeader:(nullable LCImageHeader *)header ofMergedTask:(LCImageDownloaderMergedTask *)mergedTask request:(NSURLRequest *)request {
+    if (!header) {
+        return;
+    }
+    NSMutableArray<void (^)(NSURLRequest *, LCImageHeader *)> *headerBlocks = [NSMutableArray array];
+    os_unfair_lock_lock(&_lock);
+    if (mergedTask.header == nil) {
+        mergedTask.header = header;
+        for (LCImageDownloaderResponseHandler *handler in mergedTask.responseHandlers) {
+            if (handler.headerBlock) {
+                [headerBlocks addObject:handler.headerBlock];
+            }
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+    if (headerBlocks.count == 0) {
+        return;
+    }
+    [self.deliveryQueue enqueueBlock:^{
+        for (void (^headerBlock)(NSURLRequest *, LCImageHeader *) in headerBlocks) {
+            headerBlock(request, header);
+        }
+    }];
+}
+
+// Records whether the decoded image is opaque, so the next decodes skip the alpha scan.
+- (void)addOpaqueDiskMetadataOfImage:(UIImage *)image imageData:(NSData *)imageData identifier:(NSString *)identifier {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) {
+        return;
+    }
+    // a scaled down image may have averaged a few transparent pixels away, only a full size decode tells
+    CGSize pixelSize = LCImagePixelSizeFromHeader(imageData);
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    BOOL isFullSize = (width == pixelSize.width && height == pixelSize.height) || (width == pixelSize.height && height == pixelSize.width);
+    if (!isFullSize) {
+        return;
+    }
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(imageRef);
+    BOOL opaque = alphaInfo == kCGImageAlphaNone || alphaInfo == kCGImageAlphaNoneSkipFirst || alphaInfo == kCGImageAlphaNoneSkipLast;
+    [self updateDiskMetadataWithIdentifier:identifier usingBlock:^NSDictionary<NSString *, id> *(NSDictionary<NSString *, id> *storedMetadata) {
+        NSMutableDictionary<NSString *, id> *metadata = [NSMutableDictionary dictionaryWithDictionary:storedMetadata ?: @{}];
+        metadata[LCImageDiskMetadataOpaqueKey] = @(opaque);
+        return metadata;
+    }];
+}
+
+#pragma mark - Failures
+
+static BOOL LCIsTransientStatusCode(NSInteger statusCode) {
+    switch (statusCode) {
+        case 408:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+static BOOL LCIsTransientError(NSError *error) {
+    if (![error.domain isEqualToString:NSURLErrorDomain]) {
+        return NO;
+    }
+    switch (error.code) {
+        case NSURLErrorTimedOut:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorDNSLookupFailed:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+- (BOOL)shouldRetryMergedTask:(LCImageDownloaderMergedTask *)mergedTask error:(NSError *)error response:(NSURLResponse *)response {
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 0;
+    if (!LCIsTransientStatusCode(statusCode) && !(statusCode == 0 && LCIsTransientError(error))) {
+        return NO;
+    }
+    os_unfair_lock_lock(&_lock);
+    // nobody waits for a kept alive task, don't spend slots on it
+    BOOL shouldRetry = !mergedTask.isCancelled && mergedTask.responseHandlers.count > 0 && mergedTask.retryCount < self.maximumRetryCount;
+    if (shouldRetry) {
+        mergedTask.retryCount += 1;
+    }
+    os_unfair_lock_unlock(&_lock);
+    return shouldRetry;
+}
+
+// Recreates the data task of the merged task once the backoff delay has passed, the task stays registered meanwhile.
+- (void)retryMergedTask:(LCImageDownloaderMergedTask *)mergedTask request:(NSURLRequest *)request options:(LCWebImageOptions)options response:(NSURLResponse *)response {
+    // full jitter
+    NSTimeInterval maximumDelay = MIN(self.retryBaseDelay * pow(2, mergedTask.retryCount - 1), 30);
+    NSTimeInterval delay = maximumDelay * arc4random_uniform(1001) / 1000.0;
+    if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+        NSString *retryAfter = ((NSHTTPURLResponse *)response).allHeaderFields[@"Retry-After"];
+        if (retryAfter.doubleValue > 0) {
+            delay = MIN(retryAfter.doubleValue, 30);
+        }
+    }
+    __weak __typeof__(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [weakSelf restartMergedTask:mergedTask request:request options:options];
+    });
+}
+
+- (void)restartMergedTask:(LCImageDownloaderMergedTask *)mergedTask request:(NSURLRequest *)request options:(LCWebImageOptions)options {
+    if (mergedTask.isCancelled) {
+        return;
+    }
+    NSDictionary<NSString *, id> *partialMetadata = nil;
+    NSURLRequest *taskRequest = [self taskRequestForRequest:request identifier:mergedTask.URLIdentifier options:options partialMetadata:&partialMetadata];
+    NSURLSessionDataTask *task = [self dataTaskForMergedTask:mergedTask request:request taskRequest:taskRequest options:options];
+    os_unfair_lock_lock(&_lock);
+    mergedTask.finished = NO;
+    mergedTask.resumeOffset = [partialMetadata[LCPartialDataLengthKey] longLongValue];
+    mergedTask.resumed = NO;
+    mergedTask.partialMetadata = partialMetadata;
+    mergedTask.headerData = nil;
+    mergedTask.headerProbed = NO;
+    mergedTask.firstByteReceived = NO;
+    mergedTask.traceID = 0;
+    [self raisePriorityOfMergedTask:mergedTask options:options];
+    os_unfair_lock_unlock(&_lock);
+
+    if ([self publishTask:task ofMergedTask:mergedTask]) {
+        [task resume];
+    }
+}
+
+- (NSTimeInterval)negativeCacheDurationForError:(NSError *)error response:(NSURLResponse *)response {
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 0;
+    if (LCIsTransientStatusCode(statusCode) || statusCode >= 500) {
+        return self.negativeCacheDurationForServerErrors;
+    }
+    if (statusCode >= 400) {
+        return self.negativeCacheDurationForClientErrors;
+    }
+    // a request with a larger budget may still load an oversized image
+    if (statusCode == 0 && [error.domain isEqualToString:NSURLErrorDomain] && error.code != NSURLErrorCancelled && error.code != NSURLErrorDataLengthExceedsMaximum) {
+        return self.negativeCacheDurationForNetworkErrors;
+    }
+    return 0;
+}
+
+- (void)addFailedURLWithIdentifier:(NSString *)identifier error:(NSError *)error response:(NSURLResponse *)response {
+    NSTimeInterval duration = [self negativeCacheDurationForError:error response:response];
+    if (duration <= 0) {
+        return;
+    }
+    LCImageFailedURL *failedURL = [[LCImageFailedURL alloc] init];
+    failedURL.error = error;
+    failedURL.response = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+    failedURL.expirationTime = CACurrentMediaTime() + duration;
+    os_unfair_lock_lock(&_lock);
+    self.failedURLs[identifier] = failedURL;
+    os_unfair_lock_unlock(&_lock);
+}
+
+//This method should only be called while holding the lock
+- (LCImageFailedURL *)failedURLWithIdentifier:(NSString *)identifier options:(LCWebImageOptions)options {
+    LCImageFailedURL *failedURL = self.failedURLs[identifier];
+    if (failedURL == nil) {
+        return nil;
+    }
+    if ((options & LCWebImageOptionRetryFailed) || failedURL.expirationTime <= CACurrentMediaTime()) {
+        [self.failedURLs removeObjectForKey:identifier];
+        return nil;
+    }
+    return failedURL;
+}
+
+- (void)removeAllFailedURLs {
+    os_unfair_lock_lock(&_lock);
+    [self.failedURLs removeAllObjects];
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark - Decode target
+
+//This method should only be called while holding the lock
+- (void)raiseDecodeTargetOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask context:(nullable NSDictionary<NSString *, id> *)context {
+    // an image on screen is not kept encoded because a prefetch asked for it first
+    mergedTask.decodePolicy = MIN(mergedTask.decodePolicy, LCDecodePolicyFromContext(context));
+    CGSize pixelSize = CGSizeZero;
+    UIViewContentMode contentMode = UIViewContentModeScaleAspectFill;
+    LCDecodeTargetFromContext(context, &pixelSize, &contentMode);
+    if (!mergedTask.hasDecodeTarget) {
+        mergedTask.hasDecodeTarget = YES;
+        mergedTask.decodePixelSize = pixelSize;
+        mergedTask.decodeContentMode = contentMode;
+        return;
+    }
+    CGSize mergedPixelSize = mergedTask.decodePixelSize;
+    if (mergedPixelSize.width <= 0 || mergedPixelSize.height <= 0) {
+        // already decoded at full size
+        return;
+    }
+    if (pixelSize.width <= 0 || pixelSize.height <= 0) {
+        mergedTask.decodePixelSize = CGSizeZero;
+        return;
+    }
+    // covering the largest target is large enough for every request
+    mergedTask.decodePixelSize = CGSizeMake(MAX(mergedPixelSize.width, pixelSize.width), MAX(mergedPixelSize.height, pixelSize.height));
+    if (contentMode != mergedTask.decodeContentMode) {
+        mergedTask.decodeContentMode = UIViewContentModeScaleAspectFill;
+    }
+}
+
+#pragma mark - Idle Decoding
+
+// Keeps the encoded image to decode once the main run loop is idle, see `LCWebImageDecodePolicyIdle`.
+- (void)addIdleDecodeOfImage:(UIImage *)encodedImage
+                  identifier:(NSString *)URLIdentifier
+                   pixelSize:(CGSize)pixelSize
+                 contentMode:(UIViewContentMode)contentMode
+            usesDiskMetadata:(BOOL)usesDiskMetadata {
+    LCImageIdleDecode *idleDecode = [[LCImageIdleDecode alloc] init];
+    idleDecode.encodedImage = encodedImage;
+    idleDecode.URLIdentifier = URLIdentifier;
+    idleDecode.pixelSize = pixelSize;
+    idleDecode.contentMode = contentMode;
+    idleDecode.usesDiskMetadata = usesDiskMetadata;
+    idleDecode.cost = LCDecodedByteCountForImageData(encodedImage.lc_encodedData, pixelSize, contentMode);
+    BOOL shouldObserve = NO;
+    os_unfair_lock_lock(&_lock);
+    [self.idleDecodes addObject:idleDecode];
+    if (!_idleDecodeObserver) {
+        __weak __typeof__(self) weakSelf = self;
+        _idleDecodeObserver = CFRunLoopObserverCreateWithHandler(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, true, kLCIdleDecodeObserverOrder, ^(CFRunLoopObserverRef observer, CFRunLoopActivity activity) {
+            [weakSelf startIdleDecodes];
+        });
+        shouldObserve = YES;
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    if (shouldObserve) {
+        // the tracking mode of scrolling is left out
+        CFRunLoopAddObserver(CFRunLoopGetMain(), _idleDecodeObserver, kCFRunLoopDefaultMode);
+    }
+    // a sleeping main run loop goes through one more wait
+    CFRunLoopWakeUp(CFRunLoopGetMain());
+}
+
+// Called on the main thread before it waits for events.
+- (void)startIdleDecodes {
+    NSMutableArray<LCImageIdleDecode *> *idleDecodes = [NSMutableArray array];
+    os_unfair_lock_lock(&_lock);
+    while (self.activeIdleDecodeCount < kLCMaximumIdleDecodeCount && self.idleDecodes.count > 0) {
+        [idleDecodes addObject:self.idleDecodes.firstObject];
+        [self.idleDecodes removeObjectAtIndex:0];
+        self.activeIdleDecodeCount += 1;
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    for (LCImageIdleDecode *idleDecode in idleDecodes) {
+        [self.decodeScheduler scheduleDecodeWithPriority:LCImageDecodePriorityLow cost:idleDecode.cost block:^{
+            NSString *memoryCacheKey = LCMemoryCacheKey(idleDecode.URLIdentifier, idleDecode.pixelSize, idleDecode.contentMode);
+            // skipped once the image was purged or replaced by a decoded one
+            if ([self.imageCache memoryImageWithIdentifier:memoryCacheKey] == idleDecode.encodedImage) {
+                uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDecode, idleDecode.URLIdentifier, idleDecode.encodedImage.lc_encodedData.length);
+                UIImage *image = [self decodedImageWithData:idleDecode.encodedImage.lc_encodedData
+                                                 identifier:idleDecode.URLIdentifier
+                                                  pixelSize:idleDecode.pixelSize
+                                                contentMode:idleDecode.contentMode
+                                           usesDiskMetadata:idleDecode.usesDiskMetadata
+                                                  cancelled:nil];
+                LC_TRACE_END(LCWebImageTraceStageDecode, traceID, idleDecode.cost);
+                if (image && [self.imageCache memoryImageWithIdentifier:memoryCacheKey] == idleDecode.encodedImage) {
+                    [self.imageCache addMemoryImage:image withIdentifier:memoryCacheKey];
+                }
+            }
+            os_unfair_lock_lock(&self->_lock);
+            self.activeIdleDecodeCount -= 1;
+            BOOL hasIdleDecodes = self.idleDecodes.count > 0;
+            os_unfair_lock_unlock(&self->_lock);
+            if (hasIdleDecodes) {
+                CFRunLoopWakeUp(CFRunLoopGetMain());
+            }
+        }];
+    }
+}
+
+#pragma mark - Hedging
+
+- (void)recordFirstByteOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask dataTask:(NSURLSessionDataTask *)dataTask {
+    if (mergedTask.isFirstByteReceived) {
+        return;
+    }
+    mergedTask.firstByteReceived = YES;
+    NSString *host = dataTask.originalRequest.URL.host;
+    if (self.hedgingBudget <= 0 || host == nil) {
+        return;
+    }
+    os_unfair_lock_lock(&_lock);
+    LCHostLatency *latency = self.hostLatencies[host];
+    if (latency == nil) {
+        latency = [[LCHostLatency alloc] init];
+        self.hostLatencies[host] = latency;
+    }
+    os_unfair_lock_unlock(&_lock);
+    [latency addFirstByteDuration:CACurrentMediaTime() - mergedTask.requestStartTime];
+}
+
+//This method should only be called while holding the lock
+- (void)scheduleHedgeOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    self.hedgeableRequestCount += 1;
+    NSURLSessionDataTask *primaryTask = mergedTask.task;
+    NSString *host = primaryTask.originalRequest.URL.host;
+    NSTimeInterval delay = host ? self.hostLatencies[host].hedgeDelay : 0;
+    if (delay <= 0) {
+        return;
+    }
+    __weak __typeof__(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [weakSelf hedgeMergedTask:mergedTask primaryTask:primaryTask];
+    });
+}
+
+//This method should only be called while holding the lock
+- (BOOL)isMergedTaskWaitingForHedge:(LCImageDownloaderMergedTask *)mergedTask primaryTask:(NSURLSessionDataTask *)primaryTask {
+    return mergedTask.task == primaryTask && mergedTask.isStarted && !mergedTask.isFinished && !mergedTask.isFirstByteReceived && !mergedTask.isCancelled && mergedTask.hedgeTask == nil;
+}
+
+// Sends the hedge if the task still waits for its response and the budget allows it. The hedge is created without holding the lock, and only published if the task still waits.
+- (void)hedgeMergedTask:(LCImageDownloaderMergedTask *)mergedTask primaryTask:(NSURLSessionDataTask *)primaryTask {
+    os_unfair_lock_lock(&_lock);
+    BOOL shouldHedge = [self isMergedTaskWaitingForHedge:mergedTask primaryTask:primaryTask] && self.hedgedRequestCount + 1 <= self.hedgingBudget * self.hedgeableRequestCount;
+    NSUInteger hedgeIndex = self.hedgedRequestCount;
+    if (shouldHedge) {
+        self.hedgedRequestCount += 1;
+    }
+    os_unfair_lock_unlock(&_lock);
+    if (!shouldHedge) {
+        return;
+    }
+
+    NSURLSessionDataTask *hedgeTask = [self hedgeTaskForMergedTask:mergedTask primaryTask:primaryTask hedgeIndex:hedgeIndex];
+    os_unfair_lock_lock(&_lock);
+    // the response may have arrived while the hedge was created
+    BOOL isWaiting = [self isMergedTaskWaitingForHedge:mergedTask primaryTask:primaryTask];
+    if (isWaiting) {
+        mergedTask.hedgeTask = hedgeTask;
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    if (isWaiting) {
+        [hedgeTask resume];
+    } else {
+        [hedgeTask cancel];
+    }
+}
+
+- (NSURLSessionDataTask *)hedgeTaskForMergedTask:(LCImageDownloaderMergedTask *)mergedTask primaryTask:(NSURLSessionDataTask *)primaryTask hedgeIndex:(NSUInteger)hedgeIndex {
+    NSMutableURLRequest *hedgeRequest = [primaryTask.originalRequest mutableCopy];
+    NSArray<NSString *> *mirrorHosts = self.hedgingMirrorHosts[hedgeRequest.URL.host];
+    if (mirrorHosts.count > 0) {
+        NSURLComponents *components = [NSURLComponents componentsWithURL:hedgeRequest.URL resolvingAgainstBaseURL:NO];
+        components.host = mirrorHosts[hedgeIndex % mirrorHosts.count];
+        hedgeRequest.URL = components.URL ?: hedgeRequest.URL;
+    }
+    LCWebImageOptions options = mergedTask.options;
+    __weak __typeof__(self) weakSelf = self;
+    // released with the completion handler once the hedge completes
+    __block NSURLSessionDataTask *hedgeTask = nil;
+    hedgeTask = [self.hedgingSessionManager
+            dataTaskWithRequest:hedgeRequest
+            uploadProgress:nil
+            downloadProgress:nil
+            completionHandler:^(NSURLResponse * _Nonnull response, id  _Nullable responseObject, NSError * _Nullable error) {
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        NSURLSessionDataTask *completedTask = hedgeTask;
+        hedgeTask = nil;
+        if (!strongSelf || ![strongSelf shouldCompleteHedgedMergedTask:mergedTask hedgeTask:completedTask error:error]) {
+            return;
+        }
+        [primaryTask cancel];
+        [strongSelf handleResponse:response data:responseObject error:error ofMergedTask:mergedTask options:options];
+    }];
+    return hedgeTask;
+}
+
+// Decides whether the task or its hedge completes the merged task: the first one to succeed, or the last one to fail. A hedge that was never published completes nothing.
+- (BOOL)shouldCompleteHedgedMergedTask:(LCImageDownloaderMergedTask *)mergedTask hedgeTask:(nullable NSURLSessionDataTask *)hedgeTask error:(NSError *)error {
+    BOOL hedge = hedgeTask != nil;
+    os_unfair_lock_lock(&_lock);
+    if (hedge && mergedTask.hedgeTask != hedgeTask) {
+        os_unfair_lock_unlock(&_lock);
+        return NO;
+    }
+    if (hedge) {
+        mergedTask.hedgeFinished = YES;
+    }
+    BOOL isOtherRunning = hedge ? !mergedTask.isFinished : !mergedTask.isHedgeFinished;
+    BOOL shouldComplete = !mergedTask.isCompletionClaimed && (!error || !isOtherRunning);
+    if (shouldComplete) {
+        mergedTask.completionClaimed = YES;
+    }
+    os_unfair_lock_unlock(&_lock);
+    return shouldComplete;
+}
+
+#pragma mark - Budgets
+
+//This method should only be called while holding the lock
+- (void)raiseBudgetsOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask context:(nullable NSDictionary<NSString *, id> *)context {
+    NSNumber *byteCount = context[LCWebImageContextMaximumByteCountKey];
+    long long maximumByteCount = byteCount ? byteCount.longLongValue : (long long)self.maximumDownloadBytes;
+    NSNumber *pixelCount = context[LCWebImageContextMaximumPixelCountKey];
+    double maximumPixelCount = pixelCount ? pixelCount.doubleValue : self.maximumPixelCount;
+    CGSize targetPixelSize = [context[LCWebImageContextTargetPixelSizeKey] CGSizeValue];
+    if (self.maximumPixelCountRatio > 0 && targetPixelSize.width > 0 && targetPixelSize.height > 0) {
+        double targetPixelCount = targetPixelSize.width * targetPixelSize.height * self.maximumPixelCountRatio;
+        maximumPixelCount = maximumPixelCount > 0 ? MIN(maximumPixelCount, targetPixelCount) : targetPixelCount;
+    }
+    if (!mergedTask.hasBudgets) {
+        mergedTask.hasBudgets = YES;
+        mergedTask.maximumByteCount = maximumByteCount;
+        mergedTask.maximumPixelCount = maximumPixelCount;
+        return;
+    }
+    // the largest budget wins, no limit being the largest
+    if (mergedTask.maximumByteCount > 0) {
+        mergedTask.maximumByteCount = maximumByteCount > 0 ? MAX(mergedTask.maximumByteCount, maximumByteCount) : 0;
+    }
+    if (mergedTask.maximumPixelCount > 0) {
+        mergedTask.maximumPixelCount = maximumPixelCount > 0 ? MAX(mergedTask.maximumPixelCount, maximumPixelCount) : 0;
+    }
+}
+
+- (BOOL)mergedTask:(LCImageDownloaderMergedTask *)mergedTask exceedsByteBudgetWithResponse:(NSURLResponse *)response {
+    if ([response isKindOfClass:[NSHTTPURLResponse class]] && ((NSHTTPURLResponse *)response).statusCode == 206) {
+        // the header is in the partial data, and it was probed already
+        mergedTask.headerProbed = YES;
+    }
+    long long maximumByteCount = mergedTask.maximumByteCount;
+    long long expectedLength = response.expectedContentLength;
+    if (maximumByteCount <= 0 || expectedLength == NSURLResponseUnknownLength) {
+        return NO;
+    }
+    if (mergedTask.resumeOffset + expectedLength <= maximumByteCount) {
+        return NO;
+    }
+    mergedTask.abortError = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorDataLengthExceedsMaximum userInfo:nil];
+    return YES;
+}
+
+// Reads the header from the first bytes of the response, delivers it and cancels the task if the image is too large.
+- (void)mergedTask:(LCImageDownloaderMergedTask *)mergedTask probeHeaderWithData:(NSData *)data ofDataTask:(NSURLSessionDataTask *)dataTask {
+    if (mergedTask.headerData == nil) {
+        mergedTask.headerData = [NSMutableData dataWithCapacity:data.length];
+    }
+    [mergedTask.headerData appendData:data];
+    NSData *headerData = mergedTask.headerData;
+    LCImageHeader *header = LCImageProbeHeader(headerData);
+    if (header == nil) {
+        BOOL unsupported = headerData.length >= 12 && LCImageDetectType(headerData) == LCImageTypeUnknown;
+        if (unsupported || headerData.length >= kLCMaximumHeaderProbeBytes) {
+            mergedTask.headerProbed = YES;
+            mergedTask.headerData = nil;
+        }
+        return;
+    }
+    mergedTask.headerProbed = YES;
+    mergedTask.headerData = nil;
+    [self deliverHeader:header ofMergedTask:mergedTask request:mergedTask.request];
+    CGSize pixelSize = header.pixelSize;
+    if (mergedTask.maximumPixelCount > 0 && pixelSize.width * pixelSize.height > mergedTask.maximumPixelCount) {
+        mergedTask.abortError = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorDataLengthExceedsMaximum userInfo:nil];
+        // nothing worth resuming
+        mergedTask.receivedData = nil;
+        [dataTask cancel];
+    }
+}
+
+#pragma mark - Metrics
+
+- (LCWebImageLoadMetrics *)sampledMetricsForURL:(NSURL *)URL cacheTier:(LCImageCacheTier)cacheTier {
+    double samplingRate = self.metricsSamplingRate;
+    if (samplingRate <= 0 || (self.metricsDelegate == nil && self.metricsAggregator == nil)) {
+        return nil;
+    }
+    if (samplingRate < 1 && arc4random_uniform(UINT32_MAX) >= samplingRate * UINT32_MAX) {
+        return nil;
+    }
+    LCWebImageLoadMetrics *metrics = [[LCWebImageLoadMetrics alloc] init];
+    metrics.URL = URL;
+    metrics.cacheTier = cacheTier;
+    metrics.startTime = CACurrentMediaTime();
+    return metrics;
+}
+
+// Reports the metrics once the delivery and the disk write both finished.
+- (void)finishMetricsStageOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    if (mergedTask.metrics == nil) {
+        return;
+    }
+    os_unfair_lock_lock(&_lock);
+    mergedTask.pendingMetricsCount -= 1;
+    BOOL finished = mergedTask.pendingMetricsCount == 0;
+    os_unfair_lock_unlock(&_lock);
+
+    if (finished) {
+        [self reportMetrics:mergedTask.metrics];
+    }
+}
+
+- (void)reportMetrics:(LCWebImageLoadMetrics *)metrics {
+    [self.metricsAggregator addMetrics:metrics];
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self.metricsDelegate imageManager:self didCollectMetrics:metrics];
+        });
+        return;
+    }
+    [self.metricsDelegate imageManager:self didCollectMetrics:metrics];
+}
+
+#pragma mark - Resumable downloads
+
+// Asks for the bytes missing from the partial disk data, and returns its metadata if it does. Reads the metadata only, the data is read once the response arrived.
+- (NSURLRequest *)resumingRequestForRequest:(NSURLRequest *)request
+                                 identifier:(NSString *)URLIdentifier
+                            partialMetadata:(NSDictionary<NSString *, id> * _Nullable __autoreleasing *)partialMetadata {
+    NSDictionary<NSString *, id> *metadata = [self diskMetadataWithIdentifier:LCPartialDataIdentifier(URLIdentifier)];
+    long long length = [metadata[LCPartialDataLengthKey] longLongValue];
+    NSString *ETag = metadata[LCImageDiskMetadataETagKey];
+    // a weak ETag can't be used in If-Range
+    NSString *validator = [ETag hasPrefix:@"W/"] ? nil : ETag;
+    validator = validator ?: metadata[LCImageDiskMetadataLastModifiedKey];
+    if (length <= 0 || validator == nil || [request valueForHTTPHeaderField:@"Range"]) {
+        return request;
+    }
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    mutableRequest.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    [mutableRequest setValue:[NSString stringWithFormat:@"bytes=%lld-", length] forHTTPHeaderField:@"Range"];
+    [mutableRequest setValue:validator forHTTPHeaderField:@"If-Range"];
+    *partialMetadata = metadata;
+    return mutableRequest;
+}
+
+// Called on the session delegate queue. Starts keeping the received bytes if the response can be resumed later.
+- (void)mergedTask:(LCImageDownloaderMergedTask *)mergedTask didReceiveResponse:(NSURLResponse *)response {
+    if (self.resumableDownloadMinimumBytes == 0 || (mergedTask.options & LCWebImageOptionIgnoreDiskCache) || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return;
+    }
+    NSHTTPURLResponse *HTTPResponse = (NSHTTPURLResponse *)response;
+    NSDictionary *headers = HTTPResponse.allHeaderFields;
+    if (HTTPResponse.statusCode == 206) {
+        // the validator still matches, so the partial metadata stays valid
+        mergedTask.resumed = mergedTask.resumeOffset > 0 && LCContentRangeStart(HTTPResponse) == mergedTask.resumeOffset;
+        if (mergedTask.resumed) {
+            mergedTask.receivedData = [NSMutableData data];
+        }
+        return;
+    }
+    long long expectedLength = response.expectedContentLength;
+    BOOL acceptsRanges = [[headers[@"Accept-Ranges"] lowercaseString] containsString:@"bytes"];
+    NSString *ETag = headers[@"ETag"];
+    NSString *lastModified = headers[@"Last-Modified"];
+    if (HTTPResponse.statusCode != 200 || !acceptsRanges || expectedLength < (long long)self.resumableDownloadMinimumBytes || (ETag == nil && lastModified == nil)) {
+        return;
+    }
+    NSMutableDictionary<NSString *, id> *metadata = [NSMutableDictionary dictionary];
+    metadata[LCImageDiskMetadataETagKey] = ETag;
+    metadata[LCImageDiskMetadataLastModifiedKey] = lastModified;
+    mergedTask.partialMetadata = metadata;
+    mergedTask.receivedData = [NSMutableData dataWithCapacity:(NSUInteger)expectedLength];
+}
+
+// Stores the bytes received by the interrupted task, appended to the partial data it continued.
+- (void)addPartialDataOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    NSData *receivedData = mergedTask.receivedData;
+    if (receivedData.length == 0 || mergedTask.partialMetadata == nil) {
+        return;
+    }
+    NSString *partialIdentifier = LCPartialDataIdentifier(mergedTask.URLIdentifier);
+    NSMutableData *partialData = nil;
+    if (mergedTask.isResumed) {
+        partialData = [[self.imageCache diskDataWithIdentifier:partialIdentifier] mutableCopy];
+        if (partialData.length != mergedTask.resumeOffset) {
+            return;
+        }
+        [partialData appendData:receivedData];
+    } else {
+        partialData = [receivedData mutableCopy];
+    }
+    [self.imageCache addDiskData:partialData withIdentifier:partialIdentifier];
+    if ([self.imageCache respondsToSelector:@selector(addDiskMetadata:withIdentifier:)]) {
+        NSMutableDictionary<NSString *, id> *metadata = [mergedTask.partialMetadata mutableCopy];
+        metadata[LCPartialDataLengthKey] = @(partialData.length);
+        [self.imageCache addDiskMetadata:metadata withIdentifier:partialIdentifier];
+    }
+}
+
+// Stitches the partial disk data and the body of a `206 Partial Content` response.
+- (NSData *)dataByResumingPartialDataOfMergedTask:(LCImageDownloaderMergedTask *)mergedTask data:(NSData *)data response:(NSURLResponse *)response error:(NSError * __autoreleasing *)error {
+    if (mergedTask.resumeOffset == 0 || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return data;
+    }
+    NSString *partialIdentifier = LCPartialDataIdentifier(mergedTask.URLIdentifier);
+    NSInteger statusCode = ((NSHTTPURLResponse *)response).statusCode;
+    if (statusCode == 416) {
+        // Range Not Satisfiable, the partial data is useless
+        [self.imageCache removeDiskDataWithIdentifier:partialIdentifier];
+    }
+    if (*error || statusCode != 206) {
+        return data;
+    }
+    NSMutableData *partialData = [[self.imageCache diskDataWithIdentifier:partialIdentifier] mutableCopy];
+    if (!mergedTask.isResumed || partialData.length != mergedTask.resumeOffset) {
+        // the partial data changed under the request, start over next time
+        [self.imageCache removeDiskDataWithIdentifier:partialIdentifier];
+        *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:nil];
+        return nil;
+    }
+    [partialData appendData:data];
+    return partialData;
+}
+
+#pragma mark - Queue
+
+// The methods below should only be called while holding the lock.
+
+- (LCImageDownloaderMergedTask *)startNextMergedTaskIfNecessary {
+    if ([self isActiveRequestCountBelowMaximumLimit]) {
+        LCImageDownloaderMergedTask *mergedTask = [self dequeueMergedTask];
+        if (mergedTask != nil) {
+            [self startMergedTask:mergedTask];
+        }
+        return mergedTask;
+    }
+    return nil;
+}
+
+- (BOOL)hasMergedTaskReachedKeepAliveProgress:(LCImageDownloaderMergedTask *)mergedTask {
+    int64_t expectedBytes = mergedTask.task.countOfBytesExpectedToReceive;
+    if (expectedBytes <= 0) {
+        return NO;
+    }
+    return (double)mergedTask.task.countOfBytesReceived / expectedBytes >= self.keepAliveProgressThreshold;
+}
+
+// Marks the merged task paused and frees its slot. The caller suspends the task and cancels the hedge once the lock is released, see `suspendTask:ofMergedTask:pauseCount:`.
+- (void)pauseMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    mergedTask.paused = YES;
+    mergedTask.pauseCount += 1;
+    mergedTask.started = NO;
+    if (self.activeRequestCount > 0) {
+        self.activeRequestCount -= 1;
+    }
+}
+
+// Suspends the task of a merged task paused with the given count, without holding the lock. A revive may have resumed the task before it is suspended here, the task is resumed again if the revive started it.
+- (void)suspendTask:(NSURLSessionDataTask *)task ofMergedTask:(LCImageDownloaderMergedTask *)mergedTask pauseCount:(NSUInteger)pauseCount {
+    [task suspend];
+    os_unfair_lock_lock(&_lock);
+    BOOL isRevived = !(mergedTask.isPaused && mergedTask.pauseCount == pauseCount) && mergedTask.isStarted && !mergedTask.isCancelled;
+    os_unfair_lock_unlock(&_lock);
+    if (isRevived) {
+        [task resume];
+    }
+}
+
+// Called after a handler was appended. Returns whether the caller should resume the task of a paused merged task once the lock is released.
+- (BOOL)reviveMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    if (!mergedTask.isKeptAlive && !mergedTask.isPaused) {
+        return NO;
+    }
+    // the new request reuses the bytes received while nobody waited, once
+    _savedDownloadBytes += mergedTask.task.countOfBytesReceived;
+    mergedTask.keptAlive = NO;
+    if (!mergedTask.isPaused) {
+        return NO;
+    }
+    mergedTask.paused = NO;
+    if ([self isActiveRequestCountBelowMaximumLimit]) {
+        [self startMergedTask:mergedTask];
+        return YES;
+    }
+    [self enqueueMergedTask:mergedTask];
+    return NO;
+}
+
+// Takes a slot for the merged task, the caller resumes the task once the lock is released.
+- (void)startMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
+    LCWebImageLoadMetrics *metrics = mergedTask.metrics;
+    if (metrics && [metrics durationForStage:LCWebImageMetricsStageQueueWait] < 0) {
+        [metrics setDuration:CACurrentMediaTime() - metrics.startTime forStage:LCWebImageMetricsStageQueueWait];
+    }
+    mergedTask.started = YES;
+    ++self.activeRequestCount;
+    if (mergedTask.traceID == 0) {
+        mergedTask.traceID = LC_TRACE_BEGIN(LCWebImageTraceStageDownload, mergedTask.URLIdentifier, 0);
+    }
+    mergedTask.requestStartTime = CACurrentMediaTime();
+    if (self.hedgingBudget > 0 && !mergedTask.isFirstByteReceived && mergedTask.hedgeTask == nil && mergedTask.resumeOffset == 0) {
+        [self scheduleHedgeOfMergedTask:mergedTask];
+    }
+}
+
+- (void)enqueueMergedTask:(LCImageDownloaderMergedTask *)mergedTask {
     switch (self.downloadPrioritization) {
         case LCImageDownloadPrioritizationFIFO:
             [self.queuedMergedTasks addObject:mergedTask];
@@ -396,7 +2349,9 @@
 - (LCImageDownloaderMergedTask *)dequeueMergedTask {
     LCImageDownloaderMergedTask *mergedTask = nil;
     mergedTask = [self.queuedMergedTasks firstObject];
-    [self.queuedMergedTasks removeObject:mergedTask];
+    if (mergedTask != nil) {
+        [self.queuedMergedTasks removeObjectAtIndex:0];
+    }
     return mergedTask;
 }
 
@@ -404,12 +2359,4 @@
     return self.activeRequestCount < self.maximumActiveDownloads;
 }
 
-- (LCImageDownloaderMergedTask *)safelyGetMergedTask:(NSString *)URLIdentifier {
-    __block LCImageDownloaderMergedTask *mergedTask;
-    dispatch_sync(self.synchronizationQueue, ^(){
-        mergedTask = self.mergedTasks[URLIdentifier];
-    });
-    return mergedTask;
-}
-
 @end
@@ -0,0 +1,132 @@
+// LCWebImageMetrics.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, LCImageCacheTier) {
+    /// The image was downloaded.
+    LCImageCacheTierNetwork,
+    /// The image was found in the memory cache.
+    LCImageCacheTierMemory,
+    /// The image was read from the disk cache.
+    LCImageCacheTierDisk
+};
+
+typedef NS_ENUM(NSInteger, LCWebImageMetricsStage) {
+    /// Waiting in the download queue for one of the `maximumActiveDownloads` slots.
+    LCWebImageMetricsStageQueueWait,
+    LCWebImageMetricsStageDomainLookup,
+    LCWebImageMetricsStageConnect,
+    LCWebImageMetricsStageSecureConnection,
+    /// From the request start to the first byte of the response.
+    LCWebImageMetricsStageTimeToFirstByte,
+    /// From the first to the last byte of the response.
+    LCWebImageMetricsStageTransfer,
+    LCWebImageMetricsStageDiskRead,
+    LCWebImageMetricsStageDecode,
+    LCWebImageMetricsStageDiskWrite,
+    /// From the result being ready to its success or failure block running on the main thread.
+    LCWebImageMetricsStageDelivery,
+    /// From the request to the success or failure block running.
+    LCWebImageMetricsStageTotal
+};
+
+FOUNDATION_EXPORT const NSInteger LCWebImageMetricsStageCount;
+
+/**
+ The `LCWebImageLoadMetrics` records where the time of one image load went. Merged requests for the same image share one load, and so one record. Durations are in seconds, and are negative for the stages the load did not go through.
+ */
+@interface LCWebImageLoadMetrics : NSObject
+
+/**
+ The URL of the image.
+ */
+@property (nonatomic, strong) NSURL *URL;
+
+/**
+ The cache tier that served the image.
+ */
+@property (nonatomic, assign) LCImageCacheTier cacheTier;
+
+/**
+ Whether the load ended with an image.
+ */
+@property (nonatomic, assign, getter=isSuccessful) BOOL successful;
+
+/**
+ The host time the load was requested at, see `CACurrentMediaTime()`.
+ */
+@property (nonatomic, assign) CFTimeInterval startTime;
+
+/**
+ Returns the duration of a stage.
+ */
+- (NSTimeInterval)durationForStage:(LCWebImageMetricsStage)stage;
+
+/**
+ Sets the duration of a stage.
+ */
+- (void)setDuration:(NSTimeInterval)duration forStage:(LCWebImageMetricsStage)stage;
+
+/**
+ Fills the network stages from the last transaction of the task metrics.
+ */
+- (void)setNetworkDurationsWithTaskMetrics:(NSURLSessionTaskMetrics *)taskMetrics API_AVAILABLE(ios(10.0));
+
+@end
+
+/**
+ The `LCWebImageMetricsAggregator` keeps the latest durations of each stage in fixed size ring buffers and computes percentiles over them.
+ */
+@interface LCWebImageMetricsAggregator : NSObject
+
+/**
+ The number of durations kept for each stage. `512` by default.
+ */
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+
+/**
+ Initializes an aggregator keeping 512 durations for each stage.
+ */
+- (instancetype)init;
+
+/**
+ Initializes an aggregator.
+
+ @param capacity The number of durations kept for each stage, at least 1.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ Adds the durations of every stage the load went through.
+ */
+- (void)addMetrics:(LCWebImageLoadMetrics *)metrics;
+
+/**
+ Returns the duration under which the given fraction of the kept durations of the stage fall, or a negative value if there are none.
+
+ @param percentile The fraction, for example `0.9` for p90.
+ @param stage The stage.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile forStage:(LCWebImageMetricsStage)stage;
+
+/**
+ Returns the p50, p90 and p99 durations and the count of every stage that has durations, keyed by the stage name, for example `@{@"decode": @{@"p50": @0.004, ..., @"count": @512}}`.
+ */
+- (NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *)summary;
+
+/**
+ Removes every kept duration.
+ */
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,192 @@
+// LCWebImageMetrics.m
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import "LCWebImageMetrics.h"
+#import <os/lock.h>
+
+const NSInteger LCWebImageMetricsStageCount = LCWebImageMetricsStageTotal + 1;
+
+static NSString * LCWebImageMetricsStageName(LCWebImageMetricsStage stage) {
+    switch (stage) {
+        case LCWebImageMetricsStageQueueWait: return @"queueWait";
+        case LCWebImageMetricsStageDomainLookup: return @"domainLookup";
+        case LCWebImageMetricsStageConnect: return @"connect";
+        case LCWebImageMetricsStageSecureConnection: return @"secureConnection";
+        case LCWebImageMetricsStageTimeToFirstByte: return @"timeToFirstByte";
+        case LCWebImageMetricsStageTransfer: return @"transfer";
+        case LCWebImageMetricsStageDiskRead: return @"diskRead";
+        case LCWebImageMetricsStageDecode: return @"decode";
+        case LCWebImageMetricsStageDiskWrite: return @"diskWrite";
+        case LCWebImageMetricsStageDelivery: return @"delivery";
+        case LCWebImageMetricsStageTotal: return @"total";
+    }
+    return @"";
+}
+
+static NSTimeInterval LCTimeIntervalBetweenDates(NSDate *startDate, NSDate *endDate) {
+    if (!startDate || !endDate) {
+        return -1;
+    }
+    return [endDate timeIntervalSinceDate:startDate];
+}
+
+@implementation LCWebImageLoadMetrics {
+    NSTimeInterval _durations[LCWebImageMetricsStageTotal + 1];
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        for (NSInteger stage = 0; stage < LCWebImageMetricsStageCount; stage++) {
+            _durations[stage] = -1;
+        }
+    }
+    return self;
+}
+
+- (NSTimeInterval)durationForStage:(LCWebImageMetricsStage)stage {
+    if (stage < 0 || stage >= LCWebImageMetricsStageCount) {
+        return -1;
+    }
+    return _durations[stage];
+}
+
+- (void)setDuration:(NSTimeInterval)duration forStage:(LCWebImageMetricsStage)stage {
+    if (stage < 0 || stage >= LCWebImageMetricsStageCount) {
+        return;
+    }
+    _durations[stage] = duration;
+}
+
+- (void)setNetworkDurationsWithTaskMetrics:(NSURLSessionTaskMetrics *)taskMetrics {
+    NSURLSessionTaskTransactionMetrics *transaction = taskMetrics.transactionMetrics.lastObject;
+    if (!transaction) {
+        return;
+    }
+    // the dates are nil for a reused connection
+    [self setDuration:LCTimeIntervalBetweenDates(transaction.domainLookupStartDate, transaction.domainLookupEndDate) forStage:LCWebImageMetricsStageDomainLookup];
+    [self setDuration:LCTimeIntervalBetweenDates(transaction.connectStartDate, transaction.connectEndDate) forStage:LCWebImageMetricsStageConnect];
+    [self setDuration:LCTimeIntervalBetweenDates(transaction.secureConnectionStartDate, transaction.secureConnectionEndDate) forStage:LCWebImageMetricsStageSecureConnection];
+    [self setDuration:LCTimeIntervalBetweenDates(transaction.requestStartDate ?: transaction.fetchStartDate, transaction.responseStartDate) forStage:LCWebImageMetricsStageTimeToFirstByte];
+    [self setDuration:LCTimeIntervalBetweenDates(transaction.responseStartDate, transaction.responseEndDate) forStage:LCWebImageMetricsStageTransfer];
+}
+
+- (NSString *)description {
+    NSMutableString *description = [NSMutableString stringWithFormat:@"<LCWebImageLoadMetrics>URL: %@ tier: %ld", self.URL, (long)self.cacheTier];
+    for (NSInteger stage = 0; stage < LCWebImageMetricsStageCount; stage++) {
+        if (_durations[stage] >= 0) {
+            [description appendFormat:@" %@: %.1fms", LCWebImageMetricsStageName(stage), _durations[stage] * 1000];
+        }
+    }
+    return description;
+}
+
+@end
+
+@implementation LCWebImageMetricsAggregator {
+    os_unfair_lock _lock;
+    // `capacity` durations per stage, stage after stage
+    NSTimeInterval *_durations;
+    NSUInteger _counts[LCWebImageMetricsStageTotal + 1];
+    NSUInteger _nextIndexes[LCWebImageMetricsStageTotal + 1];
+}
+
+- (instancetype)init {
+    return [self initWithCapacity:512];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    if (self = [super init]) {
+        _capacity = MAX(1, capacity);
+        _durations = calloc(_capacity * LCWebImageMetricsStageCount, sizeof(NSTimeInterval));
+        _lock = OS_UNFAIR_LOCK_INIT;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_durations);
+}
+
+- (void)addMetrics:(LCWebImageLoadMetrics *)metrics {
+    os_unfair_lock_lock(&_lock);
+    for (NSInteger stage = 0; stage < LCWebImageMetricsStageCount; stage++) {
+        NSTimeInterval duration = [metrics durationForStage:stage];
+        if (duration < 0) {
+            continue;
+        }
+        _durations[stage * _capacity + _nextIndexes[stage]] = duration;
+        _nextIndexes[stage] = (_nextIndexes[stage] + 1) % _capacity;
+        _counts[stage] = MIN(_counts[stage] + 1, _capacity);
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+static int LCCompareTimeIntervals(const void *a, const void *b) {
+    NSTimeInterval lhs = *(const NSTimeInterval *)a;
+    NSTimeInterval rhs = *(const NSTimeInterval *)b;
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+// Copies and sorts the kept durations of the stage, the caller frees the buffer.
+- (NSUInteger)copySortedDurations:(NSTimeInterval **)sortedDurations forStage:(LCWebImageMetricsStage)stage {
+    *sortedDurations = NULL;
+    if (stage < 0 || stage >= LCWebImageMetricsStageCount) {
+        return 0;
+    }
+    NSTimeInterval *buffer = malloc(_capacity * sizeof(NSTimeInterval));
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _counts[stage];
+    memcpy(buffer, _durations + stage * _capacity, count * sizeof(NSTimeInterval));
+    os_unfair_lock_unlock(&_lock);
+    // sort outside the lock, recording stays cheap
+    qsort(buffer, count, sizeof(NSTimeInterval), LCCompareTimeIntervals);
+    *sortedDurations = buffer;
+    return count;
+}
+
+static NSTimeInterval LCDurationAtPercentile(NSTimeInterval *sortedDurations, NSUInteger count, double percentile) {
+    if (count == 0) {
+        return -1;
+    }
+    percentile = MIN(MAX(percentile, 0), 1);
+    NSUInteger index = (NSUInteger)ceil(percentile * count);
+    return sortedDurations[MIN(MAX(index, 1), count) - 1];
+}
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile forStage:(LCWebImageMetricsStage)stage {
+    NSTimeInterval *sortedDurations = NULL;
+    NSUInteger count = [self copySortedDurations:&sortedDurations forStage:stage];
+    NSTimeInterval duration = LCDurationAtPercentile(sortedDurations, count, percentile);
+    free(sortedDurations);
+    return duration;
+}
+
+- (NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *)summary {
+    NSMutableDictionary *summary = [NSMutableDictionary dictionary];
+    for (NSInteger stage = 0; stage < LCWebImageMetricsStageCount; stage++) {
+        NSTimeInterval *sortedDurations = NULL;
+        NSUInteger count = [self copySortedDurations:&sortedDurations forStage:stage];
+        if (count > 0) {
+            summary[LCWebImageMetricsStageName(stage)] = @{@"p50": @(LCDurationAtPercentile(sortedDurations, count, 0.5)),
+                                                           @"p90": @(LCDurationAtPercentile(sortedDurations, count, 0.9)),
+                                                           @"p99": @(LCDurationAtPercentile(sortedDurations, count, 0.99)),
+                                                           @"count": @(count)};
+        }
+        free(sortedDurations);
+    }
+    return summary;
+}
+
+- (void)reset {
+    os_unfair_lock_lock(&_lock);
+    memset(_counts, 0, sizeof(_counts));
+    memset(_nextIndexes, 0, sizeof(_nextIndexes));
+    os_unfair_lock_unlock(&_lock);
+}
+
+@end
@@ -0,0 +1,81 @@
+// LCWebImageTrace.h
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Tracing of the image pipeline. Set `LC_WEBIMAGE_TRACE=1` in the preprocessor macros of the target that compiles LCWebImage, for example with `GCC_PREPROCESSOR_DEFINITIONS` in the `pod_target_xcconfig` of a Podfile hook, to emit an `os_signpost` interval for every stage in the "com.lcwebimage" subsystem, visible in the Points of Interest of Instruments. The same events are kept in memory and can be exported as a Chrome trace with `LCWebImageTraceWriteChromeTrace`.
+
+ When the switch is off, the macros expand to nothing and their arguments are not evaluated.
+ */
+#ifndef LC_WEBIMAGE_TRACE
+#define LC_WEBIMAGE_TRACE 0
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, LCWebImageTraceStage) {
+    /// From the data task resuming to its completion, tagged with the response size.
+    LCWebImageTraceStageDownload,
+    LCWebImageTraceStageDiskRead,
+    LCWebImageTraceStageDiskWrite,
+    /// Tagged with the data size, and the decoded size once it ends.
+    LCWebImageTraceStageDecode,
+    /// The memory cache purge, tagged with the purged size.
+    LCWebImageTraceStagePurge,
+    /// Running the success and failure blocks on the main thread, tagged with the number of blocks.
+    LCWebImageTraceStageDelivery,
+    /// The synchronous main thread work of setting an image on a view.
+    LCWebImageTraceStageSetImage
+};
+
+#if LC_WEBIMAGE_TRACE
+
+/**
+ Begins an interval and returns its identifier.
+
+ @param stage The stage.
+ @param key The cache key of the image, only its hash is recorded. May be nil.
+ @param bytes The byte size the interval starts with, 0 if unknown.
+ */
+FOUNDATION_EXPORT uint64_t LCWebImageTraceBegin(LCWebImageTraceStage stage, NSString * _Nullable key, uint64_t bytes);
+
+/**
+ Ends an interval.
+
+ @param stage The stage passed to `LCWebImageTraceBegin`.
+ @param identifier The identifier returned by `LCWebImageTraceBegin`.
+ @param bytes The byte size the interval produced, 0 if unknown.
+ */
+FOUNDATION_EXPORT void LCWebImageTraceEnd(LCWebImageTraceStage stage, uint64_t identifier, uint64_t bytes);
+
+#define LC_TRACE_BEGIN(stage, key, bytes) LCWebImageTraceBegin(stage, key, bytes)
+#define LC_TRACE_END(stage, identifier, bytes) LCWebImageTraceEnd(stage, identifier, bytes)
+
+#else
+
+#define LC_TRACE_BEGIN(stage, key, bytes) ((uint64_t)0)
+#define LC_TRACE_END(stage, identifier, bytes) ((void)(identifier))
+
+#endif
+
+/**
+ Writes the recorded events in the Chrome trace event format, readable by `chrome://tracing` and Perfetto. Writes an empty trace when tracing is compiled out.
+
+ @param path The file to write.
+ @param error The error if writing failed.
+ @return Whether the file was written.
+ */
+FOUNDATION_EXPORT BOOL LCWebImageTraceWriteChromeTrace(NSString *path, NSError * _Nullable __autoreleasing * _Nullable error);
+
+/**
+ Removes the recorded events.
+ */
+FOUNDATION_EXPORT void LCWebImageTraceReset(void);
+
+NS_ASSUME_NONNULL_END
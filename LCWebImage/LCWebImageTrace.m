@@ -0,0 +1,178 @@
+// LCWebImageTrace.m
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+#import "LCWebImageTrace.h"
+
+#if LC_WEBIMAGE_TRACE
+
+#import <os/lock.h>
+#import <os/log.h>
+#import <os/signpost.h>
+#import <pthread.h>
+#import <time.h>
+#import <unistd.h>
+
+// Enough for a long scrolling session, older events are dropped once it is reached.
+static const NSUInteger kLCMaximumTraceEventCount = 1 << 18;
+
+typedef struct {
+    LCWebImageTraceStage stage;
+    BOOL begin;
+    uint64_t identifier;
+    uint64_t timestamp; // microseconds
+    uint64_t threadID;
+    NSUInteger keyHash;
+    uint64_t bytes;
+} LCWebImageTraceEvent;
+
+static os_unfair_lock LCTraceLock = OS_UNFAIR_LOCK_INIT;
+static LCWebImageTraceEvent *LCTraceEvents = NULL;
+static NSUInteger LCTraceEventCount = 0;
+static NSUInteger LCTraceNextEventIndex = 0;
+static uint64_t LCTraceNextIdentifier = 1;
+
+static os_log_t LCTraceLog(void) API_AVAILABLE(ios(12.0)) {
+    static os_log_t log;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        log = os_log_create("com.lcwebimage", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    });
+    return log;
+}
+
+static void LCTraceRecord(LCWebImageTraceStage stage, BOOL begin, uint64_t identifier, NSUInteger keyHash, uint64_t bytes) {
+    LCWebImageTraceEvent event;
+    event.stage = stage;
+    event.begin = begin;
+    event.identifier = identifier;
+    event.timestamp = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) / 1000;
+    pthread_threadid_np(NULL, &event.threadID);
+    event.keyHash = keyHash;
+    event.bytes = bytes;
+    os_unfair_lock_lock(&LCTraceLock);
+    if (LCTraceEvents == NULL) {
+        LCTraceEvents = malloc(kLCMaximumTraceEventCount * sizeof(LCWebImageTraceEvent));
+    }
+    LCTraceEvents[LCTraceNextEventIndex] = event;
+    LCTraceNextEventIndex = (LCTraceNextEventIndex + 1) % kLCMaximumTraceEventCount;
+    LCTraceEventCount = MIN(LCTraceEventCount + 1, kLCMaximumTraceEventCount);
+    os_unfair_lock_unlock(&LCTraceLock);
+}
+
+// os_signpost needs a literal name for each interval.
+#define LC_SIGNPOST_INTERVAL(stage, begin, spid, format, ...) \
+    do { \
+        os_log_t log = LCTraceLog(); \
+        switch (stage) { \
+            case LCWebImageTraceStageDownload: if (begin) { os_signpost_interval_begin(log, spid, "Download", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "Download", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStageDiskRead: if (begin) { os_signpost_interval_begin(log, spid, "DiskRead", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "DiskRead", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStageDiskWrite: if (begin) { os_signpost_interval_begin(log, spid, "DiskWrite", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "DiskWrite", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStageDecode: if (begin) { os_signpost_interval_begin(log, spid, "Decode", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "Decode", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStagePurge: if (begin) { os_signpost_interval_begin(log, spid, "Purge", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "Purge", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStageDelivery: if (begin) { os_signpost_interval_begin(log, spid, "Delivery", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "Delivery", format, ##__VA_ARGS__); } break; \
+            case LCWebImageTraceStageSetImage: if (begin) { os_signpost_interval_begin(log, spid, "SetImage", format, ##__VA_ARGS__); } else { os_signpost_interval_end(log, spid, "SetImage", format, ##__VA_ARGS__); } break; \
+        } \
+    } while (0)
+
+uint64_t LCWebImageTraceBegin(LCWebImageTraceStage stage, NSString *key, uint64_t bytes) {
+    os_unfair_lock_lock(&LCTraceLock);
+    uint64_t identifier = LCTraceNextIdentifier++;
+    os_unfair_lock_unlock(&LCTraceLock);
+    NSUInteger keyHash = key.hash;
+    if (@available(iOS 12.0, *)) {
+        os_signpost_id_t spid = (os_signpost_id_t)identifier;
+        LC_SIGNPOST_INTERVAL(stage, YES, spid, "url:%{public}lx bytes:%llu", (unsigned long)keyHash, bytes);
+    }
+    LCTraceRecord(stage, YES, identifier, keyHash, bytes);
+    return identifier;
+}
+
+void LCWebImageTraceEnd(LCWebImageTraceStage stage, uint64_t identifier, uint64_t bytes) {
+    if (identifier == 0) {
+        // the interval never began, for example a download cancelled in the queue
+        return;
+    }
+    if (@available(iOS 12.0, *)) {
+        os_signpost_id_t spid = (os_signpost_id_t)identifier;
+        LC_SIGNPOST_INTERVAL(stage, NO, spid, "bytes:%llu", bytes);
+    }
+    LCTraceRecord(stage, NO, identifier, 0, bytes);
+}
+
+static NSString * LCWebImageTraceStageName(LCWebImageTraceStage stage) {
+    switch (stage) {
+        case LCWebImageTraceStageDownload: return @"Download";
+        case LCWebImageTraceStageDiskRead: return @"DiskRead";
+        case LCWebImageTraceStageDiskWrite: return @"DiskWrite";
+        case LCWebImageTraceStageDecode: return @"Decode";
+        case LCWebImageTraceStagePurge: return @"Purge";
+        case LCWebImageTraceStageDelivery: return @"Delivery";
+        case LCWebImageTraceStageSetImage: return @"SetImage";
+    }
+    return @"";
+}
+
+static NSArray<NSDictionary *> * LCTraceChromeEvents(void) {
+    os_unfair_lock_lock(&LCTraceLock);
+    NSUInteger count = LCTraceEventCount;
+    NSUInteger firstIndex = (LCTraceNextEventIndex + kLCMaximumTraceEventCount - count) % kLCMaximumTraceEventCount;
+    LCWebImageTraceEvent *events = malloc(MAX(count, 1) * sizeof(LCWebImageTraceEvent));
+    for (NSUInteger i = 0; i < count; i++) {
+        events[i] = LCTraceEvents[(firstIndex + i) % kLCMaximumTraceEventCount];
+    }
+    os_unfair_lock_unlock(&LCTraceLock);
+
+    NSMutableArray<NSDictionary *> *chromeEvents = [NSMutableArray arrayWithCapacity:count];
+    NSNumber *pid = @(getpid());
+    for (NSUInteger i = 0; i < count; i++) {
+        LCWebImageTraceEvent event = events[i];
+        NSMutableDictionary *args = [NSMutableDictionary dictionary];
+        args[@"bytes"] = @(event.bytes);
+        if (event.begin) {
+            args[@"url"] = [NSString stringWithFormat:@"%lx", (unsigned long)event.keyHash];
+        }
+        // async events, the intervals may end on another thread
+        [chromeEvents addObject:@{@"name": LCWebImageTraceStageName(event.stage),
+                                  @"cat": @"LCWebImage",
+                                  @"ph": event.begin ? @"b" : @"e",
+                                  @"id": [NSString stringWithFormat:@"0x%llx", event.identifier],
+                                  @"ts": @(event.timestamp),
+                                  @"pid": pid,
+                                  @"tid": @(event.threadID),
+                                  @"args": args}];
+    }
+    free(events);
+    return chromeEvents;
+}
+
+void LCWebImageTraceReset(void) {
+    os_unfair_lock_lock(&LCTraceLock);
+    LCTraceEventCount = 0;
+    LCTraceNextEventIndex = 0;
+    os_unfair_lock_unlock(&LCTraceLock);
+}
+
+#else
+
+static NSArray<NSDictionary *> * LCTraceChromeEvents(void) {
+    return @[];
+}
+
+void LCWebImageTraceReset(void) {
+}
+
+#endif
+
+BOOL LCWebImageTraceWriteChromeTrace(NSString *path, NSError **error) {
+    NSDictionary *trace = @{@"traceEvents": LCTraceChromeEvents(), @"displayTimeUnit": @"ms"};
+    NSData *data = [NSJSONSerialization dataWithJSONObject:trace options:0 error:error];
+    if (!data) {
+        return NO;
+    }
+    return [data writeToFile:path options:NSDataWritingAtomic error:error];
+}
@@ -8,6 +8,7 @@
 
 #import "UIButton+LCWebImage.h"
 #import <objc/runtime.h>
+#import "LCWebImageTrace.h"
 
 @interface UIButton (_LCWebImage)
 @end
@@ -125,17 +126,21 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
                           success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, UIImage *image))success
                           failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure
 {
+    NSDictionary<NSString *, id> *context = [self lc_imageContextWithContentMode:UIViewContentModeCenter];
+    urlRequest = [[[self class] lc_sharedImageManager] transformedRequestForRequest:urlRequest context:context];
     if ([self isActiveTaskURLEqualToURLRequest:urlRequest forState:state]) {
         return;
     }
     
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageSetImage, urlRequest.URL.absoluteString, 0);
     [self lc_cancelImageDownloadTaskForState:state];
     
     LCWebImageManager *downloader = [[self class] lc_sharedImageManager];
     id <LCImageCache> imageCache = downloader.imageCache;
+    NSString *cacheKey = [downloader cacheKeyForURL:urlRequest.URL];
     
     //Use the image from the image cache if it exists
-    UIImage *cachedImage = [imageCache memoryImageWithIdentifier:urlRequest.URL.absoluteString];
+    UIImage *cachedImage = [downloader memoryImageForURL:urlRequest.URL context:context];
     if (cachedImage) {
         if (success) {
             success(urlRequest, nil, cachedImage);
@@ -144,10 +149,10 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
         }
         [self lc_setImageDownloadReceipt:nil forState:state];
     } else if (!(options & LCWebImageOptionIgnoreDiskCache) &&
-               [imageCache containsDiskDataWithIdentifier:urlRequest.URL.absoluteString]) {
+               [imageCache containsDiskDataWithIdentifier:cacheKey]) {
         NSUUID *downloadID = [NSUUID UUID];
         __weak __typeof(self)weakSelf = self;
-        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID completion:^(UIImage * _Nonnull image) {
+        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID context:context completion:^(UIImage * _Nonnull image) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([[strongSelf lc_imageDownloadReceiptForState:state].receiptID isEqual:downloadID]) {
                 if (success) {
@@ -175,6 +180,7 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
                    downloadImageForURLRequest:urlRequest
                    withReceiptID:downloadID
                    options:options
+                   context:context
                    success:^(NSURLRequest * _Nonnull request, NSHTTPURLResponse * _Nullable response, UIImage * _Nonnull responseObject) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([[strongSelf lc_imageDownloadReceiptForState:state].receiptID isEqual:downloadID]) {
@@ -205,6 +211,7 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
         
         [self lc_setImageDownloadReceipt:receipt forState:state];
     }
+    LC_TRACE_END(LCWebImageTraceStageSetImage, traceID, 0);
 }
 
 #pragma mark -
@@ -241,17 +248,21 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
                                     success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, UIImage *image))success
                                     failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure
 {
+    NSDictionary<NSString *, id> *context = [self lc_imageContextWithContentMode:UIViewContentModeScaleToFill];
+    urlRequest = [[[self class] lc_sharedImageManager] transformedRequestForRequest:urlRequest context:context];
     if ([self isActiveBackgroundTaskURLEqualToURLRequest:urlRequest forState:state]) {
         return;
     }
     
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageSetImage, urlRequest.URL.absoluteString, 0);
     [self lc_cancelBackgroundImageDownloadTaskForState:state];
     
     LCWebImageManager *downloader = [[self class] lc_sharedImageManager];
     id <LCImageCache> imageCache = downloader.imageCache;
+    NSString *cacheKey = [downloader cacheKeyForURL:urlRequest.URL];
     
     //Use the image from the image cache if it exists
-    UIImage *cachedImage = [imageCache memoryImageWithIdentifier:urlRequest.URL.absoluteString];
+    UIImage *cachedImage = [downloader memoryImageForURL:urlRequest.URL context:context];
     if (cachedImage) {
         if (success) {
             success(urlRequest, nil, cachedImage);
@@ -260,10 +271,10 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
         }
         [self lc_setBackgroundImageDownloadReceipt:nil forState:state];
     } else if (!(options & LCWebImageOptionIgnoreDiskCache) &&
-               [imageCache containsDiskDataWithIdentifier:urlRequest.URL.absoluteString]) {
+               [imageCache containsDiskDataWithIdentifier:cacheKey]) {
         NSUUID *downloadID = [NSUUID UUID];
         __weak __typeof(self)weakSelf = self;
-        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID completion:^(UIImage * _Nonnull image) {
+        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID context:context completion:^(UIImage * _Nonnull image) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([[strongSelf lc_backgroundImageDownloadReceiptForState:state].receiptID isEqual:downloadID]) {
                 if (success) {
@@ -291,6 +302,7 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
                    downloadImageForURLRequest:urlRequest
                    withReceiptID:downloadID
                    options:options
+                   context:context
                    success:^(NSURLRequest * _Nonnull request, NSHTTPURLResponse * _Nullable response, UIImage * _Nonnull responseObject) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([[strongSelf lc_backgroundImageDownloadReceiptForState:state].receiptID isEqual:downloadID]) {
@@ -321,6 +333,7 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
         
         [self lc_setBackgroundImageDownloadReceipt:receipt forState:state];
     }
+    LC_TRACE_END(LCWebImageTraceStageSetImage, traceID, 0);
 }
 
 #pragma mark -
@@ -343,12 +356,35 @@ static const char * lc_backgroundImageDownloadReceiptKeyForState(UIControlState
 
 - (BOOL)isActiveTaskURLEqualToURLRequest:(NSURLRequest *)urlRequest forState:(UIControlState)state {
     LCImageDownloadReceipt *receipt = [self lc_imageDownloadReceiptForState:state];
-    return [receipt.task.originalRequest.URL.absoluteString isEqualToString:urlRequest.URL.absoluteString];
+    return [self isReceipt:receipt forURLRequest:urlRequest];
 }
 
 - (BOOL)isActiveBackgroundTaskURLEqualToURLRequest:(NSURLRequest *)urlRequest forState:(UIControlState)state {
     LCImageDownloadReceipt *receipt = [self lc_backgroundImageDownloadReceiptForState:state];
-    return [receipt.task.originalRequest.URL.absoluteString isEqualToString:urlRequest.URL.absoluteString];
+    return [self isReceipt:receipt forURLRequest:urlRequest];
+}
+
+// The size the image is displayed at, empty before the first layout. The image keeps its own size unless it is a background image.
+- (NSDictionary<NSString *, id> *)lc_imageContextWithContentMode:(UIViewContentMode)contentMode {
+    CGFloat scale = self.window.screen.scale ?: [UIScreen mainScreen].scale;
+    CGFloat contentScale = self.contentScaleFactor;
+    CGSize size = self.bounds.size;
+    NSMutableDictionary<NSString *, id> *context = [NSMutableDictionary dictionary];
+    context[LCWebImageContextScreenScaleKey] = @(scale);
+    context[LCWebImageContextContentModeKey] = @(contentMode);
+    if (size.width > 0 && size.height > 0) {
+        context[LCWebImageContextTargetPixelSizeKey] = [NSValue valueWithCGSize:CGSizeMake(ceil(size.width * contentScale), ceil(size.height * contentScale))];
+    }
+    return context;
+}
+
+// Disk cache loads have no task, so compare the receipt URL.
+- (BOOL)isReceipt:(LCImageDownloadReceipt *)receipt forURLRequest:(NSURLRequest *)urlRequest {
+    if (receipt == nil) {
+        return NO;
+    }
+    LCWebImageManager *downloader = [[self class] lc_sharedImageManager];
+    return [[downloader cacheKeyForURL:receipt.url] isEqualToString:[downloader cacheKeyForURL:urlRequest.URL]];
 }
 
 @end
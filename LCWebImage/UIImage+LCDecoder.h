@@ -6,13 +6,45 @@
 //
 
 #import <UIKit/UIKit.h>
+#import "LCImageKernels.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
+typedef NS_ENUM(NSInteger, LCImageOpacity) {
+    /// The decoded pixels are scanned, an image whose alpha is unused is tagged opaque.
+    LCImageOpacityUnknown,
+    /// Every pixel is known to be opaque, the image is tagged opaque without a scan.
+    LCImageOpacityOpaque,
+    /// Some pixels are known not to be opaque, the alpha is kept without a scan.
+    LCImageOpacityTranslucent
+};
+
 @interface UIImage (LCDecoder)
 
 /**
- Return the decoded image by the provided image. This one unlike `CGImageCreateDecoded:`, will not decode the image which contains alpha channel or animated image
+ The filter used to scale down images in `lc_decodedAndScaledDownImageWithImage:limitBytes:`. Defaults to `LCImageResampleQualityHigh`.
+ */
+@property (class, nonatomic, assign) LCImageResampleQuality lc_resampleQuality;
+
+/**
+ Opaque color images decoded to at most this many pixels are kept in 16 bits per pixel, RGB555, half the memory of 32 bits at the cost of some banding. Meant for thumbnails. Defaults to 0, off. Grayscale images without alpha are always kept in 8 bits gray.
+ */
+@property (class, nonatomic, assign) NSUInteger lc_compactOpaqueImageMaximumPixelCount;
+
+/**
+ The data of an image returned by `lc_encodedImageWithData:`, nil for the other images. `LCAutoPurgingImageCache` charges its length instead of the decoded size.
+ */
+@property (nonatomic, strong, readonly, nullable) NSData *lc_encodedData;
+
+/**
+ Return an image of the data that is not decoded yet. It keeps the data, see `lc_encodedData`, so that it can be decoded later with `lc_decodedAndScaledDownImageWithData:limitBytes:maximumPixelSize:cancelled:`. If it is displayed first, Core Animation decodes it on the main thread.
+ @param data The image data
+ @return The encoded image, or nil if the data is not an image
+ */
++ (nullable UIImage *)lc_encodedImageWithData:(NSData *)data;
+
+/**
+ Return the decoded image by the provided image. This one unlike `CGImageCreateDecoded:`, will not decode the image which contains alpha channel or animated image. The decoded rows are aligned to 64 bytes, in the byte order of the host, so Core Animation displays the bitmap without copying it again at commit time.
  @param image The image to be decoded
  @return The decoded image
  */
@@ -23,11 +55,64 @@ NS_ASSUME_NONNULL_BEGIN
  @warning You should not pass too small bytes, the suggestion value should be larger than 1MB. Even we use Tile Decoding to avoid OOM, however, small bytes will consume much more CPU time because we need to iterate more times to draw each tile.
 
  @param image The image to be decoded and scaled down
- @param bytes The limit bytes size. Provide 0 to use the build-in limit.
+ @param bytes The limit bytes size. Provide 0 to use the build-in limit, a 32nd of the device RAM between 16MB and 120MB.
  @return The decoded and probably scaled down image
  */
 + (UIImage *)lc_decodedAndScaledDownImageWithImage:(UIImage *)image limitBytes:(NSUInteger)bytes;
 
+/**
+ Works as `lc_decodedAndScaledDownImageWithImage:limitBytes:`, but stops early once the decode is no longer needed. The tiles are decoded at their own size and resampled with `lc_resampleQuality`, in parallel on the slots of the shared `LCImageDecodeScheduler` that are idle.
+
+ @param image The image to be decoded and scaled down
+ @param bytes The limit bytes size. Provide 0 to use the build-in limit.
+ @param cancelled Checked before the decode and between tiles. Return YES to stop.
+ @return The decoded and probably scaled down image, or nil if cancelled
+ */
++ (nullable UIImage *)lc_decodedAndScaledDownImageWithImage:(UIImage *)image limitBytes:(NSUInteger)bytes cancelled:(nullable BOOL (^)(void))cancelled;
+
+/**
+ Return the decoded and probably scaled down image of the provided data. An image that has to be scaled down is decoded by ImageIO directly at the smaller size with `CGImageSourceCreateThumbnailAtIndex`, so only the needed pixels are produced and JPEG can be scaled while decoding. Animated images and images that fit work as `lc_decodedAndScaledDownImageWithImage:limitBytes:cancelled:`.
+
+ @param data The image data
+ @param bytes The limit bytes size. Provide 0 to use the build-in limit.
+ @param maximumPixelSize The largest width or height, in pixels, of the decoded image. Provide 0 for no limit other than the bytes.
+ @param cancelled Checked before the decode. Return YES to stop.
+ @return The decoded and probably scaled down image, or nil if the data is not an image or if cancelled
+ */
++ (nullable UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize cancelled:(nullable BOOL (^)(void))cancelled;
+
+/**
+ Works as `lc_decodedAndScaledDownImageWithData:limitBytes:maximumPixelSize:cancelled:`, and decodes the image no larger than it is displayed in a view of the given pixel size and content mode. `UIViewContentModeScaleAspectFit` decodes the image to fit in the target, `UIViewContentModeScaleAspectFill` and `UIViewContentModeScaleToFill` to cover it, and the modes that don't scale the image decode it at full size.
+
+ @param data The image data
+ @param bytes The limit bytes size. Provide 0 to use the build-in limit.
+ @param maximumPixelSize The largest width or height, in pixels, of the decoded image. Provide 0 for no limit.
+ @param targetPixelSize The size, in pixels, of the view the image is displayed in. Provide `CGSizeZero` for no target.
+ @param contentMode The content mode of the view.
+ @param cancelled Checked before the decode. Return YES to stop.
+ @return The decoded and probably scaled down image, or nil if the data is not an image or if cancelled
+ */
++ (nullable UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode cancelled:(nullable BOOL (^)(void))cancelled;
+
+/**
+ Returns the size, in pixels, `lc_decodedAndScaledDownImageWithData:limitBytes:maximumPixelSize:targetPixelSize:contentMode:cancelled:` decodes a still image of the given size to, so that the cost of a decode is known before it runs.
+
+ @param pixelSize The size of the image, in pixels, with its EXIF orientation applied.
+ @param bytes The limit bytes size. Provide 0 to use the build-in limit.
+ @param maximumPixelSize The largest width or height, in pixels, of the decoded image. Provide 0 for no limit.
+ @param targetPixelSize The size, in pixels, of the view the image is displayed in. Provide `CGSizeZero` for no target.
+ @param contentMode The content mode of the view.
+ @return The decoded size, `pixelSize` if the image is decoded at full size
+ */
++ (CGSize)lc_decodedPixelSizeForPixelSize:(CGSize)pixelSize limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode;
+
+/**
+ Works as `lc_decodedAndScaledDownImageWithData:limitBytes:maximumPixelSize:targetPixelSize:contentMode:cancelled:`, with what is already known about the alpha of the image. Every decode scans the alpha of images that declare one, and tags the decoded image opaque when no pixel uses it, so that Core Animation doesn't blend it. A known opacity skips the scan.
+
+ @param opacity The known opacity of the image, `LCImageOpacityUnknown` to scan.
+ */
++ (nullable UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode opacity:(LCImageOpacity)opacity cancelled:(nullable BOOL (^)(void))cancelled;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -6,14 +6,102 @@
 //
 
 #import "UIImage+LCDecoder.h"
+#import "LCImageBufferPool.h"
+#import "LCImageDecodeScheduler.h"
 #import "objc/runtime.h"
+#import <ImageIO/ImageIO.h>
+#import <stdatomic.h>
 
 static const size_t kBytesPerPixel = 4;
-static const size_t kBitsPerComponent = 8;
 static const CGFloat kBytesPerMB = 1024.0f * 1024.0f;
-static const CGFloat kDestImageLimitBytes = 60.f * kBytesPerMB;
-static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to overlap the seems where tiles meet.
+// Core Animation uploads bitmaps whose rows are aligned to 64 bytes as they are, others are copied at commit time.
+static const size_t kBytesPerRowAlignment = 64;
+
+static LCImageResampleQuality LCResampleQuality = LCImageResampleQualityHigh;
+static NSUInteger LCCompactOpaqueImageMaximumPixelCount = 0;
+
+// The layout of a decoded bitmap. The color space is shared, not retained.
+typedef struct {
+    size_t bitsPerComponent;
+    size_t bytesPerPixel;
+    size_t channels;
+    CGColorSpaceRef colorSpace;
+    CGBitmapInfo bitmapInfo;
+} LCPixelFormat;
+
+// The build-in limit, a 32nd of the device RAM between 16MB and 120MB, 64MB on a 2GB device.
+static CGFloat LCDestImageLimitBytes(void) {
+    static CGFloat limitBytes;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        CGFloat physicalMemory = [NSProcessInfo processInfo].physicalMemory;
+        limitBytes = MIN(MAX(physicalMemory / 32 / kBytesPerMB, 16), 120) * kBytesPerMB;
+    });
+    return limitBytes;
+}
+
+// The byte of the alpha channel in a 32 bits pixel, as laid out in memory.
+static int LCAlphaChannelIndex(CGBitmapInfo bitmapInfo) {
+    CGImageAlphaInfo alphaInfo = bitmapInfo & kCGBitmapAlphaInfoMask;
+    BOOL alphaFirst = alphaInfo == kCGImageAlphaPremultipliedFirst || alphaInfo == kCGImageAlphaFirst || alphaInfo == kCGImageAlphaNoneSkipFirst;
+    CGBitmapInfo byteOrder = bitmapInfo & kCGBitmapByteOrderMask;
+    BOOL littleEndian = byteOrder == kCGBitmapByteOrder32Little || (byteOrder == kCGBitmapByteOrder32Host && CFByteOrderGetCurrent() == CFByteOrderLittleEndian);
+    return alphaFirst == littleEndian ? 3 : 0;
+}
+
+static size_t LCAlignedBytesPerRow(size_t width, size_t bytesPerPixel) {
+    return (width * bytesPerPixel + kBytesPerRowAlignment - 1) / kBytesPerRowAlignment * kBytesPerRowAlignment;
+}
+
+// Whether the image is already laid out as the decoder would draw it, so Core Animation can use it without a copy.
+static BOOL LCImageMatchesPixelFormat(CGImageRef imageRef, LCPixelFormat format) {
+    CGBitmapInfo layoutMask = kCGBitmapAlphaInfoMask | kCGBitmapByteOrderMask | kCGBitmapFloatComponents;
+    return CGImageGetBitsPerComponent(imageRef) == format.bitsPerComponent &&
+           CGImageGetBitsPerPixel(imageRef) == format.bytesPerPixel * 8 &&
+           (CGImageGetBitmapInfo(imageRef) & layoutMask) == (format.bitmapInfo & layoutMask) &&
+           CGImageGetBytesPerRow(imageRef) % kBytesPerRowAlignment == 0;
+}
+
+// The same pixels tagged without alpha, so Core Animation composites them without blending.
+static CGBitmapInfo LCOpaqueBitmapInfo(CGBitmapInfo bitmapInfo) {
+    return (bitmapInfo & ~kCGBitmapAlphaInfoMask) | kCGImageAlphaNoneSkipFirst;
+}
+
 @implementation UIImage (LCDecoder)
+
++ (LCImageResampleQuality)lc_resampleQuality {
+    return LCResampleQuality;
+}
+
++ (void)setLc_resampleQuality:(LCImageResampleQuality)quality {
+    LCResampleQuality = quality;
+}
+
++ (NSUInteger)lc_compactOpaqueImageMaximumPixelCount {
+    return LCCompactOpaqueImageMaximumPixelCount;
+}
+
++ (void)setLc_compactOpaqueImageMaximumPixelCount:(NSUInteger)pixelCount {
+    LCCompactOpaqueImageMaximumPixelCount = pixelCount;
+}
+
+- (NSData *)lc_encodedData {
+    return objc_getAssociatedObject(self, @selector(lc_encodedData));
+}
+
++ (UIImage *)lc_encodedImageWithData:(NSData *)data {
+    if (!data) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithData:data];
+    if (!image) {
+        return nil;
+    }
+    // the image is immutable, the data is only ever set here
+    objc_setAssociatedObject(image, @selector(lc_encodedData), data, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return image;
+}
+
 + (CGColorSpaceRef)colorSpaceGetDeviceRGB {
     static CGColorSpaceRef colorSpace;
     static dispatch_once_t onceToken;
@@ -27,6 +115,55 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     return colorSpace;
 }
 
++ (CGColorSpaceRef)colorSpaceGetDeviceGray {
+    static CGColorSpaceRef colorSpace;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        if (@available(iOS 9.0, tvOS 9.0, *)) {
+            colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericGrayGamma2_2);
+        } else {
+            colorSpace = CGColorSpaceCreateDeviceGray();
+        }
+    });
+    return colorSpace;
+}
+
+// The smallest format that keeps what the image holds. Never more than 8 bits per channel, even for 16 bits or float sources.
+// pixelCount is the number of decoded pixels, opaque images up to `lc_compactOpaqueImageMaximumPixelCount` get 5 bits per channel. 0 to keep 8 bits.
++ (LCPixelFormat)decodedPixelFormatForImage:(CGImageRef)cgImage pixelCount:(size_t)pixelCount {
+    BOOL hasAlpha = [self CGImageContainsAlpha:cgImage];
+    CGColorSpaceModel colorSpaceModel = CGColorSpaceGetModel(CGImageGetColorSpace(cgImage));
+    LCPixelFormat format;
+    if (!hasAlpha && colorSpaceModel == kCGColorSpaceModelMonochrome) {
+        // gray with alpha has no bitmap context format, it stays 32 bits
+        format.bitsPerComponent = 8;
+        format.bytesPerPixel = 1;
+        format.channels = 1;
+        format.colorSpace = [self colorSpaceGetDeviceGray];
+        format.bitmapInfo = (CGBitmapInfo)kCGImageAlphaNone;
+    } else if (!hasAlpha && pixelCount > 0 && pixelCount <= LCCompactOpaqueImageMaximumPixelCount) {
+        // RGB555, the only 16 bits format Core Graphics draws into
+        format.bitsPerComponent = 5;
+        format.bytesPerPixel = 2;
+        format.channels = 3;
+        format.colorSpace = [self colorSpaceGetDeviceRGB];
+        format.bitmapInfo = kCGBitmapByteOrder16Host | kCGImageAlphaNoneSkipFirst;
+    } else {
+        // iOS prefer BGRA8888 (premultiplied) or BGRX8888 bitmapInfo for screen rendering, which is same as `UIGraphicsBeginImageContext()` or `- [CALayer drawInContext:]`
+        // Though you can use any supported bitmapInfo (see: https://developer.apple.com/library/content/documentation/GraphicsImaging/Conceptual/drawingwithquartz2d/dq_context/dq_context.html#//apple_ref/doc/uid/TP30001066-CH203-BCIBHHBB ) and let Core Graphics reorder it when you call `CGContextDrawImage`
+        // But since our build-in coders use this bitmapInfo, this can have a little performance benefit
+        // kCGImageAlphaNone is not supported in CGBitmapContextCreate.
+        // Since the original image here has no alpha info, use kCGImageAlphaNoneSkipFirst
+        // to create bitmap graphics contexts without alpha info.
+        format.bitsPerComponent = 8;
+        format.bytesPerPixel = 4;
+        format.channels = 4;
+        format.colorSpace = [self colorSpaceGetDeviceRGB];
+        format.bitmapInfo = kCGBitmapByteOrder32Host | (hasAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst);
+    }
+    return format;
+}
+
 + (BOOL)CGImageContainsAlpha:(CGImageRef)cgImage {
     if (!cgImage) {
         return NO;
@@ -38,6 +175,19 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     return hasAlpha;
 }
 
+// Whether the premultiplied bitmap of the context has no pixel that is not opaque. The alpha of many images is declared but unused.
++ (BOOL)bitmapContextIsOpaque:(CGContextRef)context opacity:(LCImageOpacity)opacity {
+    CGBitmapInfo bitmapInfo = CGBitmapContextGetBitmapInfo(context);
+    if ((bitmapInfo & kCGBitmapAlphaInfoMask) != kCGImageAlphaPremultipliedFirst || CGBitmapContextGetBitsPerPixel(context) != 32) {
+        return NO;
+    }
+    if (opacity != LCImageOpacityUnknown) {
+        return opacity == LCImageOpacityOpaque;
+    }
+    LCImageBuffer buffer = {CGBitmapContextGetData(context), CGBitmapContextGetWidth(context), CGBitmapContextGetHeight(context), CGBitmapContextGetBytesPerRow(context), 4};
+    return LCImageIsOpaque(&buffer, LCAlphaChannelIndex(bitmapInfo));
+}
+
 + (BOOL)shouldScaleDownImage:(nonnull UIImage *)image limitBytes:(NSUInteger)bytes {
     BOOL shouldScaleDown = YES;
     
@@ -51,7 +201,7 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     }
     CGFloat destTotalPixels;
     if (bytes == 0) {
-        bytes = kDestImageLimitBytes;
+        bytes = LCDestImageLimitBytes();
     }
     bytes = MAX(bytes, kBytesPerPixel);
     destTotalPixels = bytes / kBytesPerPixel;
@@ -66,6 +216,10 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
 }
 
 + (CGImageRef)CGImageCreateDecoded:(CGImageRef)cgImage orientation:(CGImagePropertyOrientation)orientation {
+    return [self CGImageCreateDecoded:cgImage orientation:orientation opacity:LCImageOpacityUnknown];
+}
+
++ (CGImageRef)CGImageCreateDecoded:(CGImageRef)cgImage orientation:(CGImagePropertyOrientation)orientation opacity:(LCImageOpacity)opacity {
     if (!cgImage) {
         return NULL;
     }
@@ -91,22 +245,22 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
             break;
     }
     
-    BOOL hasAlpha = [self CGImageContainsAlpha:cgImage];
-    // iOS prefer BGRA8888 (premultiplied) or BGRX8888 bitmapInfo for screen rendering, which is same as `UIGraphicsBeginImageContext()` or `- [CALayer drawInContext:]`
-    // Though you can use any supported bitmapInfo (see: https://developer.apple.com/library/content/documentation/GraphicsImaging/Conceptual/drawingwithquartz2d/dq_context/dq_context.html#//apple_ref/doc/uid/TP30001066-CH203-BCIBHHBB ) and let Core Graphics reorder it when you call `CGContextDrawImage`
-    // But since our build-in coders use this bitmapInfo, this can have a little performance benefit
-    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host;
-    bitmapInfo |= hasAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst;
-    CGContextRef context = CGBitmapContextCreate(NULL, newWidth, newHeight, 8, 0, [self colorSpaceGetDeviceRGB], bitmapInfo);
+    LCPixelFormat format = [self decodedPixelFormatForImage:cgImage pixelCount:newWidth * newHeight];
+    // the pixels live in a pooled buffer, handed over to the image without a copy
+    LCImageBufferPool *bufferPool = [LCImageBufferPool sharedPool];
+    CGContextRef context = [bufferPool newBitmapContextWithWidth:newWidth height:newHeight bitsPerComponent:format.bitsPerComponent bytesPerRow:LCAlignedBytesPerRow(newWidth, format.bytesPerPixel) colorSpace:format.colorSpace bitmapInfo:format.bitmapInfo];
     if (!context) {
         return NULL;
     }
+    // a reused buffer holds an old image, overwrite it rather than blend over it
+    CGContextSetBlendMode(context, kCGBlendModeCopy);
     
     // Apply transform
     CGAffineTransform transform = SDCGContextTransformFromOrientation(orientation, CGSizeMake(newWidth, newHeight));
     CGContextConcatCTM(context, transform);
     CGContextDrawImage(context, CGRectMake(0, 0, width, height), cgImage); // The rect is bounding box of CGImage, don't swap width & height
-    CGImageRef newImageRef = CGBitmapContextCreateImage(context);
+    CGBitmapInfo bitmapInfo = [self bitmapContextIsOpaque:context opacity:opacity] ? LCOpaqueBitmapInfo(format.bitmapInfo) : format.bitmapInfo;
+    CGImageRef newImageRef = [bufferPool newImageFromBitmapContext:context bitmapInfo:bitmapInfo];
     CGContextRelease(context);
     
     return newImageRef;
@@ -168,11 +322,15 @@ static inline CGAffineTransform SDCGContextTransformFromOrientation(CGImagePrope
 }
 
 + (UIImage *)lc_decodedImageWithImage:(UIImage *)image {
+    return [self decodedImageWithImage:image opacity:LCImageOpacityUnknown];
+}
+
++ (UIImage *)decodedImageWithImage:(UIImage *)image opacity:(LCImageOpacity)opacity {
     if (!image) {
         return image;
     }
     
-    CGImageRef imageRef = [self CGImageCreateDecoded:image.CGImage];
+    CGImageRef imageRef = [self CGImageCreateDecoded:image.CGImage orientation:kCGImagePropertyOrientationUp opacity:opacity];
     if (!imageRef) {
         return image;
     }
@@ -183,18 +341,29 @@ static inline CGAffineTransform SDCGContextTransformFromOrientation(CGImagePrope
 }
 
 + (UIImage *)lc_decodedAndScaledDownImageWithImage:(UIImage *)image limitBytes:(NSUInteger)bytes {
+    return [self lc_decodedAndScaledDownImageWithImage:image limitBytes:bytes cancelled:nil];
+}
+
++ (UIImage *)lc_decodedAndScaledDownImageWithImage:(UIImage *)image limitBytes:(NSUInteger)bytes cancelled:(BOOL (^)(void))cancelled {
+    return [self decodedAndScaledDownImageWithImage:image limitBytes:bytes opacity:LCImageOpacityUnknown cancelled:cancelled];
+}
+
++ (UIImage *)decodedAndScaledDownImageWithImage:(UIImage *)image limitBytes:(NSUInteger)bytes opacity:(LCImageOpacity)opacity cancelled:(BOOL (^)(void))cancelled {
     if (!image) {
         return image;
     }
+    if (cancelled && cancelled()) {
+        return nil;
+    }
     
     if (![self shouldScaleDownImage:image limitBytes:bytes]) {
-        return [self lc_decodedImageWithImage:image];
+        return [self decodedImageWithImage:image opacity:opacity];
     }
     
     CGFloat destTotalPixels;
     CGFloat tileTotalPixels;
     if (bytes == 0) {
-        bytes = kDestImageLimitBytes;
+        bytes = LCDestImageLimitBytes();
     }
     destTotalPixels = bytes / kBytesPerPixel;
     tileTotalPixels = destTotalPixels / 3;
@@ -216,29 +385,21 @@ static inline CGAffineTransform SDCGContextTransformFromOrientation(CGImagePrope
         destResolution.width = MAX(1, (int)(sourceResolution.width * imageScale));
         destResolution.height = MAX(1, (int)(sourceResolution.height * imageScale));
         
-        // device color space
-        CGColorSpaceRef colorspaceRef = [self colorSpaceGetDeviceRGB];
-        BOOL hasAlpha = [self CGImageContainsAlpha:sourceImageRef];
-        // iOS display alpha info (BGRA8888/BGRX8888)
-        CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host;
-        bitmapInfo |= hasAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst;
+        // BGRA8888/BGRX8888, or 8 bits gray, the resampler works on 8 bits channels
+        LCPixelFormat format = [self decodedPixelFormatForImage:sourceImageRef pixelCount:0];
         
-        // kCGImageAlphaNone is not supported in CGBitmapContextCreate.
-        // Since the original image here has no alpha info, use kCGImageAlphaNoneSkipFirst
-        // to create bitmap graphics contexts without alpha info.
-        destContext = CGBitmapContextCreate(NULL,
-                                            destResolution.width,
-                                            destResolution.height,
-                                            kBitsPerComponent,
-                                            0,
-                                            colorspaceRef,
-                                            bitmapInfo);
+        // the resampler writes every byte, a reused buffer needs no clearing
+        LCImageBufferPool *bufferPool = [LCImageBufferPool sharedPool];
+        destContext = [bufferPool newBitmapContextWithWidth:destResolution.width
+                                                     height:destResolution.height
+                                           bitsPerComponent:format.bitsPerComponent
+                                                bytesPerRow:LCAlignedBytesPerRow(destResolution.width, format.bytesPerPixel)
+                                                 colorSpace:format.colorSpace
+                                                 bitmapInfo:format.bitmapInfo];
         
         if (destContext == NULL) {
             return image;
         }
-        CGContextSetInterpolationQuality(destContext, kCGInterpolationHigh);
-        
         // Now define the size of the rectangle to be used for the
         // incremental bits from the input image to the output image.
         // we use a source tile width equal to the width of the source
@@ -248,53 +409,87 @@ static inline CGAffineTransform SDCGContextTransformFromOrientation(CGImagePrope
         // band. Therefore we fully utilize all of the pixel data that results
         // from a decoding operation by anchoring our tile size to the full
         // width of the input image.
-        CGRect sourceTile = CGRectZero;
-        sourceTile.size.width = sourceResolution.width;
-        // The source tile height is dynamic. Since we specified the size
-        // of the source tile in MB, see how many rows of pixels high it
-        // can be given the input image width.
-        sourceTile.size.height = MAX(1, (int)(tileTotalPixels / sourceTile.size.width));
-        sourceTile.origin.x = 0.0f;
-        // The output tile is the same proportions as the input tile, but
-        // scaled to image scale.
-        CGRect destTile;
-        destTile.size.width = destResolution.width;
-        destTile.size.height = sourceTile.size.height * imageScale;
-        destTile.origin.x = 0.0f;
-        // The source seem overlap is proportionate to the destination seem overlap.
-        // this is the amount of pixels to overlap each tile as we assemble the output image.
-        float sourceSeemOverlap = (int)((kDestSeemOverlap/destResolution.height)*sourceResolution.height);
-        CGImageRef sourceTileImageRef;
+        // The bands are drawn in parallel on the idle slots of the decode
+        // scheduler, each one into its own rows of the destination buffer,
+        // so the tiles in flight share the memory one tile used to take.
+        NSUInteger processorCount = [NSProcessInfo processInfo].activeProcessorCount;
+        NSUInteger reservedSlotCount = [[LCImageDecodeScheduler sharedScheduler] reserveIdleDecodeSlots:MAX(processorCount, 1) - 1];
+        NSUInteger workerCount = 1 + reservedSlotCount;
+        CGFloat sourceTileHeight = MAX(1, (int)(tileTotalPixels / workerCount / sourceResolution.width));
         // calculate the number of read/write operations required to assemble the
-        // output image.
-        int iterations = (int)( sourceResolution.height / sourceTile.size.height );
-        // If tile height doesn't divide the image height evenly, add another iteration
-        // to account for the remaining pixels.
-        int remainder = (int)sourceResolution.height % (int)sourceTile.size.height;
-        if(remainder) {
-            iterations++;
-        }
-        // Add seem overlaps to the tiles, but save the original tile height for y coordinate calculations.
-        float sourceTileHeightMinusOverlap = sourceTile.size.height;
-        sourceTile.size.height += sourceSeemOverlap;
-        destTile.size.height += kDestSeemOverlap;
-        for( int y = 0; y < iterations; ++y ) {
-            @autoreleasepool {
-                sourceTile.origin.y = y * sourceTileHeightMinusOverlap + sourceSeemOverlap;
-                destTile.origin.y = destResolution.height - (( y + 1 ) * sourceTileHeightMinusOverlap * imageScale + kDestSeemOverlap);
-                sourceTileImageRef = CGImageCreateWithImageInRect( sourceImageRef, sourceTile );
-                if( y == iterations - 1 && remainder ) {
-                    float dify = destTile.size.height;
-                    destTile.size.height = CGImageGetHeight( sourceTileImageRef ) * imageScale;
-                    dify -= destTile.size.height;
-                    destTile.origin.y += dify;
+        // output image, each band takes an even share of the destination rows.
+        size_t destHeight = CGBitmapContextGetHeight(destContext);
+        size_t iterations = MIN((size_t)ceil(sourceResolution.height / sourceTileHeight), destHeight);
+        workerCount = MIN(workerCount, iterations);
+
+        LCImageResampleQuality quality = [self lc_resampleQuality];
+        CGImageAlphaInfo alphaInfo = format.bitmapInfo & kCGBitmapAlphaInfoMask;
+        int alphaChannel = alphaInfo == kCGImageAlphaPremultipliedFirst ? LCAlphaChannelIndex(format.bitmapInfo) : -1;
+        uint8_t *destData = CGBitmapContextGetData(destContext);
+        size_t destBytesPerRow = CGBitmapContextGetBytesPerRow(destContext);
+        // shared by the workers, dispatch_apply returns once they are all done so the flags outlive them
+        atomic_bool isCancelled = false;
+        atomic_bool isFailed = false;
+        atomic_bool *cancelledFlag = &isCancelled;
+        atomic_bool *failedFlag = &isFailed;
+        dispatch_apply(workerCount, dispatch_get_global_queue(qos_class_self(), 0), ^(size_t worker) {
+            for (size_t y = worker; y < iterations; y += workerCount) {
+                if (atomic_load(failedFlag)) {
+                    return;
+                }
+                // nobody wants the image anymore, drop the partially drawn buffer
+                if (atomic_load(cancelledFlag) || (cancelled && cancelled())) {
+                    atomic_store(cancelledFlag, true);
+                    return;
+                }
+                @autoreleasepool {
+                    // the rows of the band, top down, disjoint from the other bands
+                    size_t destTop = y * destHeight / iterations;
+                    size_t destBottom = (y + 1) * destHeight / iterations;
+                    // the source rows the filter reads, the bands overlap by its radius and meet without seams
+                    size_t sourceTop, sourceHeight;
+                    LCImageResampleSourceRows(destTop, destBottom - destTop, destHeight, sourceResolution.height, quality, &sourceTop, &sourceHeight);
+                    CGImageRef sourceTileImageRef = CGImageCreateWithImageInRect(sourceImageRef, CGRectMake(0, sourceTop, sourceResolution.width, sourceHeight));
+                    if (sourceTileImageRef == NULL) {
+                        // the rows of the band would keep the bytes of a previous use of the buffer
+                        atomic_store(failedFlag, true);
+                        return;
+                    }
+                    // decode the tile once at its own size, only converting it to the destination format
+                    CGContextRef tileContext = [bufferPool newBitmapContextWithWidth:sourceResolution.width
+                                                                              height:sourceHeight
+                                                                    bitsPerComponent:format.bitsPerComponent
+                                                                         bytesPerRow:LCAlignedBytesPerRow(sourceResolution.width, format.bytesPerPixel)
+                                                                          colorSpace:format.colorSpace
+                                                                          bitmapInfo:format.bitmapInfo];
+                    if (tileContext == NULL) {
+                        CGImageRelease(sourceTileImageRef);
+                        atomic_store(failedFlag, true);
+                        return;
+                    }
+                    CGContextSetBlendMode(tileContext, kCGBlendModeCopy);
+                    CGContextDrawImage(tileContext, CGRectMake(0, 0, sourceResolution.width, sourceHeight), sourceTileImageRef);
+                    LCImageBuffer tileBuffer = {CGBitmapContextGetData(tileContext), sourceResolution.width, sourceHeight, CGBitmapContextGetBytesPerRow(tileContext), format.channels};
+                    LCImageBuffer bandBuffer = {destData + destTop * destBytesPerRow, destResolution.width, destBottom - destTop, destBytesPerRow, format.channels};
+                    LCImageResampleRows(&tileBuffer, sourceTop, sourceResolution.height, &bandBuffer, destTop, destHeight, quality, alphaChannel);
+                    [bufferPool recycleBitmapContext:tileContext];
+                    CGImageRelease(sourceTileImageRef);
                 }
-                CGContextDrawImage( destContext, destTile, sourceTileImageRef );
-                CGImageRelease( sourceTileImageRef );
             }
+        });
+        [[LCImageDecodeScheduler sharedScheduler] releaseDecodeSlots:reservedSlotCount];
+        if (atomic_load(&isCancelled)) {
+            [bufferPool recycleBitmapContext:destContext];
+            return nil;
+        }
+        // a band was left undrawn, the image is returned as is like the other failures
+        if (atomic_load(&isFailed)) {
+            [bufferPool recycleBitmapContext:destContext];
+            return image;
         }
         
-        CGImageRef destImageRef = CGBitmapContextCreateImage(destContext);
+        CGBitmapInfo destBitmapInfo = [self bitmapContextIsOpaque:destContext opacity:opacity] ? LCOpaqueBitmapInfo(format.bitmapInfo) : format.bitmapInfo;
+        CGImageRef destImageRef = [bufferPool newImageFromBitmapContext:destContext bitmapInfo:destBitmapInfo];
         CGContextRelease(destContext);
         if (destImageRef == NULL) {
             return image;
@@ -309,6 +504,119 @@ static inline CGAffineTransform SDCGContextTransformFromOrientation(CGImagePrope
     }
 }
 
++ (UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize cancelled:(BOOL (^)(void))cancelled {
+    return [self lc_decodedAndScaledDownImageWithData:data limitBytes:bytes maximumPixelSize:maximumPixelSize targetPixelSize:CGSizeZero contentMode:UIViewContentModeScaleToFill cancelled:cancelled];
+}
+
+// The scale at which the image still covers, or fits in, the target. Modes that don't scale the image need it at full size.
+static CGFloat LCTargetScale(CGFloat width, CGFloat height, CGSize targetPixelSize, UIViewContentMode contentMode) {
+    if (targetPixelSize.width <= 0 || targetPixelSize.height <= 0) {
+        return 1;
+    }
+    CGFloat widthScale = targetPixelSize.width / width;
+    CGFloat heightScale = targetPixelSize.height / height;
+    switch (contentMode) {
+        case UIViewContentModeScaleAspectFit:
+            return MIN(1, MIN(widthScale, heightScale));
+        case UIViewContentModeScaleToFill:
+        case UIViewContentModeScaleAspectFill:
+        case UIViewContentModeRedraw:
+            return MIN(1, MAX(widthScale, heightScale));
+        default:
+            return 1;
+    }
+}
+
++ (CGSize)lc_decodedPixelSizeForPixelSize:(CGSize)pixelSize limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode {
+    CGFloat width = pixelSize.width;
+    CGFloat height = pixelSize.height;
+    if (width <= 0 || height <= 0) {
+        return pixelSize;
+    }
+    if (bytes == 0) {
+        bytes = LCDestImageLimitBytes();
+    }
+    CGFloat destTotalPixels = MAX(bytes, kBytesPerPixel) / kBytesPerPixel;
+    CGFloat longSide = MAX(width, height);
+    CGFloat longSidePixelSize = longSide * MIN(1, sqrt(destTotalPixels / (width * height)));
+    if (maximumPixelSize > 0) {
+        longSidePixelSize = MIN(longSidePixelSize, maximumPixelSize);
+    }
+    longSidePixelSize = MIN(longSidePixelSize, ceil(longSide * LCTargetScale(width, height, targetPixelSize, contentMode)));
+    if (longSidePixelSize >= longSide) {
+        return pixelSize;
+    }
+    // the thumbnail keeps the aspect ratio of the image, its long side is the maximum pixel size
+    CGFloat scale = MAX(1, floor(longSidePixelSize)) / longSide;
+    return CGSizeMake(MAX(1, round(width * scale)), MAX(1, round(height * scale)));
+}
+
++ (UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode cancelled:(BOOL (^)(void))cancelled {
+    return [self lc_decodedAndScaledDownImageWithData:data limitBytes:bytes maximumPixelSize:maximumPixelSize targetPixelSize:targetPixelSize contentMode:contentMode opacity:LCImageOpacityUnknown cancelled:cancelled];
+}
+
++ (UIImage *)lc_decodedAndScaledDownImageWithData:(NSData *)data limitBytes:(NSUInteger)bytes maximumPixelSize:(CGFloat)maximumPixelSize targetPixelSize:(CGSize)targetPixelSize contentMode:(UIViewContentMode)contentMode opacity:(LCImageOpacity)opacity cancelled:(BOOL (^)(void))cancelled {
+    if (!data) {
+        return nil;
+    }
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, (__bridge CFDictionaryRef)@{(__bridge NSString *)kCGImageSourceShouldCache: @NO});
+    if (!source) {
+        return nil;
+    }
+    CGFloat thumbnailPixelSize = 0;
+    // animated images keep every frame
+    if (CGImageSourceGetCount(source) == 1) {
+        NSDictionary *properties = CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(source, 0, NULL));
+        CGFloat width = [properties[(__bridge NSString *)kCGImagePropertyPixelWidth] doubleValue];
+        CGFloat height = [properties[(__bridge NSString *)kCGImagePropertyPixelHeight] doubleValue];
+        // the thumbnail is upright, a quarter turn swaps the sides compared with the target
+        CGImagePropertyOrientation orientation = [properties[(__bridge NSString *)kCGImagePropertyOrientation] unsignedIntValue];
+        BOOL swapsSides = orientation == kCGImagePropertyOrientationLeftMirrored || orientation == kCGImagePropertyOrientationRight ||
+                          orientation == kCGImagePropertyOrientationRightMirrored || orientation == kCGImagePropertyOrientationLeft;
+        CGSize pixelSize = swapsSides ? CGSizeMake(height, width) : CGSizeMake(width, height);
+        CGSize decodedPixelSize = [self lc_decodedPixelSizeForPixelSize:pixelSize limitBytes:bytes maximumPixelSize:maximumPixelSize targetPixelSize:targetPixelSize contentMode:contentMode];
+        if (width > 0 && height > 0 && !CGSizeEqualToSize(decodedPixelSize, pixelSize)) {
+            thumbnailPixelSize = MAX(decodedPixelSize.width, decodedPixelSize.height);
+        }
+    }
+    if (thumbnailPixelSize == 0) {
+        CFRelease(source);
+        UIImage *image = [UIImage imageWithData:data];
+        if (!image) {
+            return nil;
+        }
+        return [self decodedAndScaledDownImageWithImage:image limitBytes:bytes opacity:opacity cancelled:cancelled];
+    }
+    if (cancelled && cancelled()) {
+        CFRelease(source);
+        return nil;
+    }
+    // the decoder produces the smaller bitmap directly, upright
+    NSDictionary *thumbnailOptions = @{(__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                                       (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize: @(thumbnailPixelSize),
+                                       (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                                       (__bridge NSString *)kCGImageSourceShouldCacheImmediately: @YES};
+    CGImageRef imageRef = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)thumbnailOptions);
+    CFRelease(source);
+    if (!imageRef) {
+        return nil;
+    }
+    // ImageIO picks its own format and row stride. Redraw the thumbnail once here, off the main thread, when Core Animation
+    // would otherwise copy it at commit time, when a smaller format holds it, or to drop an unused alpha
+    LCPixelFormat format = [self decodedPixelFormatForImage:imageRef pixelCount:CGImageGetWidth(imageRef) * CGImageGetHeight(imageRef)];
+    BOOL mayBeOpaque = [self CGImageContainsAlpha:imageRef] && opacity != LCImageOpacityTranslucent;
+    if (!LCImageMatchesPixelFormat(imageRef, format) || mayBeOpaque) {
+        CGImageRef decodedImageRef = [self CGImageCreateDecoded:imageRef orientation:kCGImagePropertyOrientationUp opacity:opacity];
+        if (decodedImageRef) {
+            CGImageRelease(imageRef);
+            imageRef = decodedImageRef;
+        }
+    }
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:1 orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
 
 @end
 
@@ -8,6 +8,7 @@
 
 #import "UIImageView+LCWebImage.h"
 #import <objc/runtime.h>
+#import "LCWebImageTrace.h"
 
 @interface UIImageView (_LCWebImage)
 @property (readwrite, nonatomic, strong, setter = lc_setActiveImageDownloadReceipt:) LCImageDownloadReceipt *lc_activeImageDownloadReceipt;
@@ -75,17 +76,21 @@
         return;
     }
     
+    NSDictionary<NSString *, id> *context = [self lc_imageContext];
+    urlRequest = [[[self class] lc_sharedImageManager] transformedRequestForRequest:urlRequest context:context];
     if ([self isActiveTaskURLEqualToURLRequest:urlRequest]) {
         return;
     }
     
+    uint64_t traceID = LC_TRACE_BEGIN(LCWebImageTraceStageSetImage, urlRequest.URL.absoluteString, 0);
     [self lc_cancelImageDownloadTask];
     
     LCWebImageManager *downloader = [[self class] lc_sharedImageManager];
     id <LCImageCache> imageCache = downloader.imageCache;
+    NSString *cacheKey = [downloader cacheKeyForURL:urlRequest.URL];
     
     //Use the image from the image cache if it exists
-    UIImage *cachedImage = [imageCache memoryImageWithIdentifier:urlRequest.URL.absoluteString];
+    UIImage *cachedImage = [downloader memoryImageForURL:urlRequest.URL context:context];
     if (cachedImage) {
         if (success) {
             success(urlRequest, nil, cachedImage);
@@ -94,10 +99,10 @@
         }
         [self clearActiveDownloadInformation];
     } else if (!(options & LCWebImageOptionIgnoreDiskCache) &&
-               [imageCache containsDiskDataWithIdentifier:urlRequest.URL.absoluteString]) {
+               [imageCache containsDiskDataWithIdentifier:cacheKey]) {
         NSUUID *downloadID = [NSUUID UUID];
         __weak __typeof(self)weakSelf = self;
-        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID completion:^(UIImage * _Nonnull image) {
+        LCImageDownloadReceipt *receipt = [downloader diskImageForURL:urlRequest.URL withReceiptID:downloadID context:context completion:^(UIImage * _Nonnull image) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([strongSelf.lc_activeImageDownloadReceipt.receiptID isEqual:downloadID]) {
                 if (success) {
@@ -125,6 +130,7 @@
                    downloadImageForURLRequest:urlRequest
                    withReceiptID:downloadID
                    options:options
+                   context:context
                    success:^(NSURLRequest * _Nonnull request, NSHTTPURLResponse * _Nullable response, UIImage * _Nonnull responseObject) {
             __strong __typeof(weakSelf)strongSelf = weakSelf;
             if ([strongSelf.lc_activeImageDownloadReceipt.receiptID isEqual:downloadID]) {
@@ -155,6 +161,7 @@
         
         self.lc_activeImageDownloadReceipt = receipt;
     }
+    LC_TRACE_END(LCWebImageTraceStageSetImage, traceID, 0);
 }
 
 - (void)lc_cancelImageDownloadTask {
@@ -164,12 +171,31 @@
     }
 }
 
+// The size the image is displayed at, empty before the first layout.
+- (NSDictionary<NSString *, id> *)lc_imageContext {
+    CGFloat scale = self.window.screen.scale ?: [UIScreen mainScreen].scale;
+    CGFloat contentScale = self.contentScaleFactor;
+    CGSize size = self.bounds.size;
+    NSMutableDictionary<NSString *, id> *context = [NSMutableDictionary dictionary];
+    context[LCWebImageContextScreenScaleKey] = @(scale);
+    context[LCWebImageContextContentModeKey] = @(self.contentMode);
+    if (size.width > 0 && size.height > 0) {
+        context[LCWebImageContextTargetPixelSizeKey] = [NSValue valueWithCGSize:CGSizeMake(ceil(size.width * contentScale), ceil(size.height * contentScale))];
+    }
+    return context;
+}
+
 - (void)clearActiveDownloadInformation {
     self.lc_activeImageDownloadReceipt = nil;
 }
 
 - (BOOL)isActiveTaskURLEqualToURLRequest:(NSURLRequest *)urlRequest {
-    return [self.lc_activeImageDownloadReceipt.url.absoluteString isEqualToString:urlRequest.URL.absoluteString];
+    LCImageDownloadReceipt *receipt = self.lc_activeImageDownloadReceipt;
+    if (receipt == nil) {
+        return NO;
+    }
+    LCWebImageManager *downloader = [[self class] lc_sharedImageManager];
+    return [[downloader cacheKeyForURL:receipt.url] isEqualToString:[downloader cacheKeyForURL:urlRequest.URL]];
 }
 
 @end
@@ -0,0 +1,189 @@
+// LCImageKernelsTests.c
+//
+// LCWebImage (https://github.com/iLiuChang/LCWebImage)
+//
+// Created by 刘畅 on 2026/10/19.
+// Copyright © 2026 LiuChang. All rights reserved.
+//
+
+/*
+ Checks the pixel kernels against whole-image and scalar references. Run with `make -C Tests`.
+ */
+
+#include "LCImageKernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failureCount = 0;
+
+#define LCExpect(condition, ...) do { \
+    if (!(condition)) { \
+        failureCount += 1; \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+static uint32_t randomState = 0x12345678;
+
+// A fixed sequence, the failures reproduce.
+static uint32_t LCRandom(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Rows padded past the pixels, the kernels must not read or write the padding as pixels.
+static LCImageBuffer LCNewBuffer(size_t width, size_t height, size_t channels) {
+    LCImageBuffer buffer = {NULL, width, height, width * channels + 16, channels};
+    buffer.data = calloc(buffer.bytesPerRow, height);
+    return buffer;
+}
+
+// Random pixels, premultiplied when the image has an alpha channel.
+static void LCFillBuffer(LCImageBuffer *buffer, int alphaChannel) {
+    for (size_t y = 0; y < buffer->height; y++) {
+        uint8_t *row = buffer->data + y * buffer->bytesPerRow;
+        for (size_t x = 0; x < buffer->width; x++) {
+            uint8_t *pixel = row + x * buffer->channels;
+            uint8_t alpha = (uint8_t)LCRandom();
+            for (size_t c = 0; c < buffer->channels; c++) {
+                uint8_t value = (uint8_t)LCRandom();
+                pixel[c] = alphaChannel < 0 ? value : (int)c == alphaChannel ? alpha : (uint8_t)(value * alpha / 255);
+            }
+        }
+    }
+}
+
+static int LCCompareBuffers(const LCImageBuffer *a, const LCImageBuffer *b) {
+    for (size_t y = 0; y < a->height; y++) {
+        if (memcmp(a->data + y * a->bytesPerRow, b->data + y * b->bytesPerRow, a->width * a->channels) != 0) {
+            return (int)y;
+        }
+    }
+    return -1;
+}
+
+// Resamples band by band, the way the decoder splits the destination rows between its workers.
+static void LCResampleInBands(const LCImageBuffer *source, LCImageBuffer *destination, size_t bandCount, LCImageResampleQuality quality, int alphaChannel) {
+    for (size_t band = 0; band < bandCount; band++) {
+        size_t destinationTop = band * destination->height / bandCount;
+        size_t destinationBottom = (band + 1) * destination->height / bandCount;
+        if (destinationBottom == destinationTop) {
+            continue;
+        }
+        size_t sourceTop, sourceHeight;
+        LCImageResampleSourceRows(destinationTop, destinationBottom - destinationTop, destination->height, source->height, quality, &sourceTop, &sourceHeight);
+        LCExpect(sourceTop + sourceHeight <= source->height, "source rows %zu+%zu past the height %zu", sourceTop, sourceHeight, source->height);
+        LCImageBuffer sourceBand = {source->data + sourceTop * source->bytesPerRow, source->width, sourceHeight, source->bytesPerRow, source->channels};
+        LCImageBuffer destinationBand = {destination->data + destinationTop * destination->bytesPerRow, destination->width, destinationBottom - destinationTop, destination->bytesPerRow, destination->channels};
+        bool resampled = LCImageResampleRows(&sourceBand, sourceTop, source->height, &destinationBand, destinationTop, destination->height, quality, alphaChannel);
+        LCExpect(resampled, "band %zu of %zu was not resampled", band, bandCount);
+    }
+}
+
+static void LCTestBandedResampling(void) {
+    const size_t sizes[][4] = {
+        // source width, source height, destination width, destination height
+        {640, 480, 160, 120},
+        {333, 517, 100, 31},
+        {97, 1000, 13, 77},
+        {50, 40, 120, 90},
+        {7, 300, 7, 299},
+    };
+    const size_t bandCounts[] = {1, 2, 3, 7, 16};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t channels = 1; channels <= 4; channels += 3) {
+            int alphaChannel = channels == 4 ? 3 : -1;
+            LCImageBuffer source = LCNewBuffer(sizes[s][0], sizes[s][1], channels);
+            LCFillBuffer(&source, alphaChannel);
+            for (int quality = LCImageResampleQualityLow; quality <= LCImageResampleQualityHigh; quality++) {
+                LCImageBuffer whole = LCNewBuffer(sizes[s][2], sizes[s][3], channels);
+                LCExpect(LCImageResample(&source, &whole, (LCImageResampleQuality)quality, alphaChannel), "the whole image was not resampled");
+                for (size_t b = 0; b < sizeof(bandCounts) / sizeof(bandCounts[0]); b++) {
+                    LCImageBuffer banded = LCNewBuffer(sizes[s][2], sizes[s][3], channels);
+                    memset(banded.data, 0xA5, banded.bytesPerRow * banded.height);
+                    LCResampleInBands(&source, &banded, bandCounts[b], (LCImageResampleQuality)quality, alphaChannel);
+                    int row = LCCompareBuffers(&whole, &banded);
+                    LCExpect(row < 0, "%zux%zu to %zux%zu, %zu channels, quality %d, %zu bands: row %d differs from the whole image",
+                             sizes[s][0], sizes[s][1], sizes[s][2], sizes[s][3], channels, quality, bandCounts[b], row);
+                    free(banded.data);
+                }
+                if (alphaChannel >= 0) {
+                    for (size_t y = 0; y < whole.height; y++) {
+                        for (size_t x = 0; x < whole.width; x++) {
+                            const uint8_t *pixel = whole.data + y * whole.bytesPerRow + x * 4;
+                            LCExpect(pixel[0] <= pixel[3] && pixel[1] <= pixel[3] && pixel[2] <= pixel[3], "pixel %zu,%zu is not premultiplied", x, y);
+                        }
+                    }
+                }
+                free(whole.data);
+            }
+            free(source.data);
+        }
+    }
+}
+
+static bool LCScalarIsOpaque(const LCImageBuffer *buffer, int alphaChannel) {
+    if (alphaChannel < 0) {
+        return true;
+    }
+    for (size_t y = 0; y < buffer->height; y++) {
+        for (size_t x = 0; x < buffer->width; x++) {
+            if (buffer->data[y * buffer->bytesPerRow + x * buffer->channels + alphaChannel] != 0xFF) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void LCTestOpacityScan(void) {
+    const size_t widths[] = {1, 3, 15, 16, 17, 31, 64, 100};
+    const size_t heights[] = {1, 2, 5};
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); h++) {
+            for (int alphaChannel = 0; alphaChannel < 4; alphaChannel++) {
+                // opaque pixels, with transparent padding the scan must skip
+                LCImageBuffer buffer = LCNewBuffer(widths[w], heights[h], 4);
+                for (size_t y = 0; y < buffer.height; y++) {
+                    for (size_t x = 0; x < buffer.width; x++) {
+                        uint8_t *pixel = buffer.data + y * buffer.bytesPerRow + x * 4;
+                        for (int c = 0; c < 4; c++) {
+                            pixel[c] = c == alphaChannel ? 0xFF : (uint8_t)LCRandom();
+                        }
+                    }
+                }
+                LCExpect(LCImageIsOpaque(&buffer, alphaChannel) == LCScalarIsOpaque(&buffer, alphaChannel), "%zux%zu opaque image, alpha %d", buffer.width, buffer.height, alphaChannel);
+                // a single pixel that is not opaque, at every position
+                for (size_t y = 0; y < buffer.height; y++) {
+                    for (size_t x = 0; x < buffer.width; x++) {
+                        uint8_t *alpha = buffer.data + y * buffer.bytesPerRow + x * 4 + alphaChannel;
+                        *alpha = (uint8_t)(LCRandom() % 0xFF);
+                        LCExpect(LCImageIsOpaque(&buffer, alphaChannel) == LCScalarIsOpaque(&buffer, alphaChannel), "%zux%zu image, alpha %d, pixel %zu,%zu", buffer.width, buffer.height, alphaChannel, x, y);
+                        *alpha = 0xFF;
+                    }
+                }
+                free(buffer.data);
+            }
+        }
+    }
+    LCImageBuffer gray = LCNewBuffer(33, 3, 1);
+    LCExpect(LCImageIsOpaque(&gray, -1), "an image without alpha is opaque");
+    free(gray.data);
+}
+
+int main(void) {
+    LCTestBandedResampling();
+    LCTestOpacityScan();
+    if (failureCount > 0) {
+        fprintf(stderr, "%d failures\n", failureCount);
+        return 1;
+    }
+    printf("LCImageKernels tests passed\n");
+    return 0;
+}